@@ -0,0 +1,359 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <string.h>
+
+#include "jobs.h"
+#include "particles.h"
+#include "world.h"
+
+// Python bindings for libparticles. A World's array attributes are views
+// straight into the engine's memory through the buffer protocol, so
+// numpy.asarray(world.positions) or memoryview(world.positions) copies
+// nothing and sees every step as it happens.
+
+typedef struct {
+    PyObject_HEAD
+    struct World* world;
+    // Views alive, counting those only kept alive by a buffer taken from
+    // them. Each holds a pointer into the arrays, so while any are alive
+    // reserve refuses to grow them and __init__ to replace them.
+    int exports;
+    int stepping;
+} WorldObject;
+
+typedef struct {
+    PyObject_HEAD
+    WorldObject* owner;
+    char* data;
+    char format[2];
+    int ndim;
+    int readonly;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+} ViewObject;
+
+static PyTypeObject ViewType;
+
+// Worlds being stepped with the GIL released, anywhere in the process.
+static int stepping_worlds = 0;
+
+static int view_getbuffer (ViewObject* self, Py_buffer* view, int flags) {
+    if ((flags & PyBUF_WRITABLE) && self->readonly) {
+        PyErr_SetString(PyExc_BufferError, "this array is read-only");
+        return -1;
+    }
+    int contiguous = self->ndim == 1 || self->strides[0] == self->shape[1] * self->strides[1];
+    if (!contiguous && (flags & PyBUF_STRIDES) != PyBUF_STRIDES) {
+        PyErr_SetString(PyExc_BufferError, "this array is strided; ask for a strided buffer");
+        return -1;
+    }
+
+    view->buf = self->data;
+    view->obj = (PyObject*)self;
+    Py_INCREF(self);
+    view->itemsize = 4;
+    view->len = view->itemsize;
+    for (int d = 0; d < self->ndim; d++) {
+        view->len *= self->shape[d];
+    }
+    view->readonly = self->readonly;
+    view->ndim = self->ndim;
+    view->format = (flags & PyBUF_FORMAT) ? self->format : NULL;
+    view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static void view_dealloc (ViewObject* self) {
+    self->owner->exports--;
+    Py_DECREF(self->owner);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyBufferProcs view_as_buffer = {
+    (getbufferproc)view_getbuffer,
+    NULL,
+};
+
+static PyTypeObject ViewType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "particles.View",
+    .tp_doc = "Array inside a World, exported through the buffer protocol.",
+    .tp_basicsize = sizeof(ViewObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = (destructor)view_dealloc,
+    .tp_as_buffer = &view_as_buffer,
+};
+
+// A view of one field, or of two fields as a (2, count) array whose rows are
+// the fields' distance apart.
+static PyObject* make_view (WorldObject* owner, const void* first, const void* second, char format, int readonly) {
+    ViewObject* view = PyObject_New(ViewObject, &ViewType);
+    if (view == NULL) return NULL;
+
+    Py_INCREF(owner);
+    view->owner = owner;
+    owner->exports++;
+    view->data = (char*)first;
+    view->format[0] = format;
+    view->format[1] = '\0';
+    view->readonly = readonly;
+    if (second == NULL) {
+        view->ndim = 1;
+        view->shape[0] = owner->world->count;
+        view->strides[0] = 4;
+    } else {
+        view->ndim = 2;
+        view->shape[0] = 2;
+        view->shape[1] = owner->world->count;
+        view->strides[0] = (const char*)second - (const char*)first;
+        view->strides[1] = 4;
+    }
+    return (PyObject*)view;
+}
+
+static int check_idle (WorldObject* self) {
+    if (self->world == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "world is not initialised");
+        return 0;
+    }
+    if (self->stepping) {
+        PyErr_SetString(PyExc_RuntimeError, "world is being stepped by another thread");
+        return 0;
+    }
+    return 1;
+}
+
+static int world_init (WorldObject* self, PyObject* args, PyObject* kwargs) {
+    static char* keywords[] = {"capacity", "fluid", "solver", "iterations", "gravity", "restitution", NULL};
+    int capacity;
+    int fluid = 0;
+    const char* solver = "impulse";
+    int iterations = 4;
+    float gravity = WORLD_DEFAULT_GRAVITY;
+    float restitution = WORLD_DEFAULT_RESTITUTION;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "i|psiff", keywords, &capacity, &fluid, &solver, &iterations,
+                                     &gravity, &restitution)) {
+        return -1;
+    }
+
+    struct WorldConfig config = {capacity, fluid, SOLVER_IMPULSE, iterations};
+    if (strcmp(solver, "pbd") == 0) {
+        config.solver = SOLVER_PBD;
+    } else if (strcmp(solver, "impulse") != 0) {
+        PyErr_Format(PyExc_ValueError, "unknown solver %s", solver);
+        return -1;
+    }
+    if (capacity < 1 || iterations < 1) {
+        PyErr_SetString(PyExc_ValueError, "capacity and iterations must be positive");
+        return -1;
+    }
+
+    if (self->world != NULL) {
+        if (!check_idle(self)) return -1;
+        if (self->exports > 0) {
+            PyErr_SetString(PyExc_BufferError, "world arrays are still in use");
+            return -1;
+        }
+        world_destroy(self->world);
+    }
+    self->world = world_create(&config);
+    world_set_gravity(self->world, gravity);
+    world_set_restitution(self->world, restitution);
+    return 0;
+}
+
+static void world_dealloc (WorldObject* self) {
+    if (self->world != NULL) world_destroy(self->world);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject* world_add_method (WorldObject* self, PyObject* args, PyObject* kwargs) {
+    static char* keywords[] = {"x", "y", "x_vel", "y_vel", "radius", NULL};
+    float x_pos, y_pos;
+    float x_vel = 0.0f;
+    float y_vel = 0.0f;
+    float radius = 0.01f;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "ff|fff", keywords, &x_pos, &y_pos, &x_vel, &y_vel, &radius)) return NULL;
+    if (!check_idle(self)) return NULL;
+
+    int id = world_add(self->world, x_pos, y_pos, x_vel, y_vel, radius);
+    if (id < 0) {
+        PyErr_SetString(PyExc_MemoryError, "world is full; reserve more capacity");
+        return NULL;
+    }
+    return PyLong_FromLong(id);
+}
+
+static PyObject* world_remove_method (WorldObject* self, PyObject* args) {
+    int id;
+    if (!PyArg_ParseTuple(args, "i", &id)) return NULL;
+    if (!check_idle(self)) return NULL;
+    return PyBool_FromLong(world_remove(self->world, id));
+}
+
+static PyObject* world_index_method (WorldObject* self, PyObject* args) {
+    int id;
+    if (!PyArg_ParseTuple(args, "i", &id)) return NULL;
+    if (!check_idle(self)) return NULL;
+    return PyLong_FromLong(world_index(self->world, id));
+}
+
+static PyObject* world_reserve_method (WorldObject* self, PyObject* args) {
+    int capacity;
+    if (!PyArg_ParseTuple(args, "i", &capacity)) return NULL;
+    if (!check_idle(self)) return NULL;
+    if (capacity > self->world->capacity && self->exports > 0) {
+        PyErr_SetString(PyExc_BufferError, "cannot grow while views of the arrays are alive");
+        return NULL;
+    }
+    world_reserve(self->world, capacity);
+    Py_RETURN_NONE;
+}
+
+// Steps without the GIL, so worlds in different threads run side by side.
+static PyObject* world_step_method (WorldObject* self, PyObject* args) {
+    int steps = 1;
+    if (!PyArg_ParseTuple(args, "|i", &steps)) return NULL;
+    if (!check_idle(self)) return NULL;
+
+    self->stepping = 1;
+    stepping_worlds++;
+    Py_BEGIN_ALLOW_THREADS
+    world_step(self->world, steps);
+    Py_END_ALLOW_THREADS
+    stepping_worlds--;
+    self->stepping = 0;
+    Py_RETURN_NONE;
+}
+
+static PyObject* world_stats_method (WorldObject* self, PyObject* unused) {
+    (void)unused;
+    if (!check_idle(self)) return NULL;
+
+    struct WorldStats stats;
+    world_stats(self->world, &stats);
+    return Py_BuildValue("{s:l,s:i,s:i,s:i,s:i,s:f,s:l,s:l,s:i,s:i,s:d,s:d}",
+                         "frame", stats.frame, "count", stats.count, "capacity", stats.capacity,
+                         "links", stats.links, "pairs", stats.pairs, "max_overlap", stats.max_overlap,
+                         "cache_lookups", stats.cache_lookups, "cache_hits", stats.cache_hits,
+                         "island_count", stats.island_count, "largest_island", stats.largest_island,
+                         "kinetic_energy", stats.kinetic_energy, "step_ms", stats.step_ms);
+}
+
+static Py_ssize_t world_length (WorldObject* self) {
+    return self->world != NULL ? self->world->count : 0;
+}
+
+static PyObject* world_get_positions (WorldObject* self, void* closure) {
+    (void)closure;
+    if (self->world == NULL) return PyErr_Format(PyExc_RuntimeError, "world is not initialised");
+    return make_view(self, self->world->balls.x_pos, self->world->balls.y_pos, 'f', 0);
+}
+
+static PyObject* world_get_velocities (WorldObject* self, void* closure) {
+    (void)closure;
+    if (self->world == NULL) return PyErr_Format(PyExc_RuntimeError, "world is not initialised");
+    return make_view(self, self->world->balls.x_vel, self->world->balls.y_vel, 'f', 0);
+}
+
+static PyObject* world_get_radii (WorldObject* self, void* closure) {
+    (void)closure;
+    if (self->world == NULL) return PyErr_Format(PyExc_RuntimeError, "world is not initialised");
+    return make_view(self, self->world->balls.radius, NULL, 'f', 1);
+}
+
+static PyObject* world_get_ids (WorldObject* self, void* closure) {
+    (void)closure;
+    if (self->world == NULL) return PyErr_Format(PyExc_RuntimeError, "world is not initialised");
+    return make_view(self, self->world->ids, NULL, 'i', 1);
+}
+
+static PyMethodDef world_methods[] = {
+    {"add", (PyCFunction)(void (*) (void))world_add_method, METH_VARARGS | METH_KEYWORDS,
+     "add(x, y, x_vel=0, y_vel=0, radius=0.01) -> id"},
+    {"remove", (PyCFunction)world_remove_method, METH_VARARGS,
+     "remove(id) -> bool; the last particle moves into the freed slot"},
+    {"index", (PyCFunction)world_index_method, METH_VARARGS,
+     "index(id) -> position of the particle in the arrays, or -1"},
+    {"reserve", (PyCFunction)world_reserve_method, METH_VARARGS,
+     "reserve(capacity); fails while array views are alive"},
+    {"step", (PyCFunction)world_step_method, METH_VARARGS,
+     "step(n=1) advances n frames with the GIL released"},
+    {"stats", (PyCFunction)world_stats_method, METH_NOARGS,
+     "stats() -> dict of the last frame's figures"},
+    {NULL},
+};
+
+static PyGetSetDef world_getset[] = {
+    {"positions", (getter)world_get_positions, NULL, "(2, count) float32 view: row 0 is x, row 1 is y", NULL},
+    {"velocities", (getter)world_get_velocities, NULL, "(2, count) float32 view of the velocities", NULL},
+    {"radii", (getter)world_get_radii, NULL, "(count,) read-only float32 view of the radii", NULL},
+    {"ids", (getter)world_get_ids, NULL, "(count,) read-only int32 view of the id at each index", NULL},
+    {NULL},
+};
+
+static PySequenceMethods world_as_sequence = {
+    .sq_length = (lenfunc)world_length,
+};
+
+static PyTypeObject WorldType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "particles.World",
+    .tp_doc = "World(capacity, fluid=False, solver='impulse', iterations=4,\n"
+              "      gravity=-0.0005, restitution=0.75)\n\n"
+              "Array views are sized to the particle count when they are taken.",
+    .tp_basicsize = sizeof(WorldObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc)world_init,
+    .tp_dealloc = (destructor)world_dealloc,
+    .tp_methods = world_methods,
+    .tp_getset = world_getset,
+    .tp_as_sequence = &world_as_sequence,
+};
+
+static PyObject* set_threads (PyObject* module, PyObject* args) {
+    (void)module;
+    int count;
+    if (!PyArg_ParseTuple(args, "i", &count)) return NULL;
+    if (stepping_worlds > 0) {
+        PyErr_SetString(PyExc_RuntimeError, "cannot resize the pool while worlds are stepping");
+        return NULL;
+    }
+    jobs_shutdown();
+    jobs_init(count);
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef module_methods[] = {
+    {"set_threads", set_threads, METH_VARARGS,
+     "set_threads(count) sizes the worker pool shared by every world; 0 means one per core"},
+    {NULL},
+};
+
+static struct PyModuleDef particles_module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "particles",
+    .m_doc = "Particle simulation worlds with zero-copy array views.",
+    .m_size = -1,
+    .m_methods = module_methods,
+};
+
+PyMODINIT_FUNC PyInit_particles (void) {
+    if (PyType_Ready(&ViewType) < 0 || PyType_Ready(&WorldType) < 0) return NULL;
+
+    PyObject* module = PyModule_Create(&particles_module);
+    if (module == NULL) return NULL;
+
+    Py_INCREF(&WorldType);
+    if (PyModule_AddObject(module, "World", (PyObject*)&WorldType) < 0) {
+        Py_DECREF(&WorldType);
+        Py_DECREF(module);
+        return NULL;
+    }
+    return module;
+}
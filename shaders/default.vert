@@ -1,6 +1,7 @@
 #version 330 core
 
 layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aInstance;
 void main () {
-    gl_Position = vec4(aPos.x, aPos.y, aPos.z, 1.0);
+    gl_Position = vec4(aInstance.xy + aPos.xy * aInstance.z, aPos.z, 1.0);
 }
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "balls.h"
+
+// One block holds every field, capacity floats apart, so the distance from
+// one field to the next is a fixed stride.
+void balls_alloc (struct Balls* balls, int capacity) {
+    float* block = (float*)calloc((size_t)6 * (capacity > 0 ? capacity : 1), sizeof(float));
+    if (block == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(1);
+    }
+    balls->radius = block;
+    balls->x_pos = block + capacity;
+    balls->y_pos = block + 2 * (size_t)capacity;
+    balls->x_vel = block + 3 * (size_t)capacity;
+    balls->y_vel = block + 4 * (size_t)capacity;
+    balls->mass = block + 5 * (size_t)capacity;
+    balls->mapping = NULL;
+    balls->mapping_size = 0;
+}
+
+void balls_free (struct Balls* balls) {
+    if (balls->mapping != NULL) {
+        munmap(balls->mapping, balls->mapping_size);
+        balls->mapping = NULL;
+        return;
+    }
+
+    free(balls->radius);
+}
+
+static uint64_t hash_field (uint64_t hash, const float* field, int count) {
+    const unsigned char* bytes = (const unsigned char*)field;
+    for (size_t k = 0; k < count * sizeof(float); k++) {
+        hash ^= bytes[k];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t balls_hash (const struct Balls* balls, int count) {
+    uint64_t hash = 14695981039346656037ull;
+    hash = hash_field(hash, balls->radius, count);
+    hash = hash_field(hash, balls->x_pos, count);
+    hash = hash_field(hash, balls->y_pos, count);
+    hash = hash_field(hash, balls->x_vel, count);
+    hash = hash_field(hash, balls->y_vel, count);
+    hash = hash_field(hash, balls->mass, count);
+    return hash;
+}
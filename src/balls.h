@@ -0,0 +1,29 @@
+#ifndef BALLS_H
+#define BALLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Particle store, one array per field so kernels can stream over a single
+// attribute at a time. The fields share one allocation, or one snapshot
+// mapping, so any two of them are a fixed number of bytes apart.
+struct Balls {
+    float* radius;
+    float* x_pos;
+    float* y_pos;
+    float* x_vel;
+    float* y_vel;
+    float* mass;
+
+    // Set when the fields point into a mapped snapshot instead of the heap.
+    void* mapping;
+    size_t mapping_size;
+};
+
+void balls_alloc (struct Balls* balls, int capacity);
+void balls_free (struct Balls* balls);
+
+// FNV-1a over the raw bits of every field, for comparing runs exactly.
+uint64_t balls_hash (const struct Balls* balls, int count);
+
+#endif
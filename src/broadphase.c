@@ -0,0 +1,450 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "broadphase.h"
+
+static void* grow (void* data, int* capacity, int needed, size_t item_size) {
+    if (needed <= *capacity) return data;
+
+    int new_capacity = *capacity > 0 ? *capacity : 256;
+    while (new_capacity < needed) new_capacity *= 2;
+
+    data = realloc(data, new_capacity * item_size);
+    if (data == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(1);
+    }
+    *capacity = new_capacity;
+    return data;
+}
+
+int grid_coord (const struct Grid* grid, float pos) {
+    int coord = (int)((pos + 1.0f) / grid->cell_size);
+    if (coord < 0) coord = 0;
+    if (coord >= grid->cells_per_side) coord = grid->cells_per_side - 1;
+    return coord;
+}
+
+void grid_build (struct Grid* grid, const float* x_pos, const float* y_pos, int count, float cell_size) {
+    float cells = cell_size > 0.0f ? 2.0f / cell_size : 1.0f;
+    if (cells > GRID_MAX_CELLS_PER_SIDE) cells = GRID_MAX_CELLS_PER_SIDE;
+    int cells_per_side = cells < 1.0f ? 1 : (int)cells;
+
+    // Cells are stretched to cover the domain exactly, never shrunk below cell_size.
+    grid->cell_size = 2.0f / cells_per_side;
+    grid->cells_per_side = cells_per_side;
+
+    int cell_count = cells_per_side * cells_per_side;
+    grid->cell_start = grow(grid->cell_start, &grid->cell_capacity, cell_count + 1, sizeof(int));
+
+    // items and ball_cell always grow together, so they share one capacity.
+    int item_capacity = grid->item_capacity;
+    grid->items = grow(grid->items, &item_capacity, count, sizeof(int));
+    grid->ball_cell = grow(grid->ball_cell, &grid->item_capacity, count, sizeof(int));
+
+    for (int c = 0; c <= cell_count; c++) {
+        grid->cell_start[c] = 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int cell = grid_coord(grid, y_pos[i]) * cells_per_side + grid_coord(grid, x_pos[i]);
+        grid->ball_cell[i] = cell;
+        grid->cell_start[cell + 1]++;
+    }
+
+    for (int c = 0; c < cell_count; c++) {
+        grid->cell_start[c + 1] += grid->cell_start[c];
+    }
+
+    // Scatter through a moving cursor per cell, then shift the starts back.
+    for (int i = 0; i < count; i++) {
+        grid->items[grid->cell_start[grid->ball_cell[i]]++] = i;
+    }
+    for (int c = cell_count; c > 0; c--) {
+        grid->cell_start[c] = grid->cell_start[c - 1];
+    }
+    grid->cell_start[0] = 0;
+}
+
+void grid_free (struct Grid* grid) {
+    free(grid->cell_start);
+    free(grid->items);
+    free(grid->ball_cell);
+}
+
+static void push_pair (struct Broadphase* broadphase, int i, int j) {
+    broadphase->pairs = grow(broadphase->pairs, &broadphase->pair_capacity, broadphase->pair_count + 1, sizeof(struct Pair));
+    struct Pair pair = {i < j ? i : j, i < j ? j : i};
+    broadphase->pairs[broadphase->pair_count++] = pair;
+}
+
+static int within_reach (const struct Balls* balls, int i, int j, float reach_scale) {
+    float dx = balls->x_pos[j] - balls->x_pos[i];
+    float dy = balls->y_pos[j] - balls->y_pos[i];
+    float reach = (balls->radius[i] + balls->radius[j]) * reach_scale;
+    return dx * dx + dy * dy <= reach * reach;
+}
+
+static void find_pairs_grid (struct Broadphase* broadphase, const struct Balls* balls, int count, float reach_scale) {
+    struct Grid* grid = &broadphase->grid;
+
+    float max_radius = 0.0f;
+    for (int i = 0; i < count; i++) {
+        if (balls->radius[i] > max_radius) max_radius = balls->radius[i];
+    }
+    grid_build(grid, balls->x_pos, balls->y_pos, count, 2.0f * max_radius * reach_scale);
+
+    // Each cell is paired with itself and four forward neighbours, so every
+    // neighbouring cell pair is visited exactly once.
+    static const int offsets[4][2] = {{1, 0}, {-1, 1}, {0, 1}, {1, 1}};
+    int side = grid->cells_per_side;
+
+    for (int cy = 0; cy < side; cy++) {
+        for (int cx = 0; cx < side; cx++) {
+            int cell = cy * side + cx;
+            int begin = grid->cell_start[cell];
+            int end = grid->cell_start[cell + 1];
+
+            for (int a = begin; a < end; a++) {
+                for (int b = a + 1; b < end; b++) {
+                    if (within_reach(balls, grid->items[a], grid->items[b], reach_scale)) {
+                        push_pair(broadphase, grid->items[a], grid->items[b]);
+                    }
+                }
+            }
+
+            for (int k = 0; k < 4; k++) {
+                int nx = cx + offsets[k][0];
+                int ny = cy + offsets[k][1];
+                if (nx < 0 || nx >= side || ny >= side) continue;
+
+                int neighbour = ny * side + nx;
+                int n_begin = grid->cell_start[neighbour];
+                int n_end = grid->cell_start[neighbour + 1];
+                for (int a = begin; a < end; a++) {
+                    for (int b = n_begin; b < n_end; b++) {
+                        if (within_reach(balls, grid->items[a], grid->items[b], reach_scale)) {
+                            push_pair(broadphase, grid->items[a], grid->items[b]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void find_pairs_brute (struct Broadphase* broadphase, const struct Balls* balls, int count, float reach_scale) {
+    for (int i = 0; i < count; i++) {
+        for (int j = i + 1; j < count; j++) {
+            if (within_reach(balls, i, j, reach_scale)) push_pair(broadphase, i, j);
+        }
+    }
+}
+
+// Puts the item with the k-th smallest key at items[k], with no larger key
+// before it and no smaller one after it.
+static void select_nth (int* items, int begin, int end, int k, const float* keys) {
+    while (end - begin > 1) {
+        float pivot = keys[items[begin + (end - begin) / 2]];
+        int low = begin;
+        int high = end - 1;
+        while (low <= high) {
+            while (keys[items[low]] < pivot) low++;
+            while (keys[items[high]] > pivot) high--;
+            if (low <= high) {
+                int item = items[low];
+                items[low++] = items[high];
+                items[high--] = item;
+            }
+        }
+        if (k <= high) {
+            end = high + 1;
+        } else if (k >= low) {
+            begin = low;
+        } else {
+            return;
+        }
+    }
+}
+
+static int build_node (struct Tree* tree, const struct Balls* balls, int begin, int end) {
+    int index = tree->node_count++;
+    struct TreeNode* node = &tree->nodes[index];
+    node->begin = begin;
+    node->end = end;
+    node->left = -1;
+    node->right = -1;
+
+    int first = tree->items[begin];
+    node->min_x = node->max_x = balls->x_pos[first];
+    node->min_y = node->max_y = balls->y_pos[first];
+    node->max_radius = balls->radius[first];
+    for (int k = begin + 1; k < end; k++) {
+        int i = tree->items[k];
+        if (balls->x_pos[i] < node->min_x) node->min_x = balls->x_pos[i];
+        if (balls->x_pos[i] > node->max_x) node->max_x = balls->x_pos[i];
+        if (balls->y_pos[i] < node->min_y) node->min_y = balls->y_pos[i];
+        if (balls->y_pos[i] > node->max_y) node->max_y = balls->y_pos[i];
+        if (balls->radius[i] > node->max_radius) node->max_radius = balls->radius[i];
+    }
+    if (end - begin <= TREE_LEAF_SIZE) return index;
+
+    const float* keys = node->max_x - node->min_x >= node->max_y - node->min_y ? balls->x_pos : balls->y_pos;
+    int middle = begin + (end - begin) / 2;
+    select_nth(tree->items, begin, end, middle, keys);
+
+    int left = build_node(tree, balls, begin, middle);
+    int right = build_node(tree, balls, middle, end);
+    tree->nodes[index].left = left;
+    tree->nodes[index].right = right;
+    return index;
+}
+
+static void find_pairs_tree (struct Broadphase* broadphase, const struct Balls* balls, int count, float reach_scale) {
+    struct Tree* tree = &broadphase->tree;
+
+    // Every split leaves at least TREE_LEAF_SIZE / 2 items on each side.
+    int node_limit = 2 * (count / (TREE_LEAF_SIZE / 2) + 1);
+    tree->nodes = grow(tree->nodes, &tree->node_capacity, node_limit, sizeof(struct TreeNode));
+    tree->items = grow(tree->items, &tree->item_capacity, count, sizeof(int));
+    for (int i = 0; i < count; i++) {
+        tree->items[i] = i;
+    }
+    tree->node_count = 0;
+    build_node(tree, balls, 0, count);
+
+    // The tree is balanced, so its depth stays far below the stack's size.
+    int stack[64];
+    for (int i = 0; i < count; i++) {
+        float x = balls->x_pos[i];
+        float y = balls->y_pos[i];
+        int top = 0;
+        stack[top++] = 0;
+
+        while (top > 0) {
+            const struct TreeNode* node = &tree->nodes[stack[--top]];
+            float dx = x < node->min_x ? node->min_x - x : (x > node->max_x ? x - node->max_x : 0.0f);
+            float dy = y < node->min_y ? node->min_y - y : (y > node->max_y ? y - node->max_y : 0.0f);
+            float reach = (balls->radius[i] + node->max_radius) * reach_scale;
+            if (dx * dx + dy * dy > reach * reach) continue;
+
+            if (node->left >= 0) {
+                stack[top++] = node->left;
+                stack[top++] = node->right;
+                continue;
+            }
+            for (int k = node->begin; k < node->end; k++) {
+                int j = tree->items[k];
+                if (j > i && within_reach(balls, i, j, reach_scale)) push_pair(broadphase, i, j);
+            }
+        }
+    }
+}
+
+// Stable counting sort of the pairs on i, or on j.
+static void sort_pairs_on (const struct Pair* from, struct Pair* to, int pair_count, int* starts, int count, int on_j) {
+    memset(starts, 0, (count + 1) * sizeof(int));
+    for (int k = 0; k < pair_count; k++) {
+        starts[(on_j ? from[k].j : from[k].i) + 1]++;
+    }
+    for (int i = 0; i < count; i++) {
+        starts[i + 1] += starts[i];
+    }
+    for (int k = 0; k < pair_count; k++) {
+        to[starts[on_j ? from[k].j : from[k].i]++] = from[k];
+    }
+}
+
+// Puts the pairs in (i, j) order. The solvers' results depend on the order
+// they see the pairs in, and every strategy finds them in its own, so
+// without this the result would depend on which one the timings picked.
+static void order_pairs (struct Broadphase* broadphase, int count) {
+    struct Pair* pairs = broadphase->pairs;
+    int pair_count = broadphase->pair_count;
+
+    int ordered = 1;
+    for (int k = 1; k < pair_count && ordered; k++) {
+        ordered = pairs[k - 1].i < pairs[k].i || (pairs[k - 1].i == pairs[k].i && pairs[k - 1].j < pairs[k].j);
+    }
+    if (ordered) return;
+
+    broadphase->sorted = grow(broadphase->sorted, &broadphase->sorted_capacity, pair_count, sizeof(struct Pair));
+    broadphase->starts = grow(broadphase->starts, &broadphase->start_capacity, count + 1, sizeof(int));
+    sort_pairs_on(pairs, broadphase->sorted, pair_count, broadphase->starts, count, 1);
+    sort_pairs_on(broadphase->sorted, pairs, pair_count, broadphase->starts, count, 0);
+}
+
+static void find_pairs (struct Broadphase* broadphase, int strategy, const struct Balls* balls, int count, float reach_scale) {
+    broadphase->pair_count = 0;
+    if (strategy == BROADPHASE_BRUTE) {
+        find_pairs_brute(broadphase, balls, count, reach_scale);
+    } else if (strategy == BROADPHASE_TREE) {
+        find_pairs_tree(broadphase, balls, count, reach_scale);
+    } else {
+        find_pairs_grid(broadphase, balls, count, reach_scale);
+    }
+    order_pairs(broadphase, count);
+}
+
+static double seconds_now () {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void sample_scene (struct BroadphaseSample* sample, const struct Balls* balls, int count) {
+    static const int side = BROADPHASE_SAMPLE_CELLS;
+    int cells[BROADPHASE_SAMPLE_CELLS * BROADPHASE_SAMPLE_CELLS] = {0};
+    double sum = 0.0;
+    double sum_squares = 0.0;
+    sample->count = count;
+    sample->min_radius = balls->radius[0];
+    sample->max_radius = balls->radius[0];
+
+    for (int i = 0; i < count; i++) {
+        float radius = balls->radius[i];
+        if (radius < sample->min_radius) sample->min_radius = radius;
+        if (radius > sample->max_radius) sample->max_radius = radius;
+        sum += radius;
+        sum_squares += (double)radius * radius;
+
+        int cx = (int)((balls->x_pos[i] + 1.0f) * 0.5f * side);
+        int cy = (int)((balls->y_pos[i] + 1.0f) * 0.5f * side);
+        cx = cx < 0 ? 0 : (cx >= side ? side - 1 : cx);
+        cy = cy < 0 ? 0 : (cy >= side ? side - 1 : cy);
+        cells[cy * side + cx]++;
+    }
+
+    double mean = sum / count;
+    double variance = sum_squares / count - mean * mean;
+    sample->mean_radius = (float)mean;
+    sample->spread = mean > 0.0 && variance > 0.0 ? (float)(sqrt(variance) / mean) : 0.0f;
+
+    int occupied = 0;
+    double same_cell = 0.0;
+    for (int c = 0; c < side * side; c++) {
+        if (cells[c] > 0) occupied++;
+        same_cell += (double)cells[c] * cells[c];
+    }
+    sample->occupancy = (float)occupied / (side * side);
+    sample->crowding = (float)(same_cell * side * side / ((double)count * count));
+}
+
+// Where to start before anything has been timed. One cell size has to fit
+// the biggest ball, so a grid suits balls of about one size.
+static int guess_strategy (const struct BroadphaseSample* sample) {
+    if (sample->count <= TREE_LEAF_SIZE * 8) return BROADPHASE_BRUTE;
+    if (sample->max_radius > 4.0f * sample->mean_radius) return BROADPHASE_TREE;
+    if (sample->spread > 0.5f && sample->crowding > 4.0f) return BROADPHASE_TREE;
+    return BROADPHASE_GRID;
+}
+
+// Samples the scene, times the strategies worth trying against what the
+// current one has been costing, and leaves the pairs of the one chosen.
+static void choose_strategy (struct Broadphase* broadphase, const struct Balls* balls, int count, float reach_scale) {
+    struct BroadphaseSample* sample = &broadphase->sample;
+    sample_scene(sample, balls, count);
+
+    // Seconds per update; negative when not tried.
+    double cost[BROADPHASE_STRATEGIES] = {-1.0, -1.0, -1.0, -1.0};
+    int measured = broadphase->strategy != 0 && broadphase->updates_since_sample > 0;
+    if (measured) cost[broadphase->strategy] = broadphase->seconds_since_sample / broadphase->updates_since_sample;
+    int current = broadphase->strategy != 0 ? broadphase->strategy : guess_strategy(sample);
+
+    for (int strategy = BROADPHASE_BRUTE; strategy < BROADPHASE_STRATEGIES; strategy++) {
+        if (strategy == BROADPHASE_BRUTE && count > BROADPHASE_BRUTE_MAX) continue;
+        if (strategy == broadphase->strategy && measured) continue;
+        double start = seconds_now();
+        find_pairs(broadphase, strategy, balls, count, reach_scale);
+        cost[strategy] = seconds_now() - start;
+    }
+
+    int best = current;
+    for (int strategy = BROADPHASE_BRUTE; strategy < BROADPHASE_STRATEGIES; strategy++) {
+        if (cost[strategy] >= 0.0 && cost[strategy] < cost[best]) best = strategy;
+    }
+    int chosen = cost[best] < cost[current] * (1.0 - BROADPHASE_SWITCH_MARGIN) ? best : current;
+
+    if (broadphase->log) {
+        printf("broadphase at update %ld: %d balls, radius %.4f-%.4f (mean %.4f, spread %.2f), %.0f%% of cells occupied, crowding %.1f;",
+               broadphase->updates, count, sample->min_radius, sample->max_radius, sample->mean_radius, sample->spread,
+               sample->occupancy * 100.0f, sample->crowding);
+        for (int strategy = BROADPHASE_BRUTE; strategy < BROADPHASE_STRATEGIES; strategy++) {
+            if (cost[strategy] < 0.0) continue;
+            printf(" %s %.3f ms%s", broadphase_name(strategy), cost[strategy] * 1e3,
+                   strategy == broadphase->strategy && measured ? " (measured)" : "");
+        }
+        if (broadphase->strategy == 0) {
+            printf("; starting with %s\n", broadphase_name(chosen));
+        } else if (chosen != broadphase->strategy) {
+            printf("; switching from %s to %s\n", broadphase_name(broadphase->strategy), broadphase_name(chosen));
+        } else {
+            printf("; keeping %s\n", broadphase_name(chosen));
+        }
+    }
+
+    broadphase->strategy = chosen;
+    broadphase->updates_since_sample = 0;
+    broadphase->seconds_since_sample = 0.0;
+    find_pairs(broadphase, chosen, balls, count, reach_scale);
+}
+
+void broadphase_update (struct Broadphase* broadphase, const struct Balls* balls, int count, float reach_scale) {
+    broadphase->pair_count = 0;
+    if (count == 0) return;
+    broadphase->updates++;
+
+    if (broadphase->mode != BROADPHASE_AUTO) {
+        broadphase->strategy = broadphase->mode;
+        find_pairs(broadphase, broadphase->mode, balls, count, reach_scale);
+        return;
+    }
+
+    if (broadphase->strategy == 0 || broadphase->updates_since_sample >= BROADPHASE_SAMPLE_INTERVAL) {
+        choose_strategy(broadphase, balls, count, reach_scale);
+        return;
+    }
+
+    double start = seconds_now();
+    find_pairs(broadphase, broadphase->strategy, balls, count, reach_scale);
+    broadphase->seconds_since_sample += seconds_now() - start;
+    broadphase->updates_since_sample++;
+}
+
+void broadphase_resume (struct Broadphase* broadphase, int strategy) {
+    broadphase->strategy = strategy >= 0 && strategy < BROADPHASE_STRATEGIES ? strategy : 0;
+    broadphase->updates_since_sample = 0;
+    broadphase->seconds_since_sample = 0.0;
+}
+
+const char* broadphase_name (int strategy) {
+    if (strategy == BROADPHASE_BRUTE) return "brute";
+    if (strategy == BROADPHASE_GRID) return "grid";
+    if (strategy == BROADPHASE_TREE) return "tree";
+    return "auto";
+}
+
+void broadphase_free (struct Broadphase* broadphase) {
+    grid_free(&broadphase->grid);
+    free(broadphase->tree.nodes);
+    free(broadphase->tree.items);
+    free(broadphase->pairs);
+    free(broadphase->sorted);
+    free(broadphase->starts);
+}
+
+float pairs_max_overlap (const struct Balls* balls, const struct Pair* pairs, int pair_count) {
+    float max_overlap = 0.0f;
+    for (int k = 0; k < pair_count; k++) {
+        int i = pairs[k].i;
+        int j = pairs[k].j;
+        float dx = balls->x_pos[j] - balls->x_pos[i];
+        float dy = balls->y_pos[j] - balls->y_pos[i];
+        float overlap = balls->radius[i] + balls->radius[j] - sqrtf(dx * dx + dy * dy);
+        if (overlap > max_overlap) max_overlap = overlap;
+    }
+    return max_overlap;
+}
@@ -0,0 +1,118 @@
+#ifndef BROADPHASE_H
+#define BROADPHASE_H
+
+#include "balls.h"
+
+#define GRID_MAX_CELLS_PER_SIDE 1024
+
+struct Pair {
+    int i, j;
+};
+
+// Uniform grid over the [-1, 1] domain. Ball indices are counting-sorted by
+// cell, so the balls of cell c are items[cell_start[c] .. cell_start[c + 1]).
+struct Grid {
+    float cell_size;
+    int cells_per_side;
+    int* cell_start;
+    int* items;
+    int* ball_cell;
+    int cell_capacity;
+    int item_capacity;
+};
+
+// Tree over the balls, split at the median of the longer side down to
+// leaves of TREE_LEAF_SIZE. Each node also knows the largest radius under
+// it, so a few big balls among many small ones do not widen every search,
+// as they would widen every grid cell.
+#define TREE_LEAF_SIZE 8
+
+struct TreeNode {
+    float min_x, min_y, max_x, max_y;
+    float max_radius;
+    int begin, end;
+    // -1 for a leaf; the right child follows its left child's subtree.
+    int left, right;
+};
+
+struct Tree {
+    struct TreeNode* nodes;
+    int node_count;
+    int node_capacity;
+    int* items;
+    int item_capacity;
+};
+
+// Ways to find the pairs. Every one finds the same pairs and hands them on
+// in (i, j) order, so the choice only changes how long finding them takes.
+#define BROADPHASE_AUTO 0
+#define BROADPHASE_BRUTE 1
+#define BROADPHASE_GRID 2
+#define BROADPHASE_TREE 3
+#define BROADPHASE_STRATEGIES 4
+
+// In automatic mode the scene is sampled every this many updates, and each
+// strategy that might suit it is timed. The current one is only replaced by
+// one at least BROADPHASE_SWITCH_MARGIN cheaper, so timing noise between
+// two close strategies does not flip the choice back and forth.
+#define BROADPHASE_SAMPLE_INTERVAL 300
+#define BROADPHASE_SWITCH_MARGIN 0.25
+// Brute force is only tried on scenes this small.
+#define BROADPHASE_BRUTE_MAX 512
+#define BROADPHASE_SAMPLE_CELLS 32
+
+// What a sample found. spread is the radii's standard deviation over their
+// mean. occupancy is the fraction of a coarse grid's cells holding a ball,
+// and crowding how many balls share a ball's cell over how many would if
+// they were spread evenly: about 1 for an even scene, higher the more they
+// bunch up.
+struct BroadphaseSample {
+    int count;
+    float min_radius;
+    float mean_radius;
+    float max_radius;
+    float spread;
+    float occupancy;
+    float crowding;
+};
+
+struct Broadphase {
+    struct Grid grid;
+    struct Tree tree;
+    struct Pair* pairs;
+    int pair_count;
+    int pair_capacity;
+    // Scratch for putting the pairs in order.
+    struct Pair* sorted;
+    int sorted_capacity;
+    int* starts;
+    int start_capacity;
+
+    // BROADPHASE_AUTO, or the strategy to always use.
+    int mode;
+    // The strategy in use, 0 until the first sample.
+    int strategy;
+    // Print each automatic decision and what it was based on.
+    int log;
+    long updates;
+    int updates_since_sample;
+    double seconds_since_sample;
+    struct BroadphaseSample sample;
+};
+
+void grid_build (struct Grid* grid, const float* x_pos, const float* y_pos, int count, float cell_size);
+int grid_coord (const struct Grid* grid, float pos);
+void grid_free (struct Grid* grid);
+
+// Collects every pair whose centres are closer than (r_i + r_j) * reach_scale,
+// ordered by (i, j).
+void broadphase_update (struct Broadphase* broadphase, const struct Balls* balls, int count, float reach_scale);
+const char* broadphase_name (int strategy);
+// Carries on with a strategy saved along with the state, timing it afresh.
+void broadphase_resume (struct Broadphase* broadphase, int strategy);
+void broadphase_free (struct Broadphase* broadphase);
+
+// Deepest penetration among the pairs, 0 if none of them touch.
+float pairs_max_overlap (const struct Balls* balls, const struct Pair* pairs, int pair_count);
+
+#endif
@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "codec.h"
+
+// Quantized values are kept within +-2^30 so differences never overflow.
+#define QUANTIZED_LIMIT 1073741824.0f
+
+void codec_init (struct Codec* codec, int capacity, float precision) {
+    codec->precision = precision;
+    codec->capacity = capacity;
+    codec->previous_count = 0;
+    for (int field = 0; field < TRAJECTORY_FIELDS; field++) {
+        codec->previous[field] = malloc(capacity * sizeof(int32_t));
+        if (codec->previous[field] == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(1);
+        }
+    }
+}
+
+void codec_free (struct Codec* codec) {
+    for (int field = 0; field < TRAJECTORY_FIELDS; field++) {
+        free(codec->previous[field]);
+    }
+}
+
+void codec_reset (struct Codec* codec) {
+    codec->previous_count = 0;
+}
+
+int codec_slice_count (int count) {
+    return (count + CODEC_SLICE - 1) / CODEC_SLICE;
+}
+
+size_t codec_max_slice_size () {
+    return TRAJECTORY_FIELDS * (CODEC_SLICE / CODEC_BLOCK) * (1 + CODEC_BLOCK * sizeof(uint32_t));
+}
+
+static inline int32_t quantize (float precision, float value) {
+    if (precision == 0.0f) {
+        int32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    // NaN fails both comparisons and ends up at the lower limit.
+    float scaled = value / precision;
+    if (!(scaled >= -QUANTIZED_LIMIT)) scaled = -QUANTIZED_LIMIT;
+    if (!(scaled <= QUANTIZED_LIMIT)) scaled = QUANTIZED_LIMIT;
+    return (int32_t)lrintf(scaled);
+}
+
+static inline float dequantize (float precision, int32_t quantized) {
+    if (precision == 0.0f) {
+        float value;
+        memcpy(&value, &quantized, sizeof(value));
+        return value;
+    }
+    return quantized * precision;
+}
+
+// Packs n values of width bits each, least significant bit first.
+static uint8_t* pack (const uint32_t* values, int n, int width, uint8_t* out) {
+    uint64_t bits = 0;
+    int filled = 0;
+    for (int k = 0; k < n; k++) {
+        bits |= (uint64_t)values[k] << filled;
+        filled += width;
+        while (filled >= 8) {
+            *out++ = (uint8_t)bits;
+            bits >>= 8;
+            filled -= 8;
+        }
+    }
+    if (filled > 0) *out++ = (uint8_t)bits;
+    return out;
+}
+
+static const uint8_t* unpack (const uint8_t* in, int n, int width, uint32_t* values) {
+    uint64_t bits = 0;
+    int filled = 0;
+    uint64_t mask = ((uint64_t)1 << width) - 1;
+    for (int k = 0; k < n; k++) {
+        while (filled < width) {
+            bits |= (uint64_t)*in++ << filled;
+            filled += 8;
+        }
+        values[k] = (uint32_t)(bits & mask);
+        bits >>= width;
+        filled -= width;
+    }
+    return in;
+}
+
+size_t codec_encode_slice (struct Codec* codec, float* const* fields, int begin, int end, uint8_t* out) {
+    uint8_t* cursor = out;
+    uint32_t residuals[CODEC_BLOCK];
+
+    for (int field = 0; field < TRAJECTORY_FIELDS; field++) {
+        int32_t* previous = codec->previous[field];
+        for (int block = begin; block < end; block += CODEC_BLOCK) {
+            int n = end - block < CODEC_BLOCK ? end - block : CODEC_BLOCK;
+            uint32_t used_bits = 0;
+            for (int k = 0; k < n; k++) {
+                int i = block + k;
+                int32_t quantized = quantize(codec->precision, fields[field][i]);
+                int32_t base = i < codec->previous_count ? previous[i] : 0;
+                int32_t delta = (int32_t)((uint32_t)quantized - (uint32_t)base);
+                residuals[k] = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+                used_bits |= residuals[k];
+                previous[i] = quantized;
+            }
+
+            int width = used_bits != 0 ? 32 - __builtin_clz(used_bits) : 0;
+            *cursor++ = (uint8_t)width;
+            cursor = pack(residuals, n, width, cursor);
+        }
+    }
+    return cursor - out;
+}
+
+int codec_decode_slice (struct Codec* codec, const uint8_t* in, size_t size, int begin, int end, float* const* fields) {
+    const uint8_t* cursor = in;
+    const uint8_t* limit = in + size;
+    uint32_t residuals[CODEC_BLOCK];
+
+    for (int field = 0; field < TRAJECTORY_FIELDS; field++) {
+        int32_t* previous = codec->previous[field];
+        for (int block = begin; block < end; block += CODEC_BLOCK) {
+            int n = end - block < CODEC_BLOCK ? end - block : CODEC_BLOCK;
+            if (cursor >= limit) return 0;
+            int width = *cursor++;
+            if (width > 32 || (size_t)(limit - cursor) < ((size_t)n * width + 7) / 8) return 0;
+            cursor = unpack(cursor, n, width, residuals);
+
+            for (int k = 0; k < n; k++) {
+                int i = block + k;
+                int32_t delta = (int32_t)((residuals[k] >> 1) ^ -(residuals[k] & 1));
+                int32_t base = i < codec->previous_count ? previous[i] : 0;
+                previous[i] = (int32_t)((uint32_t)base + (uint32_t)delta);
+                fields[field][i] = dequantize(codec->precision, previous[i]);
+            }
+        }
+    }
+    return cursor == limit;
+}
+
+void codec_end_frame (struct Codec* codec, int count) {
+    codec->previous_count = count;
+}
+
+int codec_decode_frame (struct Codec* codec, const uint8_t* in, size_t size, int count, float* const* fields) {
+    if (count < 0 || count > codec->capacity) return 0;
+
+    int slices = codec_slice_count(count);
+    size_t table_size = slices * sizeof(uint32_t);
+    if (size < table_size) return 0;
+
+    const uint8_t* cursor = in + table_size;
+    size_t remaining = size - table_size;
+    for (int slice = 0; slice < slices; slice++) {
+        uint32_t slice_size;
+        memcpy(&slice_size, in + slice * sizeof(uint32_t), sizeof(slice_size));
+        if (slice_size > remaining) return 0;
+
+        int begin = slice * CODEC_SLICE;
+        int end = begin + CODEC_SLICE < count ? begin + CODEC_SLICE : count;
+        if (!codec_decode_slice(codec, cursor, slice_size, begin, end, fields)) return 0;
+        cursor += slice_size;
+        remaining -= slice_size;
+    }
+
+    codec_end_frame(codec, count);
+    return remaining == 0;
+}
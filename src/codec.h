@@ -0,0 +1,61 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "trajectory.h"
+
+// Delta codec for trajectory frames. Every field is quantized to a multiple
+// of precision (or, with precision 0, taken bit for bit), each ball is
+// coded as the difference from its value in the previous frame, and the
+// zigzagged differences are bit-packed in blocks of CODEC_BLOCK sharing one
+// bit width. Resting balls cost a few bits per field.
+//
+// A frame is cut into slices of CODEC_SLICE balls that are coded separately,
+// so slices of one frame can be encoded and decoded on different threads.
+// Frame payload: slice_count uint32 byte sizes, then the slices in order.
+
+#define CODEC_BLOCK 64
+#define CODEC_SLICE 16384
+
+// Default quantization step for recorded fields: 2^-20, about a millionth
+// of the box.
+#define CODEC_DEFAULT_PRECISION (1.0f / 1048576.0f)
+
+// The quantized previous frame that both sides delta against. Encoder and
+// decoder each keep one, and stay in step as long as they see the same
+// frames from the same keyframe.
+struct Codec {
+    float precision;
+    int capacity;
+    int32_t* previous[TRAJECTORY_FIELDS];
+    int previous_count;
+};
+
+void codec_init (struct Codec* codec, int capacity, float precision);
+void codec_free (struct Codec* codec);
+
+// Makes the next frame a keyframe, coded against zeros.
+void codec_reset (struct Codec* codec);
+
+int codec_slice_count (int count);
+
+// Upper bound on the bytes one slice of up to CODEC_SLICE balls can take.
+size_t codec_max_slice_size ();
+
+// Codes balls [begin, end) of fields into out and returns the bytes written.
+// Slices of one frame touch disjoint parts of the codec, so they may run
+// concurrently; call codec_end_frame once all of them are done.
+size_t codec_encode_slice (struct Codec* codec, float* const* fields, int begin, int end, uint8_t* out);
+
+// Reverse of codec_encode_slice. Returns 0 if the data runs out early.
+int codec_decode_slice (struct Codec* codec, const uint8_t* in, size_t size, int begin, int end, float* const* fields);
+
+void codec_end_frame (struct Codec* codec, int count);
+
+// Decodes a whole frame payload on the calling thread. Returns 0 if it is
+// malformed.
+int codec_decode_frame (struct Codec* codec, const uint8_t* in, size_t size, int count, float* const* fields);
+
+#endif
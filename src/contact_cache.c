@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "contact_cache.h"
+
+#define CACHE_EMPTY UINT64_MAX
+#define CACHE_MIN_CAPACITY 1024
+
+static inline uint64_t pair_key (int i, int j) {
+    uint32_t low = i < j ? i : j;
+    uint32_t high = i < j ? j : i;
+    return ((uint64_t)low << 32) | high;
+}
+
+// Fibonacci hashing; capacity is always a power of two.
+static inline int slot_of (uint64_t key, int capacity) {
+    return (int)((key * 0x9E3779B97F4A7C15ull) >> 32) & (capacity - 1);
+}
+
+void contact_cache_warm_start (struct ContactCache* cache, struct Contact* contacts, int count) {
+    for (int k = 0; k < count; k++) {
+        contacts[k].impulse = 0.0f;
+        cache->lookups++;
+        if (cache->capacity == 0) continue;
+
+        uint64_t key = pair_key(contacts[k].i, contacts[k].j);
+        for (int slot = slot_of(key, cache->capacity); cache->entries[slot].key != CACHE_EMPTY; slot = (slot + 1) & (cache->capacity - 1)) {
+            if (cache->entries[slot].key == key) {
+                contacts[k].impulse = CONTACT_WARM_START * cache->entries[slot].impulse;
+                cache->hits++;
+                break;
+            }
+        }
+    }
+}
+
+void contact_cache_store (struct ContactCache* cache, const struct Contact* contacts, int count) {
+    // Keep the load factor at or under one half so probes stay short.
+    int capacity = CACHE_MIN_CAPACITY;
+    while (capacity < 2 * count) capacity *= 2;
+
+    if (capacity != cache->capacity) {
+        free(cache->entries);
+        cache->entries = malloc(capacity * sizeof(struct CacheEntry));
+        if (cache->entries == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(1);
+        }
+        cache->capacity = capacity;
+    }
+
+    for (int slot = 0; slot < capacity; slot++) {
+        cache->entries[slot].key = CACHE_EMPTY;
+    }
+
+    for (int k = 0; k < count; k++) {
+        uint64_t key = pair_key(contacts[k].i, contacts[k].j);
+        int slot = slot_of(key, capacity);
+        while (cache->entries[slot].key != CACHE_EMPTY) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        cache->entries[slot].key = key;
+        cache->entries[slot].impulse = contacts[k].impulse;
+    }
+}
+
+void contact_cache_clear (struct ContactCache* cache) {
+    for (int slot = 0; slot < cache->capacity; slot++) {
+        cache->entries[slot].key = CACHE_EMPTY;
+    }
+}
+
+void contact_cache_free (struct ContactCache* cache) {
+    free(cache->entries);
+}
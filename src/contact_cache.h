@@ -0,0 +1,40 @@
+#ifndef CONTACT_CACHE_H
+#define CONTACT_CACHE_H
+
+#include <stdint.h>
+
+#include "contacts.h"
+
+// Fraction of last step's impulse a persisting contact starts from. A little
+// under 1 so stale impulses from a shifting pile cannot pump energy in.
+#define CONTACT_WARM_START 0.85f
+
+// Accumulated impulses of last step's contacts, keyed by (min id, max id) in
+// an open-addressing table with linear probing. Keys are ball indices, so the
+// cache is cleared whenever a removal renumbers balls.
+struct CacheEntry {
+    uint64_t key;
+    float impulse;
+};
+
+struct ContactCache {
+    struct CacheEntry* entries;
+    int capacity;
+    long lookups;
+    long hits;
+};
+
+// Seeds each contact's impulse from the cache.
+void contact_cache_warm_start (struct ContactCache* cache, struct Contact* contacts, int count);
+
+// Replaces the cache with these contacts, so pairs that stopped touching
+// expire on the spot.
+void contact_cache_store (struct ContactCache* cache, const struct Contact* contacts, int count);
+
+// Forgets every impulse, for when balls are renumbered and the keys no
+// longer name the same pairs.
+void contact_cache_clear (struct ContactCache* cache);
+
+void contact_cache_free (struct ContactCache* cache);
+
+#endif
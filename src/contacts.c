@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "contacts.h"
+
+// Each kernel is one of these bodies inlined with kind a constant, so every
+// variant compiles to a loop of its own with the other kinds folded away.
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+
+KERNEL_INLINE float radius_sum_of (const struct ContactKernel* kernel, int kind, const struct Balls* balls, int i, int j) {
+    if (kind == CONTACT_KERNEL_UNIFORM) return kernel->radius_sum[0][0];
+    if (kind == CONTACT_KERNEL_CLASSES) return kernel->radius_sum[kernel->classes[i]][kernel->classes[j]];
+    return balls->radius[i] + balls->radius[j];
+}
+
+KERNEL_INLINE float pair_mass_of (const struct ContactKernel* kernel, int kind, const struct Balls* balls, int i, int j) {
+    if (kind == CONTACT_KERNEL_UNIFORM) return kernel->pair_mass[0][0];
+    if (kind == CONTACT_KERNEL_CLASSES) return kernel->pair_mass[kernel->classes[i]][kernel->classes[j]];
+    return 1.0f / (1.0f / balls->mass[i] + 1.0f / balls->mass[j]);
+}
+
+KERNEL_INLINE float share_of (const struct ContactKernel* kernel, int kind, const struct Balls* balls, int i, int j) {
+    if (kind == CONTACT_KERNEL_UNIFORM) return kernel->share[0][0];
+    if (kind == CONTACT_KERNEL_CLASSES) return kernel->share[kernel->classes[i]][kernel->classes[j]];
+    return balls->radius[j] / (balls->radius[i] + balls->radius[j]);
+}
+
+KERNEL_INLINE float mass_of (const struct ContactKernel* kernel, int kind, const struct Balls* balls, int i) {
+    if (kind == CONTACT_KERNEL_UNIFORM) return kernel->mass[0];
+    if (kind == CONTACT_KERNEL_CLASSES) return kernel->mass[kernel->classes[i]];
+    return balls->mass[i];
+}
+
+KERNEL_INLINE void build_contacts (struct Contacts* contacts, const struct Balls* balls, const struct Pair* pairs, int pair_count, float dt, float bounce_threshold, float restitution, const struct ContactKernel* kernel, int kind) {
+    contacts->count = 0;
+
+    for (int k = 0; k < pair_count; k++) {
+        int i = pairs[k].i;
+        int j = pairs[k].j;
+
+        float dx = balls->x_pos[j] - balls->x_pos[i];
+        float dy = balls->y_pos[j] - balls->y_pos[i];
+        float distance_squared = dx * dx + dy * dy;
+        float radius_sum = radius_sum_of(kernel, kind, balls, i, j);
+        float reach = radius_sum * CONTACT_MARGIN;
+        if (distance_squared > reach * reach) continue;
+
+        if (contacts->count == contacts->capacity) {
+            contacts->capacity = contacts->capacity > 0 ? contacts->capacity * 2 : 1024;
+            contacts->items = realloc(contacts->items, contacts->capacity * sizeof(struct Contact));
+            if (contacts->items == NULL) {
+                fprintf(stderr, "Memory allocation error\n");
+                exit(1);
+            }
+        }
+
+        struct Contact* contact = &contacts->items[contacts->count++];
+        float distance = sqrtf(distance_squared);
+        contact->i = i;
+        contact->j = j;
+        contact->nx = distance > 0.0f ? dx / distance : 1.0f;
+        contact->ny = distance > 0.0f ? dy / distance : 0.0f;
+        contact->overlap = radius_sum - distance;
+        contact->mass = pair_mass_of(kernel, kind, balls, i, j);
+        contact->impulse = 0.0f;
+
+        float approach = contact->nx * (balls->x_vel[i] - balls->x_vel[j]) + contact->ny * (balls->y_vel[i] - balls->y_vel[j]);
+        if (contact->overlap < 0.0f) {
+            contact->target = contact->overlap / dt;
+        } else {
+            contact->target = approach > bounce_threshold ? restitution * approach : 0.0f;
+        }
+    }
+}
+
+void contacts_build (struct Contacts* contacts, const struct Balls* balls, const struct Pair* pairs, int pair_count, float dt, float bounce_threshold, float restitution, const struct ContactKernel* kernel) {
+    if (kernel->kind == CONTACT_KERNEL_UNIFORM) {
+        build_contacts(contacts, balls, pairs, pair_count, dt, bounce_threshold, restitution, kernel, CONTACT_KERNEL_UNIFORM);
+    } else if (kernel->kind == CONTACT_KERNEL_CLASSES) {
+        build_contacts(contacts, balls, pairs, pair_count, dt, bounce_threshold, restitution, kernel, CONTACT_KERNEL_CLASSES);
+    } else {
+        build_contacts(contacts, balls, pairs, pair_count, dt, bounce_threshold, restitution, kernel, CONTACT_KERNEL_GENERAL);
+    }
+}
+
+void contacts_free (struct Contacts* contacts) {
+    free(contacts->items);
+}
+
+KERNEL_INLINE void separate_contacts (struct Contact* contacts, int count, struct Balls* balls, const struct ContactKernel* kernel, int kind) {
+    for (int k = 0; k < count; k++) {
+        struct Contact* contact = &contacts[k];
+        int i = contact->i;
+        int j = contact->j;
+        if (contact->overlap <= 0.0f) continue;
+
+        float displacement_i = contact->overlap * share_of(kernel, kind, balls, i, j);
+        float displacement_j = contact->overlap * share_of(kernel, kind, balls, j, i);
+        balls->x_pos[i] -= contact->nx * displacement_i;
+        balls->y_pos[i] -= contact->ny * displacement_i;
+        balls->x_pos[j] += contact->nx * displacement_j;
+        balls->y_pos[j] += contact->ny * displacement_j;
+    }
+}
+
+void contacts_separate (struct Contact* contacts, int count, struct Balls* balls, const struct ContactKernel* kernel) {
+    if (kernel->kind == CONTACT_KERNEL_UNIFORM) {
+        separate_contacts(contacts, count, balls, kernel, CONTACT_KERNEL_UNIFORM);
+    } else if (kernel->kind == CONTACT_KERNEL_CLASSES) {
+        separate_contacts(contacts, count, balls, kernel, CONTACT_KERNEL_CLASSES);
+    } else {
+        separate_contacts(contacts, count, balls, kernel, CONTACT_KERNEL_GENERAL);
+    }
+}
+
+KERNEL_INLINE void apply_impulse (struct Balls* balls, const struct Contact* contact, float impulse, const struct ContactKernel* kernel, int kind) {
+    int i = contact->i;
+    int j = contact->j;
+    float w_i = impulse / mass_of(kernel, kind, balls, i);
+    // Equal masses take equal and opposite velocity changes.
+    float w_j = kind == CONTACT_KERNEL_UNIFORM ? w_i : impulse / mass_of(kernel, kind, balls, j);
+    balls->x_vel[i] -= contact->nx * w_i;
+    balls->y_vel[i] -= contact->ny * w_i;
+    balls->x_vel[j] += contact->nx * w_j;
+    balls->y_vel[j] += contact->ny * w_j;
+}
+
+KERNEL_INLINE void solve_contacts (struct Contact* contacts, int count, struct Balls* balls, int iterations, const struct ContactKernel* kernel, int kind) {
+    for (int k = 0; k < count; k++) {
+        if (contacts[k].impulse != 0.0f) apply_impulse(balls, &contacts[k], contacts[k].impulse, kernel, kind);
+    }
+
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        for (int k = 0; k < count; k++) {
+            struct Contact* contact = &contacts[k];
+            int i = contact->i;
+            int j = contact->j;
+
+            float separation = contact->nx * (balls->x_vel[j] - balls->x_vel[i]) + contact->ny * (balls->y_vel[j] - balls->y_vel[i]);
+            float impulse = (contact->target - separation) * contact->mass;
+
+            float accumulated = contact->impulse + impulse;
+            if (accumulated < 0.0f) accumulated = 0.0f;
+            impulse = accumulated - contact->impulse;
+            contact->impulse = accumulated;
+
+            if (impulse != 0.0f) apply_impulse(balls, contact, impulse, kernel, kind);
+        }
+    }
+}
+
+void contacts_solve (struct Contact* contacts, int count, struct Balls* balls, int iterations, const struct ContactKernel* kernel) {
+    if (kernel->kind == CONTACT_KERNEL_UNIFORM) {
+        solve_contacts(contacts, count, balls, iterations, kernel, CONTACT_KERNEL_UNIFORM);
+    } else if (kernel->kind == CONTACT_KERNEL_CLASSES) {
+        solve_contacts(contacts, count, balls, iterations, kernel, CONTACT_KERNEL_CLASSES);
+    } else {
+        solve_contacts(contacts, count, balls, iterations, kernel, CONTACT_KERNEL_GENERAL);
+    }
+}
+
+void contact_kernel_choose (struct ContactKernel* kernel, const struct Balls* balls, int count) {
+    if (count > kernel->capacity) {
+        kernel->classes = realloc(kernel->classes, count);
+        if (kernel->classes == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(1);
+        }
+        kernel->capacity = count;
+    }
+
+    // Neighbouring balls are usually of one kind, so the last class matched
+    // is tried first.
+    float radius[CONTACT_MAX_CLASSES];
+    int class_count = 0;
+    int last = 0;
+    for (int i = 0; i < count; i++) {
+        float r = balls->radius[i];
+        float m = balls->mass[i];
+        if (class_count == 0 || r != radius[last] || m != kernel->mass[last]) {
+            int c = 0;
+            while (c < class_count && (r != radius[c] || m != kernel->mass[c])) c++;
+            if (c == class_count) {
+                if (class_count == CONTACT_MAX_CLASSES) {
+                    kernel->kind = CONTACT_KERNEL_GENERAL;
+                    kernel->class_count = 0;
+                    return;
+                }
+                radius[c] = r;
+                kernel->mass[c] = m;
+                class_count++;
+            }
+            last = c;
+        }
+        kernel->classes[i] = (uint8_t)last;
+    }
+
+    // The same expressions the general kernel evaluates per pair.
+    for (int a = 0; a < class_count; a++) {
+        for (int b = 0; b < class_count; b++) {
+            kernel->radius_sum[a][b] = radius[a] + radius[b];
+            kernel->pair_mass[a][b] = 1.0f / (1.0f / kernel->mass[a] + 1.0f / kernel->mass[b]);
+            kernel->share[a][b] = radius[b] / (radius[a] + radius[b]);
+        }
+    }
+    kernel->class_count = class_count;
+    kernel->kind = class_count <= 1 ? CONTACT_KERNEL_UNIFORM : CONTACT_KERNEL_CLASSES;
+}
+
+void contact_kernel_free (struct ContactKernel* kernel) {
+    free(kernel->classes);
+}
+
+const char* contact_kernel_name (int kind) {
+    if (kind == CONTACT_KERNEL_UNIFORM) return "uniform";
+    if (kind == CONTACT_KERNEL_CLASSES) return "class";
+    return "general";
+}
@@ -0,0 +1,80 @@
+#ifndef CONTACTS_H
+#define CONTACTS_H
+
+#include <stdint.h>
+
+#include "balls.h"
+#include "broadphase.h"
+
+// Impacts slower than this many substeps of gravity land dead instead of
+// bouncing, which keeps resting piles from buzzing.
+#define CONTACT_BOUNCE_THRESHOLD 2.0f
+
+// Pairs up to this far apart, relative to contact, are kept as speculative
+// contacts: they may close the gap within the substep but not overshoot it.
+// Resting contacts then stay in the list, and in the cache, while they jitter.
+#define CONTACT_MARGIN 1.02f
+
+// Touching pair with everything the velocity solver needs precomputed. The
+// normal points from i to j.
+struct Contact {
+    int i, j;
+    float nx, ny;
+    float overlap;
+    float mass;
+    float target;
+    float impulse;
+};
+
+struct Contacts {
+    struct Contact* items;
+    int count;
+    int capacity;
+};
+
+// Where the solver gets each pair's radius sum, reduced mass and the split of
+// its overlap. A scene of one kind of ball has them as constants, a scene of
+// a few kinds looks them up in tables by the two balls' classes, and any
+// other scene computes them from the balls. The tables hold what the general
+// kernel would compute, so all three give the same results bit for bit.
+#define CONTACT_KERNEL_GENERAL 0
+#define CONTACT_KERNEL_UNIFORM 1
+#define CONTACT_KERNEL_CLASSES 2
+
+// Distinct radius and mass pairs the class tables cover.
+#define CONTACT_MAX_CLASSES 8
+
+struct ContactKernel {
+    int kind;
+    int class_count;
+    float mass[CONTACT_MAX_CLASSES];
+    float radius_sum[CONTACT_MAX_CLASSES][CONTACT_MAX_CLASSES];
+    float pair_mass[CONTACT_MAX_CLASSES][CONTACT_MAX_CLASSES];
+    // share[a][b] is the part of the overlap a ball of class a moves when it
+    // touches one of class b.
+    float share[CONTACT_MAX_CLASSES][CONTACT_MAX_CLASSES];
+
+    // Each ball's class, for the class kernel.
+    uint8_t* classes;
+    int capacity;
+};
+
+// Picks the kernel for the balls as they are now.
+void contact_kernel_choose (struct ContactKernel* kernel, const struct Balls* balls, int count);
+void contact_kernel_free (struct ContactKernel* kernel);
+const char* contact_kernel_name (int kind);
+
+// Keeps the pairs within CONTACT_MARGIN. Touching pairs approaching faster
+// than bounce_threshold get a separation target of restitution times the
+// approach speed; a gap may be closed in dt frames but no faster.
+void contacts_build (struct Contacts* contacts, const struct Balls* balls, const struct Pair* pairs, int pair_count, float dt, float bounce_threshold, float restitution, const struct ContactKernel* kernel);
+void contacts_free (struct Contacts* contacts);
+
+// Moves each overlapping pair apart, split by radius.
+void contacts_separate (struct Contact* contacts, int count, struct Balls* balls, const struct ContactKernel* kernel);
+
+// Applies each contact's starting impulse, then runs sequential impulse
+// iterations, accumulating into contact->impulse and never letting it pull.
+void contacts_solve (struct Contact* contacts, int count, struct Balls* balls, int iterations, const struct ContactKernel* kernel);
+
+#endif
@@ -0,0 +1,588 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "domain.h"
+#include "jobs.h"
+#include "snapshot.h"
+#include "world.h"
+
+struct BallList {
+    struct DomainBall* items;
+    int count;
+    int capacity;
+};
+
+// One direction of a neighbour exchange: a ball count and the balls go out
+// while the same come in.
+struct Channel {
+    int fd;
+    const struct BallList* out;
+    uint32_t out_count;
+    size_t out_done;
+    struct BallList* in;
+    uint32_t in_count;
+    size_t in_done;
+};
+
+static double seconds_now () {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void list_reserve (struct BallList* list, int capacity) {
+    if (capacity <= list->capacity) return;
+    list->capacity = capacity > 2 * list->capacity ? capacity : 2 * list->capacity;
+    list->items = realloc(list->items, list->capacity * sizeof(struct DomainBall));
+    if (list->items == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(1);
+    }
+}
+
+static void list_push (struct BallList* list, const struct DomainBall* ball) {
+    list_reserve(list, list->count + 1);
+    list->items[list->count++] = *ball;
+}
+
+static struct DomainBall ball_at (const struct Balls* balls, int i) {
+    struct DomainBall ball = {balls->x_pos[i], balls->y_pos[i], balls->x_vel[i], balls->y_vel[i], balls->radius[i]};
+    return ball;
+}
+
+static void move_ball (struct Balls* balls, int to, int from) {
+    balls->radius[to] = balls->radius[from];
+    balls->x_pos[to] = balls->x_pos[from];
+    balls->y_pos[to] = balls->y_pos[from];
+    balls->x_vel[to] = balls->x_vel[from];
+    balls->y_vel[to] = balls->y_vel[from];
+    balls->mass[to] = balls->mass[from];
+}
+
+static void append_balls (struct World* world, const struct BallList* list) {
+    if (world->count + list->count > world->capacity) world_reserve(world, 2 * (world->count + list->count));
+    for (int n = 0; n < list->count; n++) {
+        const struct DomainBall* ball = &list->items[n];
+        world_add(world, ball->x_pos, ball->y_pos, ball->x_vel, ball->y_vel, ball->radius);
+    }
+}
+
+static int read_all (int fd, void* data, size_t size) {
+    char* bytes = data;
+    while (size > 0) {
+        ssize_t got = read(fd, bytes, size);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return 0;
+        bytes += got;
+        size -= got;
+    }
+    return 1;
+}
+
+static int write_all (int fd, const void* data, size_t size) {
+    const char* bytes = data;
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return 0;
+        bytes += written;
+        size -= written;
+    }
+    return 1;
+}
+
+static int write_balls (int fd, const struct BallList* list) {
+    uint32_t count = list->count;
+    return write_all(fd, &count, sizeof(count)) && write_all(fd, list->items, count * sizeof(struct DomainBall));
+}
+
+static int read_balls (int fd, struct BallList* list) {
+    uint32_t count;
+    if (!read_all(fd, &count, sizeof(count))) return 0;
+    list_reserve(list, count);
+    list->count = count;
+    return read_all(fd, list->items, count * sizeof(struct DomainBall));
+}
+
+// Moves the bytes of one channel along as far as the socket allows. Returns
+// 0 if the neighbour is gone.
+static int pump_out (struct Channel* channel) {
+    size_t total = sizeof(uint32_t) + channel->out_count * sizeof(struct DomainBall);
+    while (channel->out_done < total) {
+        const char* bytes;
+        size_t size;
+        if (channel->out_done < sizeof(uint32_t)) {
+            bytes = (const char*)&channel->out_count + channel->out_done;
+            size = sizeof(uint32_t) - channel->out_done;
+        } else {
+            bytes = (const char*)channel->out->items + channel->out_done - sizeof(uint32_t);
+            size = total - channel->out_done;
+        }
+        ssize_t sent = send(channel->fd, bytes, size, 0);
+        if (sent > 0) {
+            channel->out_done += sent;
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+    return 1;
+}
+
+static int pump_in (struct Channel* channel) {
+    for (;;) {
+        char* bytes;
+        size_t size;
+        if (channel->in_done < sizeof(uint32_t)) {
+            bytes = (char*)&channel->in_count + channel->in_done;
+            size = sizeof(uint32_t) - channel->in_done;
+        } else {
+            size_t total = sizeof(uint32_t) + channel->in_count * sizeof(struct DomainBall);
+            if (channel->in_done == total) return 1;
+            bytes = (char*)channel->in->items + channel->in_done - sizeof(uint32_t);
+            size = total - channel->in_done;
+        }
+        ssize_t got = recv(channel->fd, bytes, size, 0);
+        if (got > 0) {
+            channel->in_done += got;
+            if (channel->in_done == sizeof(uint32_t)) {
+                list_reserve(channel->in, channel->in_count);
+                channel->in->count = channel->in_count;
+            }
+        } else if (got < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+}
+
+static int channel_sending (const struct Channel* channel) {
+    return channel->out_done < sizeof(uint32_t) + channel->out_count * sizeof(struct DomainBall);
+}
+
+static int channel_receiving (const struct Channel* channel) {
+    return channel->in_done < sizeof(uint32_t) ||
+           channel->in_done < sizeof(uint32_t) + channel->in_count * sizeof(struct DomainBall);
+}
+
+// Swaps ball lists with both neighbours at once. Sending and receiving are
+// interleaved, so neither side can stall on a full socket while the other
+// waits to be read.
+static int exchange (int left, int right, const struct BallList* out, struct BallList* in) {
+    struct Channel channels[2];
+    int fds[2] = {left, right};
+    int count = 0;
+    for (int side = 0; side < 2; side++) {
+        in[side].count = 0;
+        if (fds[side] < 0) continue;
+        struct Channel channel = {fds[side], &out[side], out[side].count, 0, &in[side], 0, 0};
+        channels[count++] = channel;
+    }
+
+    for (;;) {
+        struct pollfd polls[2];
+        int waiting = 0;
+        for (int n = 0; n < count; n++) {
+            short events = (channel_sending(&channels[n]) ? POLLOUT : 0) | (channel_receiving(&channels[n]) ? POLLIN : 0);
+            polls[n].fd = channels[n].fd;
+            polls[n].events = events;
+            polls[n].revents = 0;
+            if (events != 0) waiting = 1;
+        }
+        if (!waiting) return 1;
+
+        if (poll(polls, count, -1) < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        for (int n = 0; n < count; n++) {
+            if (polls[n].revents & POLLERR) return 0;
+            if ((polls[n].revents & POLLOUT) && !pump_out(&channels[n])) return 0;
+            if ((polls[n].revents & (POLLIN | POLLHUP)) && !pump_in(&channels[n])) return 0;
+        }
+    }
+}
+
+static void step_rank (struct World* world, int rank, int ranks, int left, int right,
+                       const struct DomainCommand* command, struct DomainReport* report) {
+    static struct BallList out[2];
+    static struct BallList in[2];
+    struct Balls* balls = &world->balls;
+    float left_edge = command->edges[rank];
+    float right_edge = command->edges[rank + 1];
+
+    // Balls that crossed an edge go to that neighbour; the rest close up in
+    // their old order.
+    out[0].count = 0;
+    out[1].count = 0;
+    int kept = 0;
+    for (int i = 0; i < world->count; i++) {
+        struct DomainBall ball = ball_at(balls, i);
+        if (rank > 0 && ball.x_pos < left_edge) {
+            list_push(&out[0], &ball);
+        } else if (rank < ranks - 1 && ball.x_pos >= right_edge) {
+            list_push(&out[1], &ball);
+        } else {
+            move_ball(balls, kept++, i);
+        }
+    }
+    world->count = kept;
+    world_renumber(world);
+    report->migrated = out[0].count + out[1].count;
+    if (!exchange(left, right, out, in)) {
+        fprintf(stderr, "Rank %d lost a neighbour\n", rank);
+        exit(1);
+    }
+    append_balls(world, &in[0]);
+    append_balls(world, &in[1]);
+    int owned = world->count;
+
+    out[0].count = 0;
+    out[1].count = 0;
+    for (int i = 0; i < owned; i++) {
+        struct DomainBall ball = ball_at(balls, i);
+        if (rank > 0 && ball.x_pos - ball.radius < left_edge + command->halo) list_push(&out[0], &ball);
+        if (rank < ranks - 1 && ball.x_pos + ball.radius > right_edge - command->halo) list_push(&out[1], &ball);
+    }
+    if (!exchange(left, right, out, in)) {
+        fprintf(stderr, "Rank %d lost a neighbour\n", rank);
+        exit(1);
+    }
+    append_balls(world, &in[0]);
+    append_balls(world, &in[1]);
+    report->ghosts = world->count - owned;
+
+    // Migrants and ghosts renumber the balls every frame, so no cached
+    // impulse would still name the same pair.
+    contact_cache_clear(&world->contact_cache);
+    world_step(world, 1);
+    world->count = owned;
+    world_renumber(world);
+
+    report->count = owned;
+    report->step_ms = world->step_ms;
+    report->kinetic_energy = world_kinetic_energy(world);
+    report->max_radius = 0.0f;
+    memset(report->histogram, 0, sizeof(report->histogram));
+    for (int i = 0; i < owned; i++) {
+        if (balls->radius[i] > report->max_radius) report->max_radius = balls->radius[i];
+        int bin = (int)((balls->x_pos[i] + 1.0f) * 0.5f * DOMAIN_BINS);
+        bin = bin < 0 ? 0 : bin >= DOMAIN_BINS ? DOMAIN_BINS - 1 : bin;
+        report->histogram[bin]++;
+    }
+}
+
+static int run_rank (const struct DomainConfig* config, int rank, int control, int left, int right) {
+    jobs_init(config->threads);
+    struct World* world = world_create(&config->world);
+
+    struct BallList initial = {0};
+    int status = read_balls(control, &initial) ? 0 : 1;
+    append_balls(world, &initial);
+    free(initial.items);
+
+    struct DomainCommand command;
+    while (status == 0 && read_all(control, &command, sizeof(command)) && command.type != DOMAIN_QUIT) {
+        if (command.type == DOMAIN_GATHER) {
+            struct BallList owned = {0};
+            for (int i = 0; i < world->count; i++) {
+                struct DomainBall ball = ball_at(&world->balls, i);
+                list_push(&owned, &ball);
+            }
+            if (!write_balls(control, &owned)) status = 1;
+            free(owned.items);
+            continue;
+        }
+
+        struct DomainReport report;
+        step_rank(world, rank, config->ranks, left, right, &command, &report);
+        if (!write_all(control, &report, sizeof(report))) status = 1;
+    }
+
+    world_destroy(world);
+    jobs_shutdown();
+    return status;
+}
+
+// A heap of balls on a jittered lattice filling the left half of the box,
+// which collapses to the right and keeps the strips unevenly loaded.
+static void seed_scene (struct BallList* scene, int count) {
+    float spacing = sqrtf(0.98f * 1.96f / (count > 0 ? count : 1));
+    int columns = (int)(0.98f / spacing);
+    if (columns < 1) columns = 1;
+    uint32_t state = 12345;
+    for (int k = 0; k < count; k++) {
+        state = state * 1664525u + 1013904223u;
+        float jitter = ((state >> 8) / 16777216.0f - 0.5f) * 0.2f * spacing;
+        struct DomainBall ball = {-0.98f + spacing * (k % columns + 0.5f) + jitter, -0.98f + spacing * (k / columns + 0.5f),
+                                  0.0f, 0.0f, 0.4f * spacing};
+        list_push(scene, &ball);
+    }
+}
+
+static int load_scene (const struct DomainConfig* config, struct BallList* scene) {
+    if (config->restore_path == NULL) {
+        seed_scene(scene, config->seed_count);
+        return 1;
+    }
+
+    struct Balls balls = {0};
+    struct Links links = {0};
+    struct ContactCache cache = {0};
+    struct SnapshotHeader header;
+    if (!snapshot_restore(config->restore_path, config->world.capacity, &balls, &links, &cache, &header)) return 0;
+    int ok = header.link_count == 0;
+    if (!ok) fprintf(stderr, "%s has links, which cannot be split across processes\n", config->restore_path);
+    for (int i = 0; ok && i < header.count; i++) {
+        struct DomainBall ball = ball_at(&balls, i);
+        list_push(scene, &ball);
+    }
+    balls_free(&balls);
+    links_free(&links);
+    contact_cache_free(&cache);
+    return ok;
+}
+
+// Puts the edges at the quantiles of the x histogram, so each strip holds
+// the same number of balls, but no strip narrower than the halo: ghosts only
+// come from the next strip over.
+static void rebalance (float* edges, int ranks, const uint64_t* histogram, float halo) {
+    uint64_t total = 0;
+    for (int bin = 0; bin < DOMAIN_BINS; bin++) {
+        total += histogram[bin];
+    }
+    if (total == 0 || ranks * halo > 2.0f) return;
+
+    float bin_width = 2.0f / DOMAIN_BINS;
+    uint64_t below = 0;
+    int bin = 0;
+    for (int rank = 1; rank < ranks; rank++) {
+        double target = (double)total * rank / ranks;
+        while (bin < DOMAIN_BINS - 1 && below + histogram[bin] < target) {
+            below += histogram[bin++];
+        }
+        double fraction = histogram[bin] > 0 ? (target - below) / histogram[bin] : 0.0;
+        edges[rank] = -1.0f + (bin + (float)fraction) * bin_width;
+    }
+
+    for (int rank = 1; rank < ranks; rank++) {
+        if (edges[rank] < edges[rank - 1] + halo) edges[rank] = edges[rank - 1] + halo;
+    }
+    for (int rank = ranks - 1; rank > 0; rank--) {
+        if (edges[rank] > edges[rank + 1] - halo) edges[rank] = edges[rank + 1] - halo;
+    }
+}
+
+static void histogram_of (const struct BallList* scene, uint64_t* histogram) {
+    memset(histogram, 0, DOMAIN_BINS * sizeof(uint64_t));
+    for (int n = 0; n < scene->count; n++) {
+        int bin = (int)((scene->items[n].x_pos + 1.0f) * 0.5f * DOMAIN_BINS);
+        bin = bin < 0 ? 0 : bin >= DOMAIN_BINS ? DOMAIN_BINS - 1 : bin;
+        histogram[bin]++;
+    }
+}
+
+static int rank_of (const float* edges, int ranks, float x_pos) {
+    int rank = 0;
+    while (rank < ranks - 1 && x_pos >= edges[rank + 1]) rank++;
+    return rank;
+}
+
+static void print_frame (long frame, double ms, const struct DomainReport* reports, int ranks) {
+    int total = 0;
+    int ghosts = 0;
+    int migrated = 0;
+    int busiest = 0;
+    for (int rank = 0; rank < ranks; rank++) {
+        total += reports[rank].count;
+        ghosts += reports[rank].ghosts;
+        migrated += reports[rank].migrated;
+        if (reports[rank].count > busiest) busiest = reports[rank].count;
+    }
+    printf("frame %ld: %.2f ms/frame, %d balls, %d ghosts, %d migrated, imbalance %.2f, per rank",
+           frame, ms, total, ghosts, migrated, total > 0 ? (double)busiest * ranks / total : 1.0);
+    for (int rank = 0; rank < ranks; rank++) {
+        printf(" %d", reports[rank].count);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+int domain_run (const struct DomainConfig* config) {
+    int ranks = config->ranks;
+    if (ranks < 1 || ranks > DOMAIN_MAX_RANKS) {
+        fprintf(stderr, "Ranks must be between 1 and %d\n", DOMAIN_MAX_RANKS);
+        return 1;
+    }
+    if (config->world.fluid || config->world.solver != SOLVER_IMPULSE) {
+        fprintf(stderr, "Only rigid balls with the impulse solver can be split across processes\n");
+        return 1;
+    }
+
+    struct BallList scene = {0};
+    if (!load_scene(config, &scene)) return 1;
+
+    float max_radius = 0.0f;
+    for (int n = 0; n < scene.count; n++) {
+        if (scene.items[n].radius > max_radius) max_radius = scene.items[n].radius;
+    }
+    struct DomainCommand command;
+    memset(&command, 0, sizeof(command));
+    command.type = DOMAIN_STEP;
+    command.halo = 2.0f * max_radius + DOMAIN_HALO_MARGIN;
+    if (ranks * command.halo > 2.0f) {
+        fprintf(stderr, "%d strips would be narrower than the %.3f halo these balls need\n", ranks, command.halo);
+        free(scene.items);
+        return 1;
+    }
+    for (int rank = 0; rank <= ranks; rank++) {
+        command.edges[rank] = -1.0f + 2.0f * rank / ranks;
+    }
+    uint64_t histogram[DOMAIN_BINS];
+    if (config->balance_interval > 0) {
+        histogram_of(&scene, histogram);
+        rebalance(command.edges, ranks, histogram, command.halo);
+    }
+
+    // control[rank] talks to the coordinator, links[rank] joins rank and
+    // rank + 1. Ranks get the first end of each pair, the coordinator and
+    // the right-hand neighbour the second.
+    int control[DOMAIN_MAX_RANKS][2];
+    int links[DOMAIN_MAX_RANKS][2];
+    for (int rank = 0; rank < ranks; rank++) {
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, control[rank]) != 0 ||
+            (rank < ranks - 1 && socketpair(AF_UNIX, SOCK_STREAM, 0, links[rank]) != 0)) {
+            fprintf(stderr, "Could not connect the ranks\n");
+            return 1;
+        }
+    }
+
+    fflush(stdout);
+    pid_t pids[DOMAIN_MAX_RANKS];
+    for (int rank = 0; rank < ranks; rank++) {
+        pids[rank] = fork();
+        if (pids[rank] < 0) {
+            fprintf(stderr, "Could not start rank %d\n", rank);
+            return 1;
+        }
+        if (pids[rank] > 0) continue;
+
+        int left = rank > 0 ? links[rank - 1][1] : -1;
+        int right = rank < ranks - 1 ? links[rank][0] : -1;
+        for (int other = 0; other < ranks; other++) {
+            close(control[other][1]);
+            if (other != rank) close(control[other][0]);
+            if (other < ranks - 1) {
+                if (links[other][0] != right) close(links[other][0]);
+                if (links[other][1] != left) close(links[other][1]);
+            }
+        }
+        if (left >= 0) fcntl(left, F_SETFL, fcntl(left, F_GETFL) | O_NONBLOCK);
+        if (right >= 0) fcntl(right, F_SETFL, fcntl(right, F_GETFL) | O_NONBLOCK);
+        _exit(run_rank(config, rank, control[rank][0], left, right));
+    }
+    for (int rank = 0; rank < ranks; rank++) {
+        close(control[rank][0]);
+        if (rank < ranks - 1) {
+            close(links[rank][0]);
+            close(links[rank][1]);
+        }
+    }
+
+    struct BallList strips[DOMAIN_MAX_RANKS];
+    memset(strips, 0, sizeof(strips));
+    for (int n = 0; n < scene.count; n++) {
+        list_push(&strips[rank_of(command.edges, ranks, scene.items[n].x_pos)], &scene.items[n]);
+    }
+    int status = 0;
+    for (int rank = 0; rank < ranks; rank++) {
+        if (!write_balls(control[rank][1], &strips[rank])) status = 1;
+        free(strips[rank].items);
+    }
+    printf("Split %d balls over %d ranks, halo %.3f\n", scene.count, ranks, command.halo);
+
+    struct DomainReport reports[DOMAIN_MAX_RANKS];
+    double start = seconds_now();
+    double interval_start = start;
+    long frame = 0;
+    while (status == 0 && frame < config->frames) {
+        command.frame = ++frame;
+        for (int rank = 0; rank < ranks; rank++) {
+            if (!write_all(control[rank][1], &command, sizeof(command))) status = 1;
+        }
+        max_radius = 0.0f;
+        memset(histogram, 0, sizeof(histogram));
+        for (int rank = 0; rank < ranks && status == 0; rank++) {
+            if (!read_all(control[rank][1], &reports[rank], sizeof(struct DomainReport))) {
+                fprintf(stderr, "Rank %d stopped\n", rank);
+                status = 1;
+                break;
+            }
+            if (reports[rank].max_radius > max_radius) max_radius = reports[rank].max_radius;
+            for (int bin = 0; bin < DOMAIN_BINS; bin++) {
+                histogram[bin] += reports[rank].histogram[bin];
+            }
+        }
+        if (status != 0) break;
+
+        float halo = 2.0f * max_radius + DOMAIN_HALO_MARGIN;
+        if (ranks * halo <= 2.0f) command.halo = halo;
+        if (config->balance_interval > 0 && frame % config->balance_interval == 0) {
+            rebalance(command.edges, ranks, histogram, command.halo);
+        }
+        if (frame % STATS_INTERVAL == 0) {
+            double now = seconds_now();
+            print_frame(frame, (now - interval_start) * 1e3 / STATS_INTERVAL, reports, ranks);
+            interval_start = now;
+        }
+    }
+    double seconds = seconds_now() - start;
+
+    // Everything comes back to be counted, so a ball lost or duplicated on
+    // the way between ranks shows.
+    int gathered = 0;
+    double energy = 0.0;
+    struct BallList owned = {0};
+    for (int rank = 0; rank < ranks && status == 0; rank++) {
+        command.type = DOMAIN_GATHER;
+        if (!write_all(control[rank][1], &command, sizeof(command)) || !read_balls(control[rank][1], &owned)) {
+            status = 1;
+            break;
+        }
+        gathered += owned.count;
+        for (int n = 0; n < owned.count; n++) {
+            const struct DomainBall* ball = &owned.items[n];
+            double mass = M_PI * ball->radius * ball->radius * ball->radius;
+            energy += 0.5 * mass * (ball->x_vel * ball->x_vel + ball->y_vel * ball->y_vel);
+        }
+    }
+    free(owned.items);
+
+    command.type = DOMAIN_QUIT;
+    for (int rank = 0; rank < ranks; rank++) {
+        write_all(control[rank][1], &command, sizeof(command));
+        close(control[rank][1]);
+    }
+    for (int rank = 0; rank < ranks; rank++) {
+        int exit_status;
+        if (waitpid(pids[rank], &exit_status, 0) < 0 || !WIFEXITED(exit_status) || WEXITSTATUS(exit_status) != 0) status = 1;
+    }
+
+    if (status == 0) {
+        printf("Stepped %ld frames on %d ranks in %.3f s (%.3f ms/frame); %d of %d balls accounted for, energy %.9g\n",
+               frame, ranks, seconds, frame > 0 ? seconds * 1e3 / frame : 0.0, gathered, scene.count, energy);
+    }
+    free(scene.items);
+    return status != 0 || gathered != scene.count;
+}
@@ -0,0 +1,77 @@
+#ifndef DOMAIN_H
+#define DOMAIN_H
+
+#include <stdint.h>
+
+#include "particles.h"
+
+// Domain decomposition across processes on one machine. The box is cut into
+// vertical strips, one per rank, and each rank is a forked process stepping
+// the balls it owns with the ordinary world step. Before every frame:
+//
+//   1. balls that left a rank's strip migrate to the neighbour on that side
+//      (a ball more than one strip away moves on by a strip per frame);
+//   2. every rank sends copies of its balls within halo of an edge to the
+//      neighbour across it, and steps them as ghosts with its own balls;
+//   3. after the step the ghosts are thrown away.
+//
+// Ghosts reach 2 * the largest radius plus DOMAIN_HALO_MARGIN past an edge,
+// which covers every pair that can touch within the frame. Neighbours talk
+// over socketpairs; a coordinator (the parent) sends each frame's command
+// and collects a report with a histogram of x positions, from which it can
+// move the edges so every strip holds the same number of balls.
+//
+// Only rigid balls with the impulse solver can be split: links and fluid
+// neighbourhoods would have to cross processes too.
+#define DOMAIN_MAX_RANKS 32
+#define DOMAIN_BINS 256
+#define DOMAIN_HALO_MARGIN 0.05f
+
+struct DomainConfig {
+    int ranks;
+    long frames;
+    // Frames between rebalancing the edges; 0 keeps them evenly spaced.
+    int balance_interval;
+    // Worker threads per rank.
+    int threads;
+    // Scene: a snapshot, or seed_count balls heaped in the left half.
+    const char* restore_path;
+    int seed_count;
+    struct WorldConfig world;
+};
+
+// The message one rank sends another: a ball count, then the balls.
+struct DomainBall {
+    float x_pos;
+    float y_pos;
+    float x_vel;
+    float y_vel;
+    float radius;
+};
+
+#define DOMAIN_STEP 0
+#define DOMAIN_GATHER 1
+#define DOMAIN_QUIT 2
+
+struct DomainCommand {
+    int32_t type;
+    float halo;
+    int64_t frame;
+    float edges[DOMAIN_MAX_RANKS + 1];
+};
+
+struct DomainReport {
+    int32_t count;
+    int32_t ghosts;
+    int32_t migrated;
+    float max_radius;
+    double kinetic_energy;
+    double step_ms;
+    uint32_t histogram[DOMAIN_BINS];
+};
+
+// Runs the whole simulation and prints its progress. Returns non-zero if the
+// scene cannot be split or a rank fails.
+int domain_run (const struct DomainConfig* config);
+
+#endif
@@ -0,0 +1,364 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ensemble.h"
+#include "snapshot.h"
+#include "world.h"
+
+struct RunResult {
+    float gravity;
+    float restitution;
+    int count;
+    double kinetic_energy;
+    double mean_height;
+    float max_overlap;
+    double seconds;
+    uint64_t hash;
+    int thread;
+    int ok;
+};
+
+// Each thread owns a range of run numbers and takes from its front. One
+// that runs dry takes the back half of the fullest range left, so threads
+// that drew slow worlds hand work to those that drew fast ones. Ranges only
+// ever shrink, so once every range is empty the sweep is done.
+struct RunQueue {
+    pthread_mutex_t lock;
+    int next;
+    int end;
+    long steals;
+};
+
+struct Ensemble {
+    const struct EnsembleSpec* spec;
+    const char* scene_path;
+    int capacity;
+    int thread_count;
+    struct RunQueue* queues;
+    struct RunResult* results;
+};
+
+struct Worker {
+    struct Ensemble* ensemble;
+    int index;
+};
+
+static double seconds_now () {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// A value, or first:last:count spread evenly from first to last.
+static int parse_values (char* token, float* values, int* count) {
+    for (; token != NULL; token = strtok(NULL, " \t\r\n")) {
+        float first, last;
+        int steps;
+        char tail;
+        if (sscanf(token, "%f:%f:%d%c", &first, &last, &steps, &tail) == 3) {
+            if (steps < 1 || *count + steps > ENSEMBLE_MAX_VALUES) return 0;
+            for (int k = 0; k < steps; k++) {
+                values[(*count)++] = steps > 1 ? first + (last - first) * k / (steps - 1) : first;
+            }
+            continue;
+        }
+
+        char* end;
+        float value = strtof(token, &end);
+        if (end == token || *end != '\0' || *count == ENSEMBLE_MAX_VALUES) return 0;
+        values[(*count)++] = value;
+    }
+    return 1;
+}
+
+int ensemble_parse (const char* path, struct EnsembleSpec* spec) {
+    memset(spec, 0, sizeof(*spec));
+    spec->frames = 600;
+    spec->world.solver = SOLVER_IMPULSE;
+    spec->world.iterations = 4;
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file %s\n", path);
+        return 0;
+    }
+
+    char line[4096];
+    int line_number = 0;
+    int ok = 1;
+    while (ok && fgets(line, sizeof(line), file) != NULL) {
+        line_number++;
+        char* comment = strchr(line, '#');
+        if (comment != NULL) *comment = '\0';
+        char* key = strtok(line, " \t\r\n");
+        if (key == NULL) continue;
+        char* value = strtok(NULL, " \t\r\n");
+
+        if (strcmp(key, "gravity") == 0) {
+            ok = value != NULL && parse_values(value, spec->gravity, &spec->gravity_count);
+        } else if (strcmp(key, "restitution") == 0) {
+            ok = value != NULL && parse_values(value, spec->restitution, &spec->restitution_count);
+        } else if (value == NULL) {
+            ok = 0;
+        } else if (strcmp(key, "scene") == 0) {
+            snprintf(spec->scene_path, sizeof(spec->scene_path), "%s", value);
+        } else if (strcmp(key, "balls") == 0) {
+            spec->seed_count = atoi(value);
+        } else if (strcmp(key, "frames") == 0) {
+            spec->frames = atol(value);
+        } else if (strcmp(key, "iterations") == 0) {
+            spec->world.iterations = atoi(value);
+        } else if (strcmp(key, "solver") == 0 && strcmp(value, "impulse") == 0) {
+            spec->world.solver = SOLVER_IMPULSE;
+        } else if (strcmp(key, "solver") == 0 && strcmp(value, "pbd") == 0) {
+            spec->world.solver = SOLVER_PBD;
+        } else if (strcmp(key, "output") == 0) {
+            snprintf(spec->output_path, sizeof(spec->output_path), "%s", value);
+        } else {
+            ok = 0;
+        }
+    }
+    fclose(file);
+
+    if (!ok) {
+        fprintf(stderr, "%s:%d: cannot read this line\n", path, line_number);
+        return 0;
+    }
+    if (spec->scene_path[0] == '\0' && spec->seed_count <= 0) {
+        fprintf(stderr, "%s needs a scene or a number of balls\n", path);
+        return 0;
+    }
+    if (spec->gravity_count == 0) spec->gravity[spec->gravity_count++] = WORLD_DEFAULT_GRAVITY;
+    if (spec->restitution_count == 0) spec->restitution[spec->restitution_count++] = WORLD_DEFAULT_RESTITUTION;
+    return 1;
+}
+
+// Builds the seeded scene once and writes it where every world can map it.
+static int write_seed_scene (const struct EnsembleSpec* spec, const char* path) {
+    int count = spec->seed_count;
+    struct WorldConfig config = spec->world;
+    config.capacity = count;
+    struct World* world = world_create(&config);
+
+    float spacing = 1.8f / 50;
+    if (count > 2500) spacing = 1.8f / sqrtf((float)count);
+    int columns = (int)(1.8f / spacing);
+    for (int k = 0; k < count; k++) {
+        float radius = spacing * (0.22f + 0.11f * (k % 3));
+        world_add(world, -0.9f + spacing * (k % columns), -0.9f + spacing * (k / columns), 0.0f, 0.0f, radius);
+    }
+
+    struct SnapshotWriter writer;
+    snapshot_writer_start(&writer, count);
+    snapshot_request(&writer, path, &world->balls, world->count, &world->links, &world->contact_cache, world->rope_end, world->broadphase.strategy, 0);
+    snapshot_writer_stop(&writer);
+    int written = writer.written == 1;
+    world_destroy(world);
+    return written;
+}
+
+static void run_world (struct Ensemble* ensemble, int run, struct RunResult* result) {
+    const struct EnsembleSpec* spec = ensemble->spec;
+    result->gravity = spec->gravity[run / spec->restitution_count];
+    result->restitution = spec->restitution[run % spec->restitution_count];
+
+    struct WorldConfig config = spec->world;
+    config.capacity = ensemble->capacity;
+    struct World* world = world_create(&config);
+    struct SnapshotHeader header;
+    if (!snapshot_restore(ensemble->scene_path, ensemble->capacity, &world->balls, &world->links, &world->contact_cache, &header)) {
+        world_destroy(world);
+        return;
+    }
+    world->count = header.count;
+    world->rope_end = header.rope_end;
+    world->stats.frame = header.frame;
+    broadphase_resume(&world->broadphase, header.broadphase);
+    world_renumber(world);
+    world_set_gravity(world, result->gravity);
+    world_set_restitution(world, result->restitution);
+
+    double start = seconds_now();
+    world_step(world, spec->frames);
+    result->seconds = seconds_now() - start;
+
+    result->count = world->count;
+    result->kinetic_energy = world_kinetic_energy(world);
+    double height = 0.0;
+    for (int i = 0; i < world->count; i++) {
+        height += world->balls.y_pos[i];
+    }
+    result->mean_height = world->count > 0 ? height / world->count : 0.0;
+    result->max_overlap = world->stats.max_overlap;
+    result->hash = balls_hash(&world->balls, world->count);
+    result->ok = 1;
+    world_destroy(world);
+}
+
+// The next run for worker self, or -1 once there is none left anywhere.
+static int take_run (struct Ensemble* ensemble, int self) {
+    struct RunQueue* own = &ensemble->queues[self];
+    for (;;) {
+        pthread_mutex_lock(&own->lock);
+        if (own->next < own->end) {
+            int run = own->next++;
+            pthread_mutex_unlock(&own->lock);
+            return run;
+        }
+        pthread_mutex_unlock(&own->lock);
+
+        // The sizes only pick a victim; they can change before the steal,
+        // which looks again under the victim's lock.
+        int victim = -1;
+        int most = 0;
+        for (int other = 0; other < ensemble->thread_count; other++) {
+            if (other == self) continue;
+            struct RunQueue* queue = &ensemble->queues[other];
+            pthread_mutex_lock(&queue->lock);
+            int left = queue->end - queue->next;
+            pthread_mutex_unlock(&queue->lock);
+            if (left > most) {
+                victim = other;
+                most = left;
+            }
+        }
+        if (victim < 0) return -1;
+
+        struct RunQueue* queue = &ensemble->queues[victim];
+        pthread_mutex_lock(&queue->lock);
+        int left = queue->end - queue->next;
+        int half = (left + 1) / 2;
+        int begin = queue->end - half;
+        if (half > 0) queue->end = begin;
+        pthread_mutex_unlock(&queue->lock);
+        if (half == 0) continue;
+
+        pthread_mutex_lock(&own->lock);
+        own->next = begin;
+        own->end = begin + half;
+        own->steals++;
+        pthread_mutex_unlock(&own->lock);
+    }
+}
+
+static void* worker_main (void* arg) {
+    struct Worker* worker = arg;
+    struct Ensemble* ensemble = worker->ensemble;
+    for (int run = take_run(ensemble, worker->index); run >= 0; run = take_run(ensemble, worker->index)) {
+        ensemble->results[run].thread = worker->index;
+        run_world(ensemble, run, &ensemble->results[run]);
+    }
+    return NULL;
+}
+
+int ensemble_run (const struct EnsembleSpec* spec, int thread_count) {
+    if (thread_count <= 0) thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (thread_count <= 0) thread_count = 1;
+    int runs = spec->gravity_count * spec->restitution_count;
+    if (thread_count > runs) thread_count = runs;
+
+    char seed_path[] = "/tmp/particle_sweep.XXXXXX";
+    const char* scene_path = spec->scene_path;
+    if (scene_path[0] == '\0') {
+        int fd = mkstemp(seed_path);
+        if (fd < 0) {
+            fprintf(stderr, "Could not create %s\n", seed_path);
+            return 1;
+        }
+        close(fd);
+        if (!write_seed_scene(spec, seed_path)) {
+            unlink(seed_path);
+            return 1;
+        }
+        scene_path = seed_path;
+    }
+
+    // Worlds must match the scene's capacity to map it.
+    struct SnapshotHeader header;
+    FILE* scene = fopen(scene_path, "rb");
+    int readable = scene != NULL && fread(&header, sizeof(header), 1, scene) == 1 && header.magic == SNAPSHOT_MAGIC;
+    if (scene != NULL) fclose(scene);
+    if (!readable) {
+        fprintf(stderr, "%s is not a snapshot\n", scene_path);
+        if (scene_path == seed_path) unlink(seed_path);
+        return 1;
+    }
+
+    FILE* output = stdout;
+    if (spec->output_path[0] != '\0') {
+        output = fopen(spec->output_path, "w");
+        if (output == NULL) {
+            fprintf(stderr, "Error opening file %s\n", spec->output_path);
+            if (scene_path == seed_path) unlink(seed_path);
+            return 1;
+        }
+    }
+
+    struct Ensemble ensemble = {spec, scene_path, header.capacity, thread_count, NULL, NULL};
+    ensemble.queues = calloc(thread_count, sizeof(struct RunQueue));
+    ensemble.results = calloc(runs, sizeof(struct RunResult));
+    struct Worker* workers = calloc(thread_count, sizeof(struct Worker));
+    pthread_t* threads = calloc(thread_count, sizeof(pthread_t));
+    if (ensemble.queues == NULL || ensemble.results == NULL || workers == NULL || threads == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(1);
+    }
+    for (int n = 0; n < thread_count; n++) {
+        pthread_mutex_init(&ensemble.queues[n].lock, NULL);
+        ensemble.queues[n].next = (int)((long)runs * n / thread_count);
+        ensemble.queues[n].end = (int)((long)runs * (n + 1) / thread_count);
+        workers[n].ensemble = &ensemble;
+        workers[n].index = n;
+    }
+
+    double start = seconds_now();
+    for (int n = 1; n < thread_count; n++) {
+        if (pthread_create(&threads[n], NULL, worker_main, &workers[n]) != 0) {
+            fprintf(stderr, "Could not start sweep thread %d\n", n);
+            exit(1);
+        }
+    }
+    worker_main(&workers[0]);
+    for (int n = 1; n < thread_count; n++) {
+        pthread_join(threads[n], NULL);
+    }
+    double seconds = seconds_now() - start;
+
+    int failed = 0;
+    long steals = 0;
+    for (int n = 0; n < thread_count; n++) {
+        steals += ensemble.queues[n].steals;
+    }
+    fprintf(output, "run,gravity,restitution,count,kinetic_energy,mean_height,max_overlap,seconds,hash,thread\n");
+    for (int run = 0; run < runs; run++) {
+        const struct RunResult* result = &ensemble.results[run];
+        if (!result->ok) {
+            failed++;
+            continue;
+        }
+        fprintf(output, "%d,%.9g,%.9g,%d,%.9g,%.9g,%.9g,%.6f,%016llx,%d\n", run, result->gravity, result->restitution,
+                result->count, result->kinetic_energy, result->mean_height, result->max_overlap, result->seconds,
+                (unsigned long long)result->hash, result->thread);
+    }
+    if (output != stdout) fclose(output);
+
+    // Kept off stdout when the table goes there.
+    fprintf(spec->output_path[0] == '\0' ? stderr : stdout, "Swept %d worlds of %d balls over %ld frames on %d threads in %.3f s (%.2f worlds/s, %ld steals)%s\n",
+            runs, header.count, spec->frames, thread_count, seconds, runs / seconds, steals,
+            failed > 0 ? ", some worlds failed" : "");
+
+    for (int n = 0; n < thread_count; n++) {
+        pthread_mutex_destroy(&ensemble.queues[n].lock);
+    }
+    free(ensemble.queues);
+    free(ensemble.results);
+    free(workers);
+    free(threads);
+    if (scene_path == seed_path) unlink(seed_path);
+    return failed > 0;
+}
@@ -0,0 +1,43 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include "particles.h"
+
+// Parameter sweeps: many independent worlds started from one scene, each
+// stepped on a single thread, as many at a time as there are threads. A
+// sweep is a text file of "key values" lines; # starts a comment:
+//
+//   scene checkpoint.snap      snapshot to start from, or
+//   balls 2000                 a heap of balls built for the sweep
+//   frames 600
+//   solver impulse             or pbd
+//   iterations 4
+//   gravity -0.001:0:11        a list of values, or first:last:count
+//   restitution 0.5 0.75 0.9
+//   output sweep.csv           one line per world; stdout by default
+//
+// Every combination of gravity and restitution is one world. The scene is
+// a snapshot mapped copy-on-write by every world, so the pages nothing
+// writes to, radius and mass, stay shared between all of them.
+#define ENSEMBLE_MAX_VALUES 1024
+
+struct EnsembleSpec {
+    char scene_path[256];
+    int seed_count;
+    long frames;
+    struct WorldConfig world;
+    float gravity[ENSEMBLE_MAX_VALUES];
+    int gravity_count;
+    float restitution[ENSEMBLE_MAX_VALUES];
+    int restitution_count;
+    char output_path[256];
+};
+
+// Returns 0 and says why if the file cannot be read or has a bad line.
+int ensemble_parse (const char* path, struct EnsembleSpec* spec);
+
+// Runs every world of the sweep on thread_count threads (0 means one per
+// core) and writes their summaries. Returns non-zero on failure.
+int ensemble_run (const struct EnsembleSpec* spec, int thread_count);
+
+#endif
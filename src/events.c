@@ -0,0 +1,68 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "events.h"
+
+int event_log_create (struct EventLog* log, const char* path, struct EventLogHeader* header) {
+    log->event_count = 0;
+    log->file = fopen(path, "wb");
+    if (log->file == NULL) {
+        fprintf(stderr, "Error opening file %s\n", path);
+        return 0;
+    }
+
+    header->magic = EVENT_LOG_MAGIC;
+    header->version = EVENT_LOG_VERSION;
+    header->header_size = sizeof(*header);
+    fwrite(header, sizeof(*header), 1, log->file);
+    fflush(log->file);
+    return 1;
+}
+
+void event_log_write (struct EventLog* log, const struct SimEvent* event) {
+    fwrite(event, sizeof(*event), 1, log->file);
+    fflush(log->file);
+    log->event_count++;
+}
+
+void event_log_close (struct EventLog* log, long frame) {
+    struct SimEvent end = {frame, EVENT_END, 0, 0.0f, 0.0f, 0.0f};
+    event_log_write(log, &end);
+    fclose(log->file);
+}
+
+struct SimEvent* event_log_load (const char* path, struct EventLogHeader* header, int* event_count) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file %s\n", path);
+        return NULL;
+    }
+
+    if (fread(header, sizeof(*header), 1, file) != 1 || header->magic != EVENT_LOG_MAGIC ||
+        header->version != EVENT_LOG_VERSION || header->header_size != sizeof(*header)) {
+        fprintf(stderr, "%s is not a version %d input log\n", path, EVENT_LOG_VERSION);
+        fclose(file);
+        return NULL;
+    }
+    header->restore_path[sizeof(header->restore_path) - 1] = '\0';
+
+    int capacity = 256;
+    struct SimEvent* events = malloc(capacity * sizeof(struct SimEvent));
+    *event_count = 0;
+    for (;;) {
+        if (*event_count == capacity) {
+            capacity *= 2;
+            events = realloc(events, capacity * sizeof(struct SimEvent));
+        }
+        if (events == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(1);
+        }
+        // A torn last record is what a crash mid-write leaves; it is dropped.
+        if (fread(&events[*event_count], sizeof(struct SimEvent), 1, file) != 1) break;
+        (*event_count)++;
+    }
+
+    fclose(file);
+    return events;
+}
@@ -0,0 +1,68 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Everything the user can do to the world, as data. Input callbacks turn
+// clicks and key presses into events, so the same events can be applied
+// again when re-simulating. x and y are in simulation coordinates and
+// radius is the brush size at the time.
+#define EVENT_ADD_BALL 0
+#define EVENT_ADD_FLUID 1
+#define EVENT_EXTEND_ROPE 2
+#define EVENT_START_ROPE 3
+#define EVENT_ADD_SOFT_BODY 4
+// Only found in input logs: value is how many frames were rewound, and the
+// end marker's frame is the last frame the session stepped.
+#define EVENT_REWIND 5
+#define EVENT_END 6
+
+// frame is the number of steps taken when the event happened; it is applied
+// before the step that follows.
+struct SimEvent {
+    int64_t frame;
+    int32_t type;
+    int32_t value;
+    float x;
+    float y;
+    float radius;
+};
+
+// An input log is this header followed by every event of a session in the
+// order it happened, so the session can be stepped again exactly.
+// Everything else that decides how the world evolves is in the header.
+#define EVENT_LOG_MAGIC 0x474c4e49 // "INLG"
+#define EVENT_LOG_VERSION 1
+
+struct EventLogHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    int32_t sph_mode;
+    int32_t fluid_count;
+    int32_t solver_mode;
+    int32_t solver_iterations;
+    int32_t reserved;
+    uint64_t rewind_budget;
+    char restore_path[256];
+};
+
+struct EventLog {
+    FILE* file;
+    long event_count;
+};
+
+// Returns 0 if the file cannot be created. magic, version and header_size
+// are filled in.
+int event_log_create (struct EventLog* log, const char* path, struct EventLogHeader* header);
+// Written through at once, so a log cut short by a crash still replays up
+// to the crash.
+void event_log_write (struct EventLog* log, const struct SimEvent* event);
+void event_log_close (struct EventLog* log, long frame);
+
+// Reads a whole log into a malloc'd array, or returns NULL if it is not a
+// log this version understands.
+struct SimEvent* event_log_load (const char* path, struct EventLogHeader* header, int* event_count);
+
+#endif
@@ -0,0 +1,120 @@
+#include <string.h>
+
+#include "integrate.h"
+#include "simd.h"
+
+struct Lanes {
+    vfloat radius;
+    vfloat x_pos;
+    vfloat y_pos;
+    vfloat x_vel;
+    vfloat y_vel;
+};
+
+static void run_passes (struct Lanes* lanes, const struct IntegrateParams* params) {
+    if (params->passes & INTEGRATE_MOVE) {
+        vfloat dt = vsplat(params->dt);
+        lanes->y_vel += vsplat(params->gravity) * dt;
+        lanes->x_pos += lanes->x_vel * dt;
+        lanes->y_pos += lanes->y_vel * dt;
+    }
+
+    if (params->passes & INTEGRATE_WALLS) {
+        vfloat low = vsplat(-1.0f) + lanes->radius;
+        vfloat high = vsplat(1.0f) - lanes->radius;
+        vfloat restitution = vsplat(params->restitution);
+
+        vmask below = lanes->y_pos < low;
+        lanes->y_pos = vselect(below, low, lanes->y_pos);
+        lanes->y_vel = vselect(below, -lanes->y_vel * restitution, lanes->y_vel);
+
+        vmask above = lanes->y_pos > high;
+        lanes->y_pos = vselect(above, high, lanes->y_pos);
+        lanes->y_vel = vselect(above, -lanes->y_vel * restitution, lanes->y_vel);
+
+        vmask left = lanes->x_pos < low;
+        lanes->x_pos = vselect(left, low, lanes->x_pos);
+        lanes->x_vel = vselect(left, -lanes->x_vel * restitution, lanes->x_vel);
+
+        vmask right = lanes->x_pos > high;
+        lanes->x_pos = vselect(right, high, lanes->x_pos);
+        lanes->x_vel = vselect(right, -lanes->x_vel * restitution, lanes->x_vel);
+    }
+}
+
+void integrate_balls (struct Balls* balls, int begin, int end, const struct IntegrateParams* params) {
+    int i = begin;
+    for (; i + SIMD_WIDTH <= end; i += SIMD_WIDTH) {
+        struct Lanes lanes = {vload(balls->radius + i), vload(balls->x_pos + i), vload(balls->y_pos + i),
+                              vload(balls->x_vel + i), vload(balls->y_vel + i)};
+        run_passes(&lanes, params);
+        vstore(balls->x_pos + i, lanes.x_pos);
+        vstore(balls->y_pos + i, lanes.y_pos);
+        vstore(balls->x_vel + i, lanes.x_vel);
+        vstore(balls->y_vel + i, lanes.y_vel);
+    }
+    if (i == end) return;
+
+    // Padding lanes sit at rest in the middle of the box.
+    int count = end - i;
+    float fields[5][SIMD_WIDTH] = {{0.0f}};
+    float* sources[5] = {balls->radius, balls->x_pos, balls->y_pos, balls->x_vel, balls->y_vel};
+    for (int f = 0; f < 5; f++) {
+        memcpy(fields[f], sources[f] + i, count * sizeof(float));
+    }
+
+    struct Lanes lanes = {vload(fields[0]), vload(fields[1]), vload(fields[2]), vload(fields[3]), vload(fields[4])};
+    run_passes(&lanes, params);
+    vstore(fields[1], lanes.x_pos);
+    vstore(fields[2], lanes.y_pos);
+    vstore(fields[3], lanes.x_vel);
+    vstore(fields[4], lanes.y_vel);
+    for (int f = 1; f < 5; f++) {
+        memcpy(sources[f] + i, fields[f], count * sizeof(float));
+    }
+}
+
+static void move_ball (struct Balls* balls, int i, float dt, float gravity) {
+    balls->y_vel[i] += gravity * dt;
+    balls->x_pos[i] += balls->x_vel[i] * dt;
+    balls->y_pos[i] += balls->y_vel[i] * dt;
+}
+
+static void bounce_ball (struct Balls* balls, int i, float restitution) {
+    float bottom_limit = -1.0f + balls->radius[i];
+    if (balls->y_pos[i] < bottom_limit) {
+        balls->y_pos[i] = bottom_limit;
+        balls->y_vel[i] = -balls->y_vel[i] * restitution;
+    }
+
+    float top_limit = 1.0f - balls->radius[i];
+    if (balls->y_pos[i] > top_limit) {
+        balls->y_pos[i] = top_limit;
+        balls->y_vel[i] = -balls->y_vel[i] * restitution;
+    }
+
+    float left_limit = -1.0f + balls->radius[i];
+    if (balls->x_pos[i] < left_limit) {
+        balls->x_pos[i] = left_limit;
+        balls->x_vel[i] = -balls->x_vel[i] * restitution;
+    }
+
+    float right_limit = 1.0f - balls->radius[i];
+    if (balls->x_pos[i] > right_limit) {
+        balls->x_pos[i] = right_limit;
+        balls->x_vel[i] = -balls->x_vel[i] * restitution;
+    }
+}
+
+void integrate_balls_scalar (struct Balls* balls, int begin, int end, const struct IntegrateParams* params) {
+    if (params->passes & INTEGRATE_MOVE) {
+        for (int i = begin; i < end; i++) {
+            move_ball(balls, i, params->dt, params->gravity);
+        }
+    }
+    if (params->passes & INTEGRATE_WALLS) {
+        for (int i = begin; i < end; i++) {
+            bounce_ball(balls, i, params->restitution);
+        }
+    }
+}
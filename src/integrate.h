@@ -0,0 +1,28 @@
+#ifndef INTEGRATE_H
+#define INTEGRATE_H
+
+#include "balls.h"
+
+// What a pass over the balls does: move them through a substep under
+// gravity, bounce them off the walls of the [-1, 1] box, or both at once.
+#define INTEGRATE_MOVE 1
+#define INTEGRATE_WALLS 2
+
+struct IntegrateParams {
+    float dt;
+    float gravity;
+    float restitution;
+    int passes;
+};
+
+// Runs the passes over balls [begin, end) SIMD_WIDTH balls at a time, with
+// every wall test a masked select rather than a branch. begin must be a
+// multiple of SIMD_WIDTH; a short last block goes through the same vector
+// code padded, so results never depend on where a range was split.
+void integrate_balls (struct Balls* balls, int begin, int end, const struct IntegrateParams* params);
+
+// The same passes one ball at a time, each pass a loop of its own, for
+// comparing against.
+void integrate_balls_scalar (struct Balls* balls, int begin, int end, const struct IntegrateParams* params);
+
+#endif
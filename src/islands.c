@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "islands.h"
+
+static void* grow (void* data, int* capacity, int needed, size_t item_size) {
+    if (needed <= *capacity) return data;
+
+    int new_capacity = *capacity > 0 ? *capacity : 256;
+    while (new_capacity < needed) new_capacity *= 2;
+
+    data = realloc(data, new_capacity * item_size);
+    if (data == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(1);
+    }
+    *capacity = new_capacity;
+    return data;
+}
+
+static int find_root (int* parent, int i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+// The lower index always becomes the root, so islands do not depend on the
+// order contacts arrive in.
+static void unite (int* parent, int a, int b) {
+    a = find_root(parent, a);
+    b = find_root(parent, b);
+    if (a < b) parent[b] = a;
+    if (b < a) parent[a] = b;
+}
+
+static int compare_islands (const void* a, const void* b) {
+    const struct Island* island_a = a;
+    const struct Island* island_b = b;
+    if (island_a->contact_count != island_b->contact_count) {
+        return island_b->contact_count - island_a->contact_count;
+    }
+    return island_a->root - island_b->root;
+}
+
+static int bucket_of (int ball_count) {
+    int bucket = 0;
+    while (bucket < ISLAND_BUCKETS - 1 && ball_count > (2 << bucket)) bucket++;
+    return bucket;
+}
+
+void islands_build (struct Islands* islands, struct Contact* contacts, int contact_count, int ball_count) {
+    for (int b = 0; b < ISLAND_BUCKETS; b++) {
+        islands->histogram[b] = 0;
+    }
+    islands->count = 0;
+    if (contact_count == 0) return;
+
+    // parent, island_of and stamp always grow together.
+    int old_capacity = islands->ball_capacity;
+    int capacity = old_capacity;
+    islands->parent = grow(islands->parent, &capacity, ball_count, sizeof(int));
+    capacity = old_capacity;
+    islands->island_of = grow(islands->island_of, &capacity, ball_count, sizeof(int));
+    islands->stamp = grow(islands->stamp, &islands->ball_capacity, ball_count, sizeof(int));
+    for (int i = old_capacity; i < islands->ball_capacity; i++) {
+        islands->stamp[i] = 0;
+    }
+    islands->generation++;
+
+    int* parent = islands->parent;
+    int* island_of = islands->island_of;
+    for (int k = 0; k < contact_count; k++) {
+        parent[contacts[k].i] = contacts[k].i;
+        parent[contacts[k].j] = contacts[k].j;
+        island_of[contacts[k].i] = -1;
+        island_of[contacts[k].j] = -1;
+    }
+    for (int k = 0; k < contact_count; k++) {
+        unite(parent, contacts[k].i, contacts[k].j);
+    }
+
+    for (int k = 0; k < contact_count; k++) {
+        int root = find_root(parent, contacts[k].i);
+        if (island_of[root] < 0) {
+            islands->items = grow(islands->items, &islands->island_capacity, islands->count + 1, sizeof(struct Island));
+            struct Island island = {root, 0, 0, 0};
+            island_of[root] = islands->count;
+            islands->items[islands->count++] = island;
+        }
+        islands->items[island_of[root]].contact_count++;
+
+        int ends[2] = {contacts[k].i, contacts[k].j};
+        for (int e = 0; e < 2; e++) {
+            if (islands->stamp[ends[e]] == islands->generation) continue;
+            islands->stamp[ends[e]] = islands->generation;
+            islands->items[island_of[root]].ball_count++;
+        }
+    }
+
+    // Largest first, so the big islands start early and small ones fill in
+    // around them.
+    qsort(islands->items, islands->count, sizeof(struct Island), compare_islands);
+
+    int begin = 0;
+    for (int n = 0; n < islands->count; n++) {
+        struct Island* island = &islands->items[n];
+        island_of[island->root] = n;
+        island->contact_begin = begin;
+        begin += island->contact_count;
+        islands->histogram[bucket_of(island->ball_count)]++;
+    }
+
+    // Stable scatter into island order, using contact_count as the cursor.
+    islands->sorted = grow(islands->sorted, &islands->contact_capacity, contact_count, sizeof(struct Contact));
+    for (int n = 0; n < islands->count; n++) {
+        islands->items[n].contact_count = 0;
+    }
+    for (int k = 0; k < contact_count; k++) {
+        struct Island* island = &islands->items[island_of[find_root(parent, contacts[k].i)]];
+        islands->sorted[island->contact_begin + island->contact_count++] = contacts[k];
+    }
+    for (int k = 0; k < contact_count; k++) {
+        contacts[k] = islands->sorted[k];
+    }
+}
+
+void islands_free (struct Islands* islands) {
+    free(islands->items);
+    free(islands->parent);
+    free(islands->island_of);
+    free(islands->stamp);
+    free(islands->sorted);
+}
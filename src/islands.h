@@ -0,0 +1,41 @@
+#ifndef ISLANDS_H
+#define ISLANDS_H
+
+#include "contacts.h"
+
+// Island sizes are binned by powers of two: bucket b counts islands of
+// 2^b + 1 to 2^(b + 1) balls, the last bucket everything bigger.
+#define ISLAND_BUCKETS 12
+
+// A set of balls connected through touching contacts. No contact links two
+// islands, so islands can be solved concurrently without locks.
+struct Island {
+    int root;
+    int contact_begin;
+    int contact_count;
+    int ball_count;
+};
+
+struct Islands {
+    struct Island* items;
+    int count;
+    int island_capacity;
+
+    int* parent;
+    int* island_of;
+    int* stamp;
+    int ball_capacity;
+    int generation;
+
+    struct Contact* sorted;
+    int contact_capacity;
+
+    int histogram[ISLAND_BUCKETS];
+};
+
+// Splits the contacts into islands with union-find and reorders them so each
+// island's contacts are contiguous. Islands come largest first.
+void islands_build (struct Islands* islands, struct Contact* contacts, int contact_count, int ball_count);
+void islands_free (struct Islands* islands);
+
+#endif
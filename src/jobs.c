@@ -0,0 +1,486 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "jobs.h"
+
+// A piece of a batch still to run.
+struct Task {
+    struct JobBatch* batch;
+    int begin;
+    int end;
+};
+
+// Every thread of the pool owns a deque: it pushes and pops tasks at the
+// bottom, and other threads steal from the top, taking the oldest and so the
+// biggest halves. top and bottom only change under the lock but are read
+// without it to see whether there is anything to take. Both go back to 0
+// whenever the deque empties, so a long-running pool never overflows them.
+struct Worker {
+    pthread_mutex_t lock;
+    struct Task tasks[JOBS_DEQUE_SIZE];
+    atomic_int top;
+    atomic_int bottom;
+
+    unsigned seed;
+    int depth;
+
+    // Written by the owner, read by jobs_worker_stats.
+    atomic_long busy_ns;
+    atomic_long sleep_ns;
+    atomic_long task_count;
+    atomic_long steal_count;
+    atomic_long sleep_count;
+};
+
+static pthread_t threads[JOBS_MAX_THREADS];
+// Worker 0 belongs to whichever thread holds submit_lock.
+static struct Worker workers[JOBS_MAX_THREADS];
+static int worker_count = 0;
+
+static pthread_mutex_t submit_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t sleep_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static atomic_int sleepers;
+static atomic_int quitting;
+
+static _Thread_local struct Worker* current = NULL;
+
+static long now_ns () {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+static int deque_size (struct Worker* worker) {
+    return atomic_load_explicit(&worker->bottom, memory_order_relaxed) -
+           atomic_load_explicit(&worker->top, memory_order_relaxed);
+}
+
+static void wake_sleepers () {
+    // Pairs with the fence in worker_sleep: either the sleeper sees the new
+    // task, or this sees the sleeper.
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&sleepers) == 0) return;
+    pthread_mutex_lock(&sleep_lock);
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&sleep_lock);
+}
+
+// Called under the worker's lock.
+static void set_ends (struct Worker* worker, int top, int bottom) {
+    if (top == bottom) top = bottom = 0;
+    atomic_store_explicit(&worker->top, top, memory_order_relaxed);
+    atomic_store_explicit(&worker->bottom, bottom, memory_order_relaxed);
+}
+
+// Returns 0 if the deque is full.
+static int push (struct Worker* worker, struct Task task) {
+    pthread_mutex_lock(&worker->lock);
+    int bottom = atomic_load_explicit(&worker->bottom, memory_order_relaxed);
+    int top = atomic_load_explicit(&worker->top, memory_order_relaxed);
+    if (bottom - top >= JOBS_DEQUE_SIZE) {
+        pthread_mutex_unlock(&worker->lock);
+        return 0;
+    }
+    worker->tasks[bottom % JOBS_DEQUE_SIZE] = task;
+    atomic_store_explicit(&worker->bottom, bottom + 1, memory_order_relaxed);
+    pthread_mutex_unlock(&worker->lock);
+
+    wake_sleepers();
+    return 1;
+}
+
+static int pop (struct Worker* worker, struct Task* task) {
+    if (deque_size(worker) <= 0) return 0;
+
+    pthread_mutex_lock(&worker->lock);
+    int bottom = atomic_load_explicit(&worker->bottom, memory_order_relaxed);
+    int top = atomic_load_explicit(&worker->top, memory_order_relaxed);
+    int found = bottom > top;
+    if (found) {
+        *task = worker->tasks[(bottom - 1) % JOBS_DEQUE_SIZE];
+        set_ends(worker, top, bottom - 1);
+    }
+    pthread_mutex_unlock(&worker->lock);
+    return found;
+}
+
+static int steal (struct Worker* self, struct Task* task) {
+    int count = worker_count + 1;
+    self->seed = self->seed * 1103515245u + 12345u;
+    int start = (self->seed >> 16) % count;
+
+    for (int k = 0; k < count; k++) {
+        struct Worker* victim = &workers[(start + k) % count];
+        if (victim == self || deque_size(victim) <= 0) continue;
+
+        pthread_mutex_lock(&victim->lock);
+        int bottom = atomic_load_explicit(&victim->bottom, memory_order_relaxed);
+        int top = atomic_load_explicit(&victim->top, memory_order_relaxed);
+        int found = bottom > top;
+        if (found) {
+            *task = victim->tasks[top % JOBS_DEQUE_SIZE];
+            set_ends(victim, top + 1, bottom);
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (found) {
+            atomic_fetch_add_explicit(&self->steal_count, 1, memory_order_relaxed);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void release_node (struct Worker* self, struct TaskGraph* graph, int node);
+static void run_task (struct Worker* self, struct Task task);
+
+static void finish_node (struct Worker* self, struct TaskGraph* graph, int node) {
+    struct TaskNode* finished = &graph->nodes[node];
+    for (int k = 0; k < finished->dependent_count; k++) {
+        int next = finished->dependents[k];
+        if (atomic_fetch_sub(&graph->nodes[next].waiting, 1) == 1) release_node(self, graph, next);
+    }
+    // Last, so the graph is not done while a dependent is still being queued.
+    atomic_fetch_sub(&graph->unfinished, 1);
+}
+
+static void release_node (struct Worker* self, struct TaskGraph* graph, int node) {
+    struct TaskNode* ready = &graph->nodes[node];
+    if (ready->count <= 0) {
+        finish_node(self, graph, node);
+        return;
+    }
+
+    atomic_store(&ready->batch.remaining, ready->count);
+    struct Task task = {&ready->batch, 0, ready->count};
+    if (!push(self, task)) run_task(self, task);
+}
+
+// Runs a task, first giving away halves of it while this thread's deque is
+// short, then chunk by chunk so a thief can still take what is left.
+static void run_task (struct Worker* self, struct Task task) {
+    struct JobBatch* batch = task.batch;
+    atomic_fetch_add_explicit(&self->task_count, 1, memory_order_relaxed);
+
+    while (task.begin < task.end) {
+        int size = task.end - task.begin;
+        if (size > batch->grain && deque_size(self) < JOBS_SPLIT_DEPTH) {
+            int middle = task.begin + size / 2;
+            struct Task half = {batch, middle, task.end};
+            if (push(self, half)) {
+                task.end = middle;
+                continue;
+            }
+        }
+
+        int end = size > batch->grain ? task.begin + batch->grain : task.end;
+        batch->fn(batch->context, task.begin, end);
+
+        // The batch may be gone once remaining reaches zero.
+        struct TaskGraph* graph = batch->graph;
+        int node = batch->node;
+        if (atomic_fetch_sub(&batch->remaining, end - task.begin) == end - task.begin && graph != NULL) {
+            finish_node(self, graph, node);
+        }
+        task.begin = end;
+    }
+}
+
+static void execute (struct Worker* self, struct Task task) {
+    // Only the outermost task is timed; nested ones run inside it.
+    if (self->depth++ > 0) {
+        run_task(self, task);
+    } else {
+        long start = now_ns();
+        run_task(self, task);
+        atomic_fetch_add_explicit(&self->busy_ns, now_ns() - start, memory_order_relaxed);
+    }
+    self->depth--;
+}
+
+static int find_task (struct Worker* self, struct Task* task) {
+    return pop(self, task) || steal(self, task);
+}
+
+// Runs queued tasks, its own first, until counter reaches zero.
+static void help_until (struct Worker* self, atomic_int* counter) {
+    struct Task task;
+    while (atomic_load(counter) > 0) {
+        if (find_task(self, &task)) execute(self, task);
+    }
+}
+
+static int work_available () {
+    for (int w = 0; w <= worker_count; w++) {
+        if (deque_size(&workers[w]) > 0) return 1;
+    }
+    return 0;
+}
+
+static void worker_sleep (struct Worker* self) {
+    long start = now_ns();
+    pthread_mutex_lock(&sleep_lock);
+    atomic_fetch_add(&sleepers, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!work_available() && !atomic_load(&quitting)) {
+        // The timeout only bounds how long a missed wakeup could cost.
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += 10000000;
+        if (until.tv_nsec >= 1000000000) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&wake, &sleep_lock, &until);
+        atomic_fetch_add_explicit(&self->sleep_count, 1, memory_order_relaxed);
+    }
+    atomic_fetch_sub(&sleepers, 1);
+    pthread_mutex_unlock(&sleep_lock);
+    atomic_fetch_add_explicit(&self->sleep_ns, now_ns() - start, memory_order_relaxed);
+}
+
+static void* worker_main (void* arg) {
+    struct Worker* self = arg;
+    current = self;
+
+    // Between frames there is nothing to do for a few milliseconds, while
+    // inside a frame work arrives microseconds apart, so spin before sleeping.
+    int idle = 0;
+    struct Task task;
+    while (!atomic_load(&quitting)) {
+        if (find_task(self, &task)) {
+            execute(self, task);
+            idle = 0;
+        } else if (++idle < JOBS_SPIN) {
+            sched_yield();
+        } else {
+            worker_sleep(self);
+            idle = 0;
+        }
+    }
+    return NULL;
+}
+
+static void reset_worker (struct Worker* worker, unsigned seed) {
+    atomic_store(&worker->top, 0);
+    atomic_store(&worker->bottom, 0);
+    worker->seed = seed;
+    worker->depth = 0;
+    atomic_store(&worker->busy_ns, 0);
+    atomic_store(&worker->sleep_ns, 0);
+    atomic_store(&worker->task_count, 0);
+    atomic_store(&worker->steal_count, 0);
+    atomic_store(&worker->sleep_count, 0);
+}
+
+void jobs_init (int thread_count) {
+    if (thread_count <= 0) thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (thread_count < 1) thread_count = 1;
+    if (thread_count > JOBS_MAX_THREADS) thread_count = JOBS_MAX_THREADS;
+
+    atomic_store(&quitting, 0);
+    for (int w = 0; w < thread_count; w++) {
+        pthread_mutex_init(&workers[w].lock, NULL);
+        reset_worker(&workers[w], 2654435761u * (w + 1));
+    }
+
+    // Workers look at worker_count when stealing, so it is set first.
+    worker_count = thread_count - 1;
+    for (int i = 0; i < worker_count; i++) {
+        if (pthread_create(&threads[i], NULL, worker_main, &workers[i + 1]) != 0) {
+            fprintf(stderr, "Failed to start worker thread\n");
+            exit(1);
+        }
+    }
+}
+
+void jobs_shutdown () {
+    atomic_store(&quitting, 1);
+    pthread_mutex_lock(&sleep_lock);
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&sleep_lock);
+
+    for (int i = 0; i < worker_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (int w = 0; w <= worker_count; w++) {
+        pthread_mutex_destroy(&workers[w].lock);
+    }
+    worker_count = 0;
+}
+
+int jobs_thread_count () {
+    return worker_count + 1;
+}
+
+// The worker the calling thread runs tasks as, taking worker 0 if it is not
+// one of the pool's threads. Returns NULL if it should run its work inline:
+// there is no pool, or another thread's work holds it, most likely another
+// world being stepped, and running here beats waiting for the workers.
+static struct Worker* enter () {
+    if (current != NULL) return current;
+    if (worker_count == 0 || pthread_mutex_trylock(&submit_lock) != 0) return NULL;
+    current = &workers[0];
+    return current;
+}
+
+static void leave (struct Worker* self) {
+    if (self != &workers[0] || self->depth > 0) return;
+    current = NULL;
+    pthread_mutex_unlock(&submit_lock);
+}
+
+void parallel_for (int count, int grain, job_fn fn, void* context) {
+    if (count <= 0) return;
+    if (grain < 1) grain = 1;
+
+    struct Worker* self = count > grain ? enter() : NULL;
+    if (self == NULL) {
+        fn(context, 0, count);
+        return;
+    }
+
+    struct JobBatch batch = {fn, context, grain, count, NULL, 0};
+    execute(self, (struct Task){&batch, 0, count});
+    help_until(self, &batch.remaining);
+    leave(self);
+}
+
+struct SumJob {
+    sum_fn fn;
+    void* context;
+    int count;
+    double* partials;
+};
+
+static void sum_chunks (void* context, int begin, int end) {
+    struct SumJob* job = context;
+    for (int chunk = begin; chunk < end; chunk++) {
+        int first = chunk * JOBS_SUM_CHUNK;
+        int last = first + JOBS_SUM_CHUNK < job->count ? first + JOBS_SUM_CHUNK : job->count;
+        job->partials[chunk] = job->fn(job->context, first, last);
+    }
+}
+
+double parallel_sum (int count, sum_fn fn, void* context) {
+    if (count <= 0) return 0.0;
+
+    int chunks = (count + JOBS_SUM_CHUNK - 1) / JOBS_SUM_CHUNK;
+    double* partials = malloc(chunks * sizeof(double));
+    if (partials == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(1);
+    }
+
+    struct SumJob job = {fn, context, count, partials};
+    parallel_for(chunks, 1, sum_chunks, &job);
+
+    double total = 0.0;
+    for (int chunk = 0; chunk < chunks; chunk++) {
+        total += partials[chunk];
+    }
+    free(partials);
+    return total;
+}
+
+void task_graph_init (struct TaskGraph* graph) {
+    graph->node_count = 0;
+    atomic_store(&graph->unfinished, 0);
+}
+
+int task_graph_add (struct TaskGraph* graph, job_fn fn, void* context, int count, int grain) {
+    if (graph->node_count == JOBS_MAX_NODES) {
+        fprintf(stderr, "Task graph has more than %d nodes\n", JOBS_MAX_NODES);
+        exit(1);
+    }
+
+    int node = graph->node_count++;
+    struct TaskNode* added = &graph->nodes[node];
+    added->batch.fn = fn;
+    added->batch.context = context;
+    added->batch.grain = grain < 1 ? 1 : grain;
+    atomic_store(&added->batch.remaining, 0);
+    added->batch.graph = graph;
+    added->batch.node = node;
+    added->count = count;
+    added->dependency_count = 0;
+    added->dependent_count = 0;
+    return node;
+}
+
+void task_graph_depend (struct TaskGraph* graph, int node, int on) {
+    struct TaskNode* before = &graph->nodes[on];
+    if (before->dependent_count == JOBS_MAX_DEPENDENTS) {
+        fprintf(stderr, "Task graph node has more than %d dependents\n", JOBS_MAX_DEPENDENTS);
+        exit(1);
+    }
+    before->dependents[before->dependent_count++] = node;
+    graph->nodes[node].dependency_count++;
+}
+
+void task_graph_set_count (struct TaskGraph* graph, int node, int count) {
+    graph->nodes[node].count = count;
+}
+
+// Without the pool the nodes run one after another, in the order they
+// become ready.
+static void run_graph_inline (struct TaskGraph* graph) {
+    int ready[JOBS_MAX_NODES];
+    int waiting[JOBS_MAX_NODES];
+    int head = 0;
+    int tail = 0;
+
+    for (int n = 0; n < graph->node_count; n++) {
+        waiting[n] = graph->nodes[n].dependency_count;
+        if (waiting[n] == 0) ready[tail++] = n;
+    }
+
+    while (head < tail) {
+        struct TaskNode* node = &graph->nodes[ready[head++]];
+        if (node->count > 0) node->batch.fn(node->batch.context, 0, node->count);
+        for (int k = 0; k < node->dependent_count; k++) {
+            int next = node->dependents[k];
+            if (--waiting[next] == 0) ready[tail++] = next;
+        }
+    }
+}
+
+void task_graph_run (struct TaskGraph* graph) {
+    if (graph->node_count == 0) return;
+
+    struct Worker* self = enter();
+    if (self == NULL) {
+        run_graph_inline(graph);
+        return;
+    }
+
+    atomic_store(&graph->unfinished, graph->node_count);
+    for (int n = 0; n < graph->node_count; n++) {
+        atomic_store(&graph->nodes[n].waiting, graph->nodes[n].dependency_count);
+    }
+    for (int n = 0; n < graph->node_count; n++) {
+        if (graph->nodes[n].dependency_count == 0) release_node(self, graph, n);
+    }
+
+    help_until(self, &graph->unfinished);
+    leave(self);
+}
+
+int jobs_worker_stats (struct JobsWorkerStats* stats) {
+    int count = worker_count + 1;
+    for (int w = 0; w < count; w++) {
+        struct Worker* worker = &workers[w];
+        stats[w].busy_seconds = atomic_load_explicit(&worker->busy_ns, memory_order_relaxed) * 1e-9;
+        stats[w].sleep_seconds = atomic_load_explicit(&worker->sleep_ns, memory_order_relaxed) * 1e-9;
+        stats[w].tasks = atomic_load_explicit(&worker->task_count, memory_order_relaxed);
+        stats[w].steals = atomic_load_explicit(&worker->steal_count, memory_order_relaxed);
+        stats[w].sleeps = atomic_load_explicit(&worker->sleep_count, memory_order_relaxed);
+    }
+    return count;
+}
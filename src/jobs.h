@@ -0,0 +1,90 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdatomic.h>
+
+#define JOBS_MAX_THREADS 64
+
+// parallel_sum always cuts its range into chunks of this size, however many
+// threads there are, so the result is the same on every machine.
+#define JOBS_SUM_CHUNK 4096
+
+// Tasks a thread can have queued before it stops splitting its ranges.
+#define JOBS_DEQUE_SIZE 1024
+#define JOBS_SPLIT_DEPTH 4
+
+// Rounds an idle worker spends looking for work before it sleeps.
+#define JOBS_SPIN 256
+
+#define JOBS_MAX_NODES 32
+#define JOBS_MAX_DEPENDENTS 8
+
+// Called with a half-open index range [begin, end).
+typedef void (*job_fn) (void* context, int begin, int end);
+typedef double (*sum_fn) (void* context, int begin, int end);
+
+// Starts a persistent pool; thread_count 0 means one thread per core. The
+// calling thread counts as one of them.
+void jobs_init (int thread_count);
+void jobs_shutdown ();
+int jobs_thread_count ();
+
+// Runs fn over [0, count) across the pool, returning once all of it is done.
+// Ranges are split in half only while the running thread has few tasks
+// queued, so idle threads steal big halves and busy ones run whole chunks of
+// grain. Calls made from inside a job join the same pool; calls from another
+// thread while one thread's work holds the pool run inline.
+void parallel_for (int count, int grain, job_fn fn, void* context);
+
+// Sums fn over fixed chunks in parallel, then adds the partial sums in chunk
+// order, so rounding does not depend on the thread count.
+double parallel_sum (int count, sum_fn fn, void* context);
+
+// A task graph: nodes are parallel_for ranges, and a node starts once every
+// node it depends on has finished. Build it once, run it as often as needed.
+struct JobBatch {
+    job_fn fn;
+    void* context;
+    int grain;
+    atomic_int remaining;
+    struct TaskGraph* graph;
+    int node;
+};
+
+struct TaskNode {
+    struct JobBatch batch;
+    int count;
+    int dependency_count;
+    atomic_int waiting;
+    int dependents[JOBS_MAX_DEPENDENTS];
+    int dependent_count;
+};
+
+struct TaskGraph {
+    struct TaskNode nodes[JOBS_MAX_NODES];
+    int node_count;
+    atomic_int unfinished;
+};
+
+void task_graph_init (struct TaskGraph* graph);
+// Returns the new node's index. A node of count 1 is a single task.
+int task_graph_add (struct TaskGraph* graph, job_fn fn, void* context, int count, int grain);
+void task_graph_depend (struct TaskGraph* graph, int node, int on);
+// Changes a node's count. While the graph runs, only a node this one depends
+// on may call it, to size work it has just found.
+void task_graph_set_count (struct TaskGraph* graph, int node, int count);
+void task_graph_run (struct TaskGraph* graph);
+
+// Per thread, the calling thread first, since jobs_init.
+struct JobsWorkerStats {
+    double busy_seconds;
+    double sleep_seconds;
+    long tasks;
+    long steals;
+    long sleeps;
+};
+
+// Fills one entry per thread and returns how many.
+int jobs_worker_stats (struct JobsWorkerStats* stats);
+
+#endif
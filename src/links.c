@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "links.h"
+#include "jobs.h"
+
+#define LINK_GRAIN 512
+
+struct LinkPass {
+    struct Links* links;
+    struct Balls* balls;
+    int batch_begin;
+    float dt;
+};
+
+void links_add (struct Links* links, int a, int b, float rest_length, float compliance) {
+    if (links->count == links->capacity) {
+        links->capacity = links->capacity > 0 ? links->capacity * 2 : 256;
+        links->links = realloc(links->links, links->capacity * sizeof(struct Link));
+        links->lambda = realloc(links->lambda, links->capacity * sizeof(float));
+        if (links->links == NULL || links->lambda == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(1);
+        }
+    }
+
+    struct Link link = {a, b, rest_length, compliance};
+    links->links[links->count++] = link;
+    links->coloured = 0;
+}
+
+void links_remove_ball (struct Links* links, int ball, int moved) {
+    int kept = 0;
+    for (int k = 0; k < links->count; k++) {
+        struct Link link = links->links[k];
+        if (link.a == ball || link.b == ball) continue;
+        if (link.a == moved) link.a = ball;
+        if (link.b == moved) link.b = ball;
+        links->links[kept++] = link;
+    }
+    links->count = kept;
+    links->coloured = 0;
+}
+
+void links_free (struct Links* links) {
+    free(links->links);
+    free(links->lambda);
+    free(links->ball_colours);
+}
+
+// Greedy colouring: each link takes the lowest colour neither of its balls
+// has used yet, then links are counting-sorted into one batch per colour.
+static void colour_links (struct Links* links, int count) {
+    if (count > links->ball_capacity) {
+        links->ball_capacity = count;
+        links->ball_colours = realloc(links->ball_colours, count * sizeof(uint64_t));
+        if (links->ball_colours == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(1);
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        links->ball_colours[i] = 0;
+    }
+
+    int* colours = malloc(links->count * sizeof(int));
+    // Sized to the capacity, not the count, since links_add appends in place.
+    struct Link* sorted = malloc(links->capacity * sizeof(struct Link));
+    if ((colours == NULL || sorted == NULL) && links->count > 0) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(1);
+    }
+
+    int histogram[LINK_MAX_COLOURS + 1] = {0};
+    links->batch_count = 0;
+
+    for (int k = 0; k < links->count; k++) {
+        struct Link* link = &links->links[k];
+        uint64_t used = links->ball_colours[link->a] | links->ball_colours[link->b];
+
+        int colour = 0;
+        while (colour < LINK_MAX_COLOURS && (used >> colour) & 1) colour++;
+        if (colour == LINK_MAX_COLOURS) {
+            fprintf(stderr, "A ball has more than %d links\n", LINK_MAX_COLOURS);
+            exit(1);
+        }
+
+        links->ball_colours[link->a] |= (uint64_t)1 << colour;
+        links->ball_colours[link->b] |= (uint64_t)1 << colour;
+        colours[k] = colour;
+        histogram[colour + 1]++;
+        if (colour + 1 > links->batch_count) links->batch_count = colour + 1;
+    }
+
+    for (int c = 0; c < LINK_MAX_COLOURS; c++) {
+        histogram[c + 1] += histogram[c];
+    }
+    for (int c = 0; c <= links->batch_count; c++) {
+        links->batch_start[c] = histogram[c];
+    }
+    for (int k = 0; k < links->count; k++) {
+        sorted[histogram[colours[k]]++] = links->links[k];
+    }
+
+    free(links->links);
+    links->links = sorted;
+    free(colours);
+    links->coloured = 1;
+}
+
+static void project_links (void* context, int begin, int end) {
+    struct LinkPass* pass = context;
+    struct Links* links = pass->links;
+    struct Balls* balls = pass->balls;
+
+    for (int k = pass->batch_begin + begin; k < pass->batch_begin + end; k++) {
+        struct Link* link = &links->links[k];
+        int a = link->a;
+        int b = link->b;
+
+        float dx = balls->x_pos[b] - balls->x_pos[a];
+        float dy = balls->y_pos[b] - balls->y_pos[a];
+        float length = sqrtf(dx * dx + dy * dy);
+        if (length == 0.0f) continue;
+
+        float w_a = 1.0f / balls->mass[a];
+        float w_b = 1.0f / balls->mass[b];
+        float alpha = link->compliance / (pass->dt * pass->dt);
+
+        float constraint = length - link->rest_length;
+        float delta_lambda = (-constraint - alpha * links->lambda[k]) / (w_a + w_b + alpha);
+        links->lambda[k] += delta_lambda;
+
+        float nx = dx / length;
+        float ny = dy / length;
+        float correction_a = -delta_lambda * w_a;
+        float correction_b = delta_lambda * w_b;
+
+        // Position changes show up in the velocity too, as they would if
+        // positions were integrated from scratch (dx / dt).
+        balls->x_pos[a] += correction_a * nx;
+        balls->y_pos[a] += correction_a * ny;
+        balls->x_pos[b] += correction_b * nx;
+        balls->y_pos[b] += correction_b * ny;
+        balls->x_vel[a] += correction_a * nx / pass->dt;
+        balls->y_vel[a] += correction_a * ny / pass->dt;
+        balls->x_vel[b] += correction_b * nx / pass->dt;
+        balls->y_vel[b] += correction_b * ny / pass->dt;
+    }
+}
+
+void links_solve (struct Links* links, struct Balls* balls, int count, float dt) {
+    if (links->count == 0) return;
+    if (!links->coloured) colour_links(links, count);
+
+    for (int k = 0; k < links->count; k++) {
+        links->lambda[k] = 0.0f;
+    }
+
+    struct LinkPass pass = {links, balls, 0, dt};
+    for (int iteration = 0; iteration < LINK_ITERATIONS; iteration++) {
+        for (int batch = 0; batch < links->batch_count; batch++) {
+            pass.batch_begin = links->batch_start[batch];
+            parallel_for(links->batch_start[batch + 1] - pass.batch_begin, LINK_GRAIN, project_links, &pass);
+        }
+    }
+}
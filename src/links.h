@@ -0,0 +1,49 @@
+#ifndef LINKS_H
+#define LINKS_H
+
+#include <stdint.h>
+
+#include "balls.h"
+
+#define LINK_ITERATIONS 4
+#define LINK_MAX_COLOURS 64
+
+// Compliance is inverse stiffness: 0 makes a rigid distance link, larger
+// values give softer springs (XPBD, so softness does not depend on the
+// iteration count).
+#define LINK_RIGID 0.0f
+#define LINK_SPRING 0.0001f
+
+struct Link {
+    int a, b;
+    float rest_length;
+    float compliance;
+};
+
+// Links are kept sorted by colour: no two links of one colour share a ball,
+// so each colour batch can be projected in parallel without atomics.
+struct Links {
+    struct Link* links;
+    float* lambda;
+    int count;
+    int capacity;
+
+    int batch_start[LINK_MAX_COLOURS + 1];
+    int batch_count;
+    int coloured;
+
+    uint64_t* ball_colours;
+    int ball_capacity;
+};
+
+void links_add (struct Links* links, int a, int b, float rest_length, float compliance);
+// Drops every link of ball and renames ball moved to ball, for when moved
+// is shifted into the slot of a removed ball.
+void links_remove_ball (struct Links* links, int ball, int moved);
+void links_free (struct Links* links);
+
+// Projects every link LINK_ITERATIONS times over a substep of dt frames and
+// folds the corrections into the velocities.
+void links_solve (struct Links* links, struct Balls* balls, int count, float dt);
+
+#endif
@@ -1,34 +1,97 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "vendors/glad/glad.h"
 #include "vendors/GLFW/glfw3.h"
 
+#include "domain.h"
+#include "ensemble.h"
+#include "events.h"
+#include "jobs.h"
+#include "pipeline.h"
+#include "playback.h"
+#include "recorder.h"
+#include "rewind.h"
+#include "server.h"
+#include "shm_export.h"
+#include "snapshot.h"
+#include "stream.h"
+#include "world.h"
+
 #define GL_SILENCE_DEPRECATION
 
 #define WINDOW_WIDTH 800
 #define WINDOW_HEIGHT 800
 #define NUM_CIRCLE_SEGMENTS 100
-#define MAX_OBJECTS 1000
+#define MAX_OBJECTS 131072
+#define INSTANCE_GRAIN 8192
+#define MAX_PENDING_EVENTS 64
 
 float current_radius = 0.01f;
 
-const float gravity = -0.0005f;
-const float bounce_restitution = 0.75f;
-
 GLuint vertex_shader;
 GLuint fragment_shader;
 GLuint outline_fragment_shader;
 
-int amount_balls = 0;
+struct World* world;
+
+struct SnapshotWriter snapshot_writer;
+const char* snapshot_path = "checkpoint.snap";
+int checkpoint_interval = 0;
+
+struct Recorder recorder;
+
+struct Rewind history;
+size_t rewind_budget = REWIND_DEFAULT_BUDGET;
+long rewind_target = -1;
+
+// --record-input logs every input; --replay feeds a log back in place of the
+// mouse and keyboard until it runs out.
+struct EventLog input_log;
+int logging_input = 0;
+struct SimEvent* replay_events = NULL;
+int replay_count = 0;
+int replay_next = 0;
+int replaying = 0;
+
+// --shm keeps the balls in a shared-memory segment other processes can map.
+struct ShmExport shm_export;
+int exporting = 0;
+
+// --stream sends frames to remote viewers; --view makes this a viewer that
+// draws a stream instead of simulating.
+struct StreamServer stream_server;
+int streaming = 0;
+struct StreamViewer stream_viewer;
+int viewing = 0;
+
+// Playback mode shows a recorded trajectory instead of simulating.
+// playback_position counts frames and moves by playback_speed each tick.
+int playback_mode = 0;
+struct Playback playback;
+double playback_position = 0.0;
+double playback_speed = 1.0;
+int playback_paused = 0;
+int scrubbing = 0;
+
+// Frames go from physics to the screen through the pipeline. With
+// --pipeline N a physics thread steps up to N frames ahead of the one being
+// drawn, and inputs wait in pending_events until it takes them at the start
+// of its next frame.
+struct Pipeline pipeline;
+int pipeline_depth = 0;
+pthread_t physics_thread;
+pthread_mutex_t input_lock = PTHREAD_MUTEX_INITIALIZER;
+struct SimEvent pending_events[MAX_PENDING_EVENTS];
+int pending_count = 0;
+int pending_rewinds = 0;
+int pending_save = 0;
 
-struct Ball {
-    float radius;
-    float x_pos, y_pos;
-    float x_vel, y_vel;
-    float mass;
-} balls[MAX_OBJECTS];
+int headless = 0;
 
 double mouse_x = 0.0, mouse_y = 0.0;
 
@@ -53,19 +116,142 @@ void scroll_callback (GLFWwindow* window, double xoffset, double yoffset) {
     if (current_radius > 0.25f) current_radius = 0.25f;
 }
 
-void add_ball (float x_pos, float y_pos, float radius) {
-    struct Ball new_ball = {radius, x_pos, y_pos, 0.0f, 0.0f, M_PI * radius * radius * radius};
-    balls[amount_balls] = new_ball;
-    amount_balls++;
+// Applies an input to the world now and remembers it, so rewinding past it
+// and stepping forward again, or replaying the input log, brings it back at
+// the same frame.
+void dispatch_event (const struct SimEvent* event) {
+    if (exporting) shm_export_begin(&shm_export);
+    world_apply_event(world, event);
+    if (exporting) shm_export_end(&shm_export, world->count, world->stats.frame);
+    if (rewind_budget > 0) rewind_record_event(&history, event);
+    if (logging_input) event_log_write(&input_log, event);
+}
+
+void apply_input (struct SimEvent* event) {
+    // The log being replayed is in control until it runs out.
+    if (replaying) return;
+    event->frame = world->stats.frame;
+    dispatch_event(event);
+}
+
+void submit_event (int type, float x_pos, float y_pos) {
+    struct SimEvent event = {0, type, 0, x_pos, y_pos, current_radius};
+    if (pipeline_depth == 0) {
+        apply_input(&event);
+        return;
+    }
+
+    pthread_mutex_lock(&input_lock);
+    if (pending_count < MAX_PENDING_EVENTS) pending_events[pending_count++] = event;
+    pthread_mutex_unlock(&input_lock);
+}
+
+// Goes back one keyframe interval from the frame shown, or from the one a
+// rewind is already headed for.
+void request_rewind () {
+    if (rewind_budget == 0 || replaying) return;
+    long from = rewind_target >= 0 ? rewind_target : world->stats.frame;
+    rewind_target = from - REWIND_INTERVAL;
+    if (rewind_target < rewind_oldest(&history)) rewind_target = rewind_oldest(&history);
+}
+
+void save_snapshot () {
+    if (snapshot_request(&snapshot_writer, snapshot_path, &world->balls, world->count, &world->links, &world->contact_cache, world->rope_end, world->broadphase.strategy, world->stats.frame)) {
+        printf("Saving frame %ld to %s\n", world->stats.frame, snapshot_path);
+    }
+}
+
+// Physics thread: applies what the inputs asked for since its last frame.
+void apply_pending_inputs () {
+    struct SimEvent events[MAX_PENDING_EVENTS];
+    pthread_mutex_lock(&input_lock);
+    int count = pending_count;
+    int rewinds = pending_rewinds;
+    int save = pending_save;
+    memcpy(events, pending_events, count * sizeof(struct SimEvent));
+    pending_count = 0;
+    pending_rewinds = 0;
+    pending_save = 0;
+    pthread_mutex_unlock(&input_lock);
+
+    for (int e = 0; e < count; e++) {
+        apply_input(&events[e]);
+    }
+    for (int r = 0; r < rewinds; r++) {
+        request_rewind();
+    }
+    if (save) save_snapshot();
 }
 
 void mouse_button_callback (GLFWwindow* window, int button, int action, int mods) {
+    if (viewing) return;
+
+    // Dragging with the left button held scrubs through the recording.
+    if (playback_mode) {
+        if (button == GLFW_MOUSE_BUTTON_LEFT) scrubbing = action == GLFW_PRESS;
+        return;
+    }
+
+    float x_pos = (mouse_x / WINDOW_WIDTH) * 2.0 - 1.0;
+    float y_pos = 1.0 - (mouse_y / WINDOW_HEIGHT) * 2.0;
+
     if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+        submit_event(world->fluid ? EVENT_ADD_FLUID : EVENT_ADD_BALL, x_pos, y_pos);
+    }
+
+    // Right click extends the rope, shift + right click starts a new one.
+    if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS && !world->fluid) {
+        submit_event(mods & GLFW_MOD_SHIFT ? EVENT_START_ROPE : EVENT_EXTEND_ROPE, x_pos, y_pos);
+    }
+}
+
+// Space pauses, the arrow keys step a frame or change the speed, Home and
+// End jump to either end.
+void playback_key (int key) {
+    long last = playback.frame_count - 1;
+    if (key == GLFW_KEY_SPACE) {
+        playback_paused = !playback_paused;
+        if (!playback_paused && playback_position >= last) playback_position = 0.0;
+    } else if (key == GLFW_KEY_RIGHT || key == GLFW_KEY_LEFT) {
+        playback_paused = 1;
+        playback_position = floor(playback_position) + (key == GLFW_KEY_RIGHT ? 1 : -1);
+    } else if (key == GLFW_KEY_UP && playback_speed < 64.0) {
+        playback_speed *= 2.0;
+    } else if (key == GLFW_KEY_DOWN && playback_speed > 0.125) {
+        playback_speed *= 0.5;
+    } else if (key == GLFW_KEY_HOME) {
+        playback_position = 0.0;
+    } else if (key == GLFW_KEY_END) {
+        playback_position = last;
+    }
+}
+
+void key_callback (GLFWwindow* window, int key, int scancode, int action, int mods) {
+    if (viewing) return;
+    if (playback_mode) {
+        if (action == GLFW_PRESS || action == GLFW_REPEAT) playback_key(key);
+        return;
+    }
+
+    if (key == GLFW_KEY_B && action == GLFW_PRESS && !world->fluid) {
         float x_pos = (mouse_x / WINDOW_WIDTH) * 2.0 - 1.0;
         float y_pos = 1.0 - (mouse_y / WINDOW_HEIGHT) * 2.0;
+        submit_event(EVENT_ADD_SOFT_BODY, x_pos, y_pos);
+    }
 
-        add_ball(x_pos, y_pos, current_radius);
+    // Backspace goes back one keyframe interval, and keeps going while held.
+    int rewind = key == GLFW_KEY_BACKSPACE && (action == GLFW_PRESS || action == GLFW_REPEAT);
+    int save = key == GLFW_KEY_S && action == GLFW_PRESS;
+    if (pipeline_depth == 0) {
+        if (rewind) request_rewind();
+        if (save) save_snapshot();
+        return;
     }
+
+    pthread_mutex_lock(&input_lock);
+    pending_rewinds += rewind;
+    pending_save |= save;
+    pthread_mutex_unlock(&input_lock);
 }
 
 void cursor_position_callback (GLFWwindow* window, double xpos, double ypos) {
@@ -73,89 +259,363 @@ void cursor_position_callback (GLFWwindow* window, double xpos, double ypos) {
     mouse_y = ypos;
 }
 
-void update_ball (struct Ball* ball) {
-    ball->y_vel += gravity;
-    ball->x_pos += ball->x_vel;
-    ball->y_pos += ball->y_vel;
+double seconds_now () {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Goes back to frame: loads the keyframe before it and steps forward
+// through the recorded events. Inputs after frame are forgotten, so the
+// next click starts a new timeline.
+void rewind_to (long frame) {
+    double start = seconds_now();
+    int broadphase;
+    long keyframe = rewind_load(&history, frame, &world->balls, &world->count, &world->links, &world->contact_cache, &world->rope_end, &broadphase);
+    if (keyframe < 0) return;
+    broadphase_resume(&world->broadphase, broadphase);
+    world_renumber(world);
+
+    world->stats.frame = keyframe;
+    while (world->stats.frame < frame) {
+        int event_count;
+        const struct SimEvent* events = rewind_events(&history, world->stats.frame, &event_count);
+        for (int n = 0; n < event_count; n++) {
+            world_apply_event(world, &events[n]);
+        }
+        world_step(world, 1);
+    }
+
+    world->stats.restore_ms = (seconds_now() - start) * 1000.0;
+    printf("Rewound to frame %ld in %.2f ms (%ld frames re-simulated)\n", frame, world->stats.restore_ms, frame - keyframe);
+}
+
+// Applies the logged events up to the current frame. A logged rewind stops
+// there, as it took the place of the next step when it happened. Returns 0
+// once the log is used up.
+int feed_replay () {
+    while (replay_next < replay_count && replay_events[replay_next].frame <= world->stats.frame) {
+        const struct SimEvent* event = &replay_events[replay_next++];
+        if (event->type == EVENT_END) {
+            replay_next = replay_count;
+            break;
+        }
+        if (event->type == EVENT_REWIND) {
+            rewind_target = event->frame - event->value;
+            return 1;
+        }
+        dispatch_event(event);
+    }
+    return replay_next < replay_count;
+}
+
+void finish_replay () {
+    replaying = 0;
+    printf("Replay finished at frame %ld: %d balls, hash %016llx\n",
+           world->stats.frame, world->count, (unsigned long long)balls_hash(&world->balls, world->count));
 }
 
-void apply_constraints (struct Ball* ball) {
-    float bottom_limit = -1.0f + ball->radius;
-    if (ball->y_pos < bottom_limit) {
-        ball->y_pos = bottom_limit;
-        ball->y_vel = -ball->y_vel * bounce_restitution;
+// Prints how busy each thread of the job pool was since the last call.
+void print_worker_stats () {
+    static struct JobsWorkerStats last[JOBS_MAX_THREADS];
+    static double last_time = 0.0;
+
+    struct JobsWorkerStats current[JOBS_MAX_THREADS];
+    int count = jobs_worker_stats(current);
+    double now = seconds_now();
+    if (count > 1 && last_time > 0.0) {
+        long steals = 0;
+        long sleeps = 0;
+        printf("  workers busy");
+        for (int w = 0; w < count; w++) {
+            printf(" %.0f%%", 100.0 * (current[w].busy_seconds - last[w].busy_seconds) / (now - last_time));
+            steals += current[w].steals - last[w].steals;
+            sleeps += current[w].sleeps - last[w].sleeps;
+        }
+        printf(", %ld steals, %ld sleeps\n", steals, sleeps);
     }
+    memcpy(last, current, sizeof(current));
+    last_time = now;
+}
 
-    float top_limit = 1.0f - ball->radius;
-    if (ball->y_pos > top_limit) {
-        ball->y_pos = top_limit;
-        ball->y_vel = -ball->y_vel * bounce_restitution;
+// One frame of simulation and its bookkeeping, shared by the window and
+// headless replay.
+void simulate_frame () {
+    if (exporting) shm_export_begin(&shm_export);
+
+    // A rewind shows the frame it lands on instead of stepping.
+    if (rewind_target >= 0) {
+        if (logging_input) {
+            struct SimEvent event = {world->stats.frame, EVENT_REWIND, (int32_t)(world->stats.frame - rewind_target), 0.0f, 0.0f, 0.0f};
+            event_log_write(&input_log, &event);
+        }
+        rewind_to(rewind_target);
+        rewind_target = -1;
+    } else {
+        world_step(world, 1);
     }
+    if (exporting) shm_export_end(&shm_export, world->count, world->stats.frame);
+    if (rewind_budget > 0) {
+        rewind_capture(&history, world->stats.frame, &world->balls, world->count, &world->links, &world->contact_cache, world->rope_end, world->broadphase.strategy);
+        world->stats.rewind_bytes = history.used;
+        world->stats.rewind_frames = world->stats.frame - rewind_oldest(&history);
+    }
+    if (world->stats.recording) {
+        recorder_capture(&recorder, &world->balls, world->count, world->stats.frame);
+        recorder_counters(&recorder, &world->stats.recorder);
+    }
+    if (world->stats.frame % STATS_INTERVAL == 0) world->stats.kinetic_energy = world_kinetic_energy(world);
+    if (world->stats.frame % STATS_INTERVAL == 0) {
+        stats_print(&world->stats);
+        print_worker_stats();
+    }
+    if (checkpoint_interval > 0 && world->stats.frame % checkpoint_interval == 0) {
+        snapshot_request(&snapshot_writer, snapshot_path, &world->balls, world->count, &world->links, &world->contact_cache, world->rope_end, world->broadphase.strategy, world->stats.frame);
+    }
+    if (streaming) stream_server_publish(&stream_server, &world->balls, world->count, world->stats.frame);
+}
 
-    float left_limit = -1.0f + ball->radius;
-    if (ball->x_pos < bottom_limit) {
-        ball->x_pos = bottom_limit;
-        ball->x_vel = -ball->x_vel * bounce_restitution;
+// Closes the input log with the frame the session ended on, and the hash a
+// replay of it should end on.
+void shutdown_simulation () {
+    if (logging_input) {
+        event_log_close(&input_log, world->stats.frame);
+        printf("Input log: %ld events up to frame %ld, hash %016llx\n", input_log.event_count, world->stats.frame,
+               (unsigned long long)balls_hash(&world->balls, world->count));
     }
+    free(replay_events);
+    if (playback_mode) playback_close(&playback);
+    if (rewind_budget > 0) rewind_free(&history);
+    if (world->stats.recording) recorder_close(&recorder);
+    snapshot_writer_stop(&snapshot_writer);
+    if (exporting) shm_export_close(&shm_export);
+    if (streaming) {
+        printf("Stream: %ld frames sent, %ld dropped, %.1f MB\n", stream_server.frames_sent, stream_server.frames_dropped,
+               stream_server.bytes_sent / 1e6);
+        stream_server_close(&stream_server);
+    }
+    if (viewing) stream_viewer_close(&stream_viewer);
+    world_destroy(world);
+    jobs_shutdown();
+}
+
+// Vertex generation: x, y and radius per ball, interleaved for the instance
+// buffer, filled in parallel.
+struct InstanceFill {
+    const float* x_pos;
+    const float* y_pos;
+    const float* radius;
+    GLfloat* instances;
+};
 
-    float right_limit = 1.0f - ball->radius;
-    if (ball->x_pos > top_limit) {
-        ball->x_pos = top_limit;
-        ball->x_vel = -ball->x_vel * bounce_restitution;
+void fill_instances (void* context, int begin, int end) {
+    const struct InstanceFill* fill = context;
+    for (int i = begin; i < end; i++) {
+        fill->instances[i * 3] = fill->x_pos[i];
+        fill->instances[i * 3 + 1] = fill->y_pos[i];
+        fill->instances[i * 3 + 2] = fill->radius[i];
     }
 }
-void handle_collisions () {
-    for (int i = 0; i < amount_balls; i++) {
-        for (int j = i + 1; j < amount_balls; j++) {
-            float dx = balls[j].x_pos - balls[i].x_pos;
-            float dy = balls[j].y_pos - balls[i].y_pos;
-            float distance_squared = dx * dx + dy * dy;
-            float radius_sum = balls[i].radius + balls[j].radius;
 
-            if (distance_squared <= (radius_sum * radius_sum)) {
-                float distance = sqrt(distance_squared);
+void write_instances (GLfloat* instances, const float* x_pos, const float* y_pos, const float* radius, int count) {
+    struct InstanceFill fill = {x_pos, y_pos, radius, instances};
+    parallel_for(count, INSTANCE_GRAIN, fill_instances, &fill);
+}
 
-                if (distance == 0.0f) {
-                    distance = 0.1f;
-                }
+// Steps one frame into slot. Returns 0 instead when a headless replay has
+// run out.
+int step_into (struct PipelineSlot* slot) {
+    if (pipeline_depth > 0) apply_pending_inputs();
+    if (replaying && !feed_replay()) {
+        finish_replay();
+        if (headless) return 0;
+    }
+    simulate_frame();
 
-                float overlap = radius_sum - distance;
-                float nx = dx / distance;
-                float ny = dy / distance;
-                float displacement_i = overlap * (balls[j].radius / radius_sum);
-                float displacement_j = overlap * (balls[i].radius / radius_sum);
-                balls[i].x_pos -= nx * displacement_i;
-                balls[i].y_pos -= ny * displacement_i;
-                balls[j].x_pos += nx * displacement_j;
-                balls[j].y_pos += ny * displacement_j;
+    write_instances(slot->instances, world->balls.x_pos, world->balls.y_pos, world->balls.radius, world->count);
+    slot->count = world->count;
+    slot->frame = world->stats.frame;
+    return 1;
+}
 
-                float nx_total = nx * (balls[i].x_vel - balls[j].x_vel) + ny * (balls[i].y_vel - balls[j].y_vel);
-                float p = 2.0f * nx_total / (balls[i].mass + balls[j].mass);
+void* physics_main (void* arg) {
+    (void)arg;
+    struct PipelineSlot* slot;
+    while ((slot = pipeline_begin_frame(&pipeline)) != NULL) {
+        if (!step_into(slot)) {
+            pipeline_stop(&pipeline);
+            break;
+        }
+        pipeline_end_frame(&pipeline, slot);
+    }
+    return NULL;
+}
 
-                balls[i].x_vel -= p * balls[j].mass * nx;
-                balls[i].y_vel -= p * balls[j].mass * ny;
-                balls[j].x_vel += p * balls[i].mass * nx;
-                balls[j].y_vel += p * balls[i].mass * ny;
-            }
+// The next frame to show, stepped here unless a physics thread is ahead.
+// Returns NULL once the pipeline has stopped.
+struct PipelineSlot* next_frame () {
+    if (pipeline_depth == 0) {
+        struct PipelineSlot* slot = pipeline_begin_frame(&pipeline);
+        if (slot == NULL) return NULL;
+        if (!step_into(slot)) {
+            pipeline_stop(&pipeline);
+            return NULL;
         }
+        pipeline_end_frame(&pipeline, slot);
     }
+    return pipeline_take(&pipeline);
 }
 
-void draw_circle (GLfloat* vertices, GLuint VBO, GLuint VAO, GLuint shader_program) {
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, (NUM_CIRCLE_SEGMENTS + 2) * 3 * sizeof(GLfloat), vertices, GL_DYNAMIC_DRAW);
+void print_pipeline_stats () {
+    struct PipelineCounters counters;
+    pipeline_counters(&pipeline, &counters);
+    if (counters.frames == 0) return;
+
+    double frame_ms = counters.seconds * 1e3 / counters.frames;
+    double latency_ms = counters.latency_sum * 1e3 / counters.frames;
+    printf("  pipeline depth %d: %.1f fps, latency %.1f ms (max %.1f, %.1f frames), physics %.1f ms, waits physics %.1f ms render %.1f ms\n",
+           pipeline_depth, counters.frames / counters.seconds, latency_ms, counters.latency_max * 1e3, latency_ms / frame_ms,
+           counters.physics_seconds * 1e3 / counters.frames, counters.physics_wait * 1e3 / counters.frames,
+           counters.render_wait * 1e3 / counters.frames);
+}
+
+void start_pipeline () {
+    pipeline_init(&pipeline, pipeline_depth, MAX_OBJECTS);
+    if (pipeline_depth > 0 && pthread_create(&physics_thread, NULL, physics_main, NULL) != 0) {
+        fprintf(stderr, "Failed to start physics thread\n");
+        exit(1);
+    }
+}
+
+// Waits for the physics thread to finish its frame; world is this thread's
+// again afterwards.
+void stop_pipeline () {
+    pipeline_stop(&pipeline);
+    if (pipeline_depth > 0) pthread_join(physics_thread, NULL);
+    pipeline_free(&pipeline);
+}
+
+// Moves the playback position on and, when that lands on a new frame,
+// writes it straight into the mapped instance buffer. Returns the number of
+// balls to draw.
+int update_playback (GLFWwindow* window, GLuint instance_VBO) {
+    static long shown = -1;
+    static int shown_count = 0;
+    long last = playback.frame_count - 1;
+
+    if (scrubbing) {
+        playback_position = mouse_x / WINDOW_WIDTH * last;
+    } else if (!playback_paused) {
+        playback_position += playback_speed;
+    }
+    if (playback_position >= last) {
+        playback_position = last;
+        playback_paused = 1;
+    }
+    if (playback_position < 0.0) playback_position = 0.0;
+
+    long n = (long)playback_position;
+    if (n == shown || last < 0) return shown_count;
+
+    const float* fields[TRAJECTORY_FIELDS];
+    int count = playback_read(&playback, n, fields);
+    if (count < 0) {
+        fprintf(stderr, "Frame %ld of the recording is damaged\n", n);
+        playback_paused = 1;
+        return shown_count;
+    }
+
+    // Orphaning the old storage lets the driver hand back fresh memory
+    // instead of waiting for the previous frame's draw.
+    GLsizeiptr size = (GLsizeiptr)count * 3 * sizeof(GLfloat);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_VBO);
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+    GLfloat* instances = count > 0 ? glMapBufferRange(GL_ARRAY_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT) : NULL;
+    if (instances != NULL) {
+        write_instances(instances, fields[TRAJECTORY_X_POS], fields[TRAJECTORY_Y_POS], fields[TRAJECTORY_RADIUS], count);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+
+    char title[128];
+    snprintf(title, sizeof(title), "Particle Simulator - frame %lld (%ld/%ld) x%g%s", (long long)playback.index[n].frame,
+             n + 1, last + 1, playback_speed, playback_paused ? " paused" : "");
+    glfwSetWindowTitle(window, title);
+
+    shown = n;
+    shown_count = count;
+    return count;
+}
+
+// Draws the newest frame of the stream being viewed, written into the
+// instance buffer as playback does. Returns the number of balls to draw.
+int update_view (GLFWwindow* window, GLuint instance_VBO) {
+    int status = stream_viewer_poll(&stream_viewer);
+    if (status < 0) glfwSetWindowShouldClose(window, 1);
+    if (status <= 0) return stream_viewer.frame >= 0 ? stream_viewer.count : 0;
+
+    int count = stream_viewer.count;
+    GLsizeiptr size = (GLsizeiptr)count * 3 * sizeof(GLfloat);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_VBO);
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+    GLfloat* instances = count > 0 ? glMapBufferRange(GL_ARRAY_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT) : NULL;
+    if (instances != NULL) {
+        write_instances(instances, stream_viewer.fields[TRAJECTORY_X_POS], stream_viewer.fields[TRAJECTORY_Y_POS],
+                        stream_viewer.fields[TRAJECTORY_RADIUS], count);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+
+    char title[128];
+    snprintf(title, sizeof(title), "Particle Simulator - frame %ld, %d balls (live)", stream_viewer.frame, count);
+    glfwSetWindowTitle(window, title);
+    return count;
+}
+
+// Headless viewing: prints what arrives once a second until the stream ends.
+void watch_stream () {
+    double last_report = seconds_now();
+    long last_frames = 0;
+    uint64_t last_bytes = 0;
+    struct timespec pause = {0, 1000000};
+    for (;;) {
+        int status = stream_viewer_poll(&stream_viewer);
+        if (status < 0) break;
+        if (status == 0) nanosleep(&pause, NULL);
+
+        double now = seconds_now();
+        if (now - last_report >= 1.0) {
+            double elapsed = now - last_report;
+            printf("frame %ld: %d balls, %.1f fps, %.1f kB/s\n", stream_viewer.frame, stream_viewer.count,
+                   (stream_viewer.frames_received - last_frames) / elapsed,
+                   (stream_viewer.bytes_received - last_bytes) / elapsed / 1e3);
+            fflush(stdout);
+            last_report = now;
+            last_frames = stream_viewer.frames_received;
+            last_bytes = stream_viewer.bytes_received;
+        }
+    }
+    printf("Stream ended after %ld frames, %.1f MB\n", stream_viewer.frames_received, stream_viewer.bytes_received / 1e6);
+}
+
+// Draws the first count instances already in the instance buffer.
+void draw_instances (int count, GLuint VAO, GLuint shader_program) {
     glUseProgram(shader_program);
     glBindVertexArray(VAO);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, NUM_CIRCLE_SEGMENTS + 2);
+    glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, NUM_CIRCLE_SEGMENTS + 2, count);
 }
 
-void draw_outline (GLuint VBO, GLuint VAO, GLuint outline_shader_program) {
-    GLfloat outline_vertices[(NUM_CIRCLE_SEGMENTS + 2) * 3];
+// Draws count circles in one call; instances holds x, y and radius per circle.
+void draw_circles (const GLfloat* instances, int count, GLuint instance_VBO, GLuint VAO, GLuint shader_program) {
+    glBindBuffer(GL_ARRAY_BUFFER, instance_VBO);
+    glBufferData(GL_ARRAY_BUFFER, count * 3 * sizeof(GLfloat), instances, GL_STREAM_DRAW);
+    draw_instances(count, VAO, shader_program);
+}
+
+void draw_outline (GLuint instance_VBO, GLuint VAO, GLuint outline_shader_program) {
     double x_pos = (mouse_x / WINDOW_WIDTH) * 2.0 - 1.0;
     double y_pos = 1.0 - (mouse_y / WINDOW_HEIGHT) * 2.0;
     if (x_pos <= 1.0f && x_pos >= -1 && y_pos >= -1 && y_pos <= 1) {
-        build_circle(outline_vertices, x_pos, y_pos, current_radius);
-        draw_circle(outline_vertices, VBO, VAO, outline_shader_program);
+        GLfloat outline_instance[3] = {x_pos, y_pos, current_radius};
+        draw_circles(outline_instance, 1, instance_VBO, VAO, outline_shader_program);
         // add_ball(x_pos, y_pos, current_radius);
     }
 }
@@ -242,7 +702,275 @@ GLuint create_shader (const char* frag_path, const char* vert_path) {
     return shader_program;
 }
 
-int main () {
+int main (int argc, char** argv) {
+    struct WorldConfig config = {MAX_OBJECTS, 0, SOLVER_IMPULSE, 4};
+    int thread_count = 0;
+    int broadphase_mode = BROADPHASE_AUTO;
+    int fluid_count = 0;
+    int verify_steps = 0;
+    const char* restore_path = NULL;
+    const char* record_path = NULL;
+    const char* play_path = NULL;
+    const char* input_log_path = NULL;
+    const char* replay_path = NULL;
+    const char* shm_name = NULL;
+    const char* socket_path = NULL;
+    const char* view_address = NULL;
+    const char* sweep_path = NULL;
+    struct DomainConfig domain = {0, 600, 0, 1, NULL, 20000, {0}};
+    int stream_port = 0;
+    double stream_rate = STREAM_DEFAULT_RATE;
+    int record_codec = TRAJECTORY_CODEC_DELTA;
+    float record_precision = CODEC_DEFAULT_PRECISION;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--sph") == 0 && i + 1 < argc) {
+            config.fluid = 1;
+            fluid_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            thread_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--solver") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "pbd") == 0) {
+                config.solver = SOLVER_PBD;
+            } else if (strcmp(argv[i], "impulse") == 0) {
+                config.solver = SOLVER_IMPULSE;
+            } else {
+                fprintf(stderr, "Unknown solver %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            config.iterations = atoi(argv[++i]);
+            if (config.iterations < 1) config.iterations = 1;
+        } else if (strcmp(argv[i], "--broadphase") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "auto") == 0) {
+                broadphase_mode = BROADPHASE_AUTO;
+            } else if (strcmp(argv[i], "brute") == 0) {
+                broadphase_mode = BROADPHASE_BRUTE;
+            } else if (strcmp(argv[i], "grid") == 0) {
+                broadphase_mode = BROADPHASE_GRID;
+            } else if (strcmp(argv[i], "tree") == 0) {
+                broadphase_mode = BROADPHASE_TREE;
+            } else {
+                fprintf(stderr, "Unknown broadphase %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--verify-determinism") == 0 && i + 1 < argc) {
+            verify_steps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+            snapshot_path = argv[++i];
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            checkpoint_interval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc) {
+            restore_path = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (strcmp(argv[i], "--record-input") == 0 && i + 1 < argc) {
+            input_log_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+            shm_name = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+            stream_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--stream-rate") == 0 && i + 1 < argc) {
+            stream_rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--view") == 0 && i + 1 < argc) {
+            view_address = argv[++i];
+            viewing = 1;
+        } else if (strcmp(argv[i], "--sweep") == 0 && i + 1 < argc) {
+            sweep_path = argv[++i];
+        } else if (strcmp(argv[i], "--domain") == 0 && i + 1 < argc) {
+            domain.ranks = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--domain-balls") == 0 && i + 1 < argc) {
+            domain.seed_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--domain-frames") == 0 && i + 1 < argc) {
+            domain.frames = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--domain-balance") == 0 && i + 1 < argc) {
+            domain.balance_interval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+            pipeline_depth = atoi(argv[++i]);
+            if (pipeline_depth < 0) pipeline_depth = 0;
+            if (pipeline_depth > PIPELINE_MAX_DEPTH) pipeline_depth = PIPELINE_MAX_DEPTH;
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            headless = 1;
+        } else if (strcmp(argv[i], "--rewind-budget") == 0 && i + 1 < argc) {
+            rewind_budget = (size_t)atoi(argv[++i]) << 20;
+        } else if (strcmp(argv[i], "--play") == 0 && i + 1 < argc) {
+            play_path = argv[++i];
+            playback_mode = 1;
+        } else if (strcmp(argv[i], "--record-codec") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "delta") == 0) {
+                record_codec = TRAJECTORY_CODEC_DELTA;
+            } else if (strcmp(argv[i], "raw") == 0) {
+                record_codec = TRAJECTORY_CODEC_RAW;
+            } else {
+                fprintf(stderr, "Unknown codec %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--record-precision") == 0 && i + 1 < argc) {
+            record_precision = atof(argv[++i]);
+            if (record_precision < 0.0f) record_precision = 0.0f;
+        } else {
+            fprintf(stderr, "Usage: %s [--sph <particles>] [--threads <count>] [--solver impulse|pbd] [--iterations <count>]"
+                            " [--broadphase auto|brute|grid|tree] [--verify-determinism <frames>]"
+                            " [--snapshot <file>] [--checkpoint <frames>] [--restore <file>]"
+                            " [--record <file>] [--record-codec delta|raw] [--record-precision <step>] [--play <file>]"
+                            " [--rewind-budget <MB>] [--record-input <file>] [--replay <file> [--headless]] [--pipeline <depth>]"
+                            " [--stream <port>] [--stream-rate <fps>] [--view <host:port> [--headless]]"
+                            " [--sweep <spec>] [--domain <ranks> [--domain-balls <count>] [--domain-frames <frames>] [--domain-balance <frames>]]"
+                            " [--shm <name>] [--serve <socket>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (headless && replay_path == NULL && !viewing) {
+        fprintf(stderr, "--headless needs a log to --replay or a stream to --view\n");
+        return 1;
+    }
+
+    // The log decides everything the session's evolution depended on.
+    struct EventLogHeader scene;
+    if (replay_path != NULL) {
+        replay_events = event_log_load(replay_path, &scene, &replay_count);
+        if (replay_events == NULL) return 1;
+        config.fluid = scene.sph_mode;
+        fluid_count = scene.fluid_count;
+        config.solver = scene.solver_mode;
+        config.iterations = scene.solver_iterations;
+        rewind_budget = scene.rewind_budget;
+        if (restore_path == NULL && scene.restore_path[0] != '\0') restore_path = scene.restore_path;
+        replaying = 1;
+    }
+
+    // Sweeps run a world per thread and need no pool.
+    if (sweep_path != NULL) {
+        struct EnsembleSpec* spec = malloc(sizeof(struct EnsembleSpec));
+        if (spec == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            return 1;
+        }
+        int status = ensemble_parse(sweep_path, spec) ? ensemble_run(spec, thread_count) : 1;
+        free(spec);
+        return status;
+    }
+
+    // Split across processes: each rank runs its own pool, so the default
+    // is one thread per rank rather than one per core.
+    if (domain.ranks > 0) {
+        domain.threads = thread_count > 0 ? thread_count : 1;
+        domain.restore_path = restore_path;
+        domain.world = config;
+        return domain_run(&domain);
+    }
+
+    // Serving replaces the app: worlds belong to the clients.
+    if (socket_path != NULL) {
+        jobs_init(thread_count);
+        int status = server_run(socket_path, &config);
+        jobs_shutdown();
+        return status;
+    }
+
+    // Headless: no window is needed to compare runs.
+    if (verify_steps > 0) {
+        const char* name = config.fluid ? "fluid" : (config.solver == SOLVER_PBD ? "pbd" : "impulse");
+        int failures = world_check_determinism(name, &config, verify_steps, fluid_count);
+        printf(failures > 0 ? "Determinism check FAILED\n" : "Determinism check passed\n");
+        return failures > 0;
+    }
+
+    world = world_create(&config);
+    world->broadphase.mode = broadphase_mode;
+    world->broadphase.log = 1;
+
+    jobs_init(thread_count);
+    snapshot_writer_start(&snapshot_writer, MAX_OBJECTS);
+
+    if (restore_path != NULL) {
+        struct SnapshotHeader header;
+        if (!snapshot_restore(restore_path, MAX_OBJECTS, &world->balls, &world->links, &world->contact_cache, &header)) return 1;
+        world->count = header.count;
+        world->rope_end = header.rope_end;
+        world->stats.frame = header.frame;
+        broadphase_resume(&world->broadphase, header.broadphase);
+        world_renumber(world);
+    } else if (world->fluid) {
+        world_seed_fluid(world, fluid_count);
+    }
+
+    if (playback_mode && !playback_open(&playback, play_path)) return 1;
+    if (viewing && !stream_viewer_connect(&stream_viewer, view_address)) return 1;
+
+    // A viewer has no world of its own to save, share or stream.
+    if (viewing) {
+        rewind_budget = 0;
+        record_path = NULL;
+        input_log_path = NULL;
+        shm_name = NULL;
+        stream_port = 0;
+    }
+
+    if (shm_name != NULL && !playback_mode) {
+        if (!shm_export_open(&shm_export, shm_name, &world->balls, world->count, world->capacity)) return 1;
+        exporting = 1;
+    }
+
+    if (playback_mode) rewind_budget = 0;
+    if (stream_port > 0 && !playback_mode) {
+        if (!stream_server_open(&stream_server, stream_port, stream_rate, STREAM_DEFAULT_PRECISION, world->capacity)) return 1;
+        streaming = 1;
+    }
+    if (rewind_budget > 0) {
+        rewind_init(&history, rewind_budget);
+        rewind_capture(&history, world->stats.frame, &world->balls, world->count, &world->links, &world->contact_cache, world->rope_end, world->broadphase.strategy);
+    }
+
+    if (record_path != NULL && !playback_mode) {
+        if (!recorder_open(&recorder, record_path, MAX_OBJECTS, record_codec, record_precision)) return 1;
+        world->stats.recording = 1;
+    }
+
+    if (input_log_path != NULL && !playback_mode) {
+        memset(&scene, 0, sizeof(scene));
+        scene.sph_mode = world->fluid;
+        scene.fluid_count = fluid_count;
+        scene.solver_mode = world->solver;
+        scene.solver_iterations = world->iterations;
+        scene.rewind_budget = rewind_budget;
+        if (restore_path != NULL) snprintf(scene.restore_path, sizeof(scene.restore_path), "%s", restore_path);
+        if (!event_log_create(&input_log, input_log_path, &scene)) return 1;
+        logging_input = 1;
+    }
+
+    if (viewing && headless) {
+        watch_stream();
+        shutdown_simulation();
+        return 0;
+    }
+
+    // Runs the log as fast as it steps, which makes it a benchmark too.
+    if (headless) {
+        double start = seconds_now();
+        long frames = 0;
+        start_pipeline();
+        struct PipelineSlot* slot;
+        while ((slot = next_frame()) != NULL) {
+            pipeline_presented(&pipeline, slot);
+            if (++frames % STATS_INTERVAL == 0) print_pipeline_stats();
+        }
+        stop_pipeline();
+        double seconds = seconds_now() - start;
+        printf("Replayed %d events over %ld frames in %.3f s (%.3f ms/frame)\n",
+               replay_count, frames, seconds, frames > 0 ? seconds * 1000.0 / frames : 0.0);
+        shutdown_simulation();
+        return 0;
+    }
+
     if (!glfwInit()) {
         fprintf(stderr, "ERROR: Could not initialize GLFW.");
         return 1;
@@ -268,16 +996,27 @@ int main () {
 
     glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
 
-    GLuint VAO, VBO;
+    // One unit circle shared by every ball; each instance scales and moves it.
+    GLfloat circle_vertices[(NUM_CIRCLE_SEGMENTS + 2) * 3];
+    build_circle(circle_vertices, 0.0f, 0.0f, 1.0f);
+
+    GLuint VAO, VBO, instance_VBO;
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
+    glGenBuffers(1, &instance_VBO);
 
     glBindVertexArray(VAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(circle_vertices), circle_vertices, GL_STATIC_DRAW);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
+    glBindBuffer(GL_ARRAY_BUFFER, instance_VBO);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(1);
+
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 
@@ -287,30 +1026,45 @@ int main () {
     glfwSetScrollCallback(window, scroll_callback);
     glfwSetMouseButtonCallback(window, mouse_button_callback);
     glfwSetCursorPosCallback(window, cursor_position_callback);
+    glfwSetKeyCallback(window, key_callback);
+
+    if (!viewing && !playback_mode) start_pipeline();
+    long frames_shown = 0;
 
     while (!glfwWindowShouldClose(window)) {
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
-        draw_outline(VBO, VAO, outline_shader_program);
-
-        handle_collisions();
-
-        for (int i = 0; i < amount_balls; i++) {
-            GLfloat vertices[(NUM_CIRCLE_SEGMENTS + 2) * 3];
-            update_ball(&balls[i]);
-            build_circle(vertices, balls[i].x_pos, balls[i].y_pos, balls[i].radius);
-            draw_circle(vertices, VBO, VAO, shader_program);
+        if (viewing) {
+            draw_instances(update_view(window, instance_VBO), VAO, shader_program);
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+            continue;
         }
 
-        for (int i = 0; i < amount_balls; i++) {
-            apply_constraints(&balls[i]);
+        if (playback_mode) {
+            draw_instances(update_playback(window, instance_VBO), VAO, shader_program);
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+            continue;
         }
 
+        draw_outline(instance_VBO, VAO, outline_shader_program);
+
+        // Drawn while the physics thread, if there is one, steps the next.
+        struct PipelineSlot* slot = next_frame();
+        if (slot == NULL) break;
+        draw_circles(slot->instances, slot->count, instance_VBO, VAO, shader_program);
+
         glfwSwapBuffers(window);
+        pipeline_presented(&pipeline, slot);
+        if (++frames_shown % STATS_INTERVAL == 0) print_pipeline_stats();
         glfwPollEvents();
     }
 
+    if (!viewing && !playback_mode) stop_pipeline();
+    shutdown_simulation();
+
     glfwTerminate();
     return 0;
 }
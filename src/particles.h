@@ -0,0 +1,82 @@
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+// libparticles: the simulation core behind an opaque handle. Worlds share
+// nothing but the worker pool (see jobs_init in jobs.h; without it every
+// step runs on the calling thread), so any number can live in one process.
+#define SOLVER_IMPULSE 0
+#define SOLVER_PBD 1
+
+// Velocity gained per frame, and the fraction of speed kept bouncing off a
+// wall or another ball, until changed with world_set_gravity and
+// world_set_restitution.
+#define WORLD_DEFAULT_GRAVITY -0.0005f
+#define WORLD_DEFAULT_RESTITUTION 0.75f
+
+struct World;
+
+// Fields left at zero take the defaults: rigid balls and the impulse solver
+// with 4 iterations. Stepping is deterministic whatever the thread count.
+struct WorldConfig {
+    int capacity;
+    int fluid;
+    int solver;
+    int iterations;
+};
+
+// The world's own arrays, valid until the next add, remove or reserve.
+// Index i holds the particle with id ids[i]; writing positions or
+// velocities between steps moves the particles.
+struct WorldView {
+    int count;
+    float* x_pos;
+    float* y_pos;
+    float* x_vel;
+    float* y_vel;
+    const float* radius;
+    const int* ids;
+};
+
+// Pair, overlap and cache figures cover the last frame stepped.
+struct WorldStats {
+    long frame;
+    int count;
+    int capacity;
+    int links;
+    int pairs;
+    float max_overlap;
+    long cache_lookups;
+    long cache_hits;
+    int island_count;
+    int largest_island;
+    double kinetic_energy;
+    double step_ms;
+};
+
+struct World* world_create (const struct WorldConfig* config);
+void world_destroy (struct World* world);
+
+// Grows the world to hold at least capacity particles. Never shrinks.
+void world_reserve (struct World* world, int capacity);
+
+// Returns the new particle's id, or -1 if the world is full. Ids stay with
+// their particle until it is removed, and are then handed out again.
+int world_add (struct World* world, float x_pos, float y_pos, float x_vel, float y_vel, float radius);
+
+// Removes a particle and its links; the last particle moves into its slot.
+// Returns 0 if there is no particle with that id.
+int world_remove (struct World* world, int id);
+
+// Index of a particle in the view arrays, or -1 if the id is not in use.
+int world_index (const struct World* world, int id);
+
+// Take effect from the next step.
+void world_set_gravity (struct World* world, float gravity);
+void world_set_restitution (struct World* world, float restitution);
+
+void world_step (struct World* world, int steps);
+
+void world_view (struct World* world, struct WorldView* view);
+void world_stats (const struct World* world, struct WorldStats* stats);
+
+#endif
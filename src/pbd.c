@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "pbd.h"
+
+static float* alloc_field (int capacity) {
+    float* field = (float*)calloc(capacity, sizeof(float));
+    if (field == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(1);
+    }
+    return field;
+}
+
+void pbd_init (struct Pbd* pbd, int capacity) {
+    pbd->capacity = capacity;
+    pbd->x_prev = alloc_field(capacity);
+    pbd->y_prev = alloc_field(capacity);
+    pbd->x_vel_prev = alloc_field(capacity);
+    pbd->y_vel_prev = alloc_field(capacity);
+}
+
+void pbd_free (struct Pbd* pbd) {
+    free(pbd->x_prev);
+    free(pbd->y_prev);
+    free(pbd->x_vel_prev);
+    free(pbd->y_vel_prev);
+}
+
+void pbd_begin (struct Pbd* pbd, const struct Balls* balls, int count) {
+    for (int i = 0; i < count; i++) {
+        pbd->x_prev[i] = balls->x_pos[i];
+        pbd->y_prev[i] = balls->y_pos[i];
+        pbd->x_vel_prev[i] = balls->x_vel[i];
+        pbd->y_vel_prev[i] = balls->y_vel[i];
+    }
+}
+
+static inline float clamp_to_walls (float pos, float radius) {
+    if (pos < -1.0f + radius) return -1.0f + radius;
+    if (pos > 1.0f - radius) return 1.0f - radius;
+    return pos;
+}
+
+void pbd_project_contacts (struct Balls* balls, const struct Pair* pairs, int pair_count, int count, int iterations) {
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        for (int k = 0; k < pair_count; k++) {
+            int i = pairs[k].i;
+            int j = pairs[k].j;
+
+            float dx = balls->x_pos[j] - balls->x_pos[i];
+            float dy = balls->y_pos[j] - balls->y_pos[i];
+            float distance_squared = dx * dx + dy * dy;
+            float radius_sum = balls->radius[i] + balls->radius[j];
+            if (distance_squared >= radius_sum * radius_sum) continue;
+
+            float distance = sqrtf(distance_squared);
+            float nx = 1.0f, ny = 0.0f;
+            if (distance > 0.0f) {
+                nx = dx / distance;
+                ny = dy / distance;
+            }
+
+            float w_i = 1.0f / balls->mass[i];
+            float w_j = 1.0f / balls->mass[j];
+            float push = (radius_sum - distance) / (w_i + w_j);
+            balls->x_pos[i] -= nx * push * w_i;
+            balls->y_pos[i] -= ny * push * w_i;
+            balls->x_pos[j] += nx * push * w_j;
+            balls->y_pos[j] += ny * push * w_j;
+        }
+
+        // Walls are constraints like any other, or contacts would keep
+        // pushing balls through them between iterations.
+        for (int i = 0; i < count; i++) {
+            balls->x_pos[i] = clamp_to_walls(balls->x_pos[i], balls->radius[i]);
+            balls->y_pos[i] = clamp_to_walls(balls->y_pos[i], balls->radius[i]);
+        }
+    }
+}
+
+static inline float wall_bounce (float vel, float vel_prev, float pos, float radius, float threshold, float restitution) {
+    int at_low = pos <= -1.0f + radius && vel_prev < -threshold;
+    int at_high = pos >= 1.0f - radius && vel_prev > threshold;
+    return at_low || at_high ? -vel_prev * restitution : vel;
+}
+
+void pbd_end (struct Pbd* pbd, struct Balls* balls, int count, const struct Pair* pairs, int pair_count, float dt, float gravity, float restitution) {
+    float threshold = PBD_BOUNCE_THRESHOLD * fabsf(gravity) * dt;
+
+    for (int i = 0; i < count; i++) {
+        balls->x_vel[i] = (balls->x_pos[i] - pbd->x_prev[i]) / dt;
+        balls->y_vel[i] = (balls->y_pos[i] - pbd->y_prev[i]) / dt;
+    }
+
+    for (int k = 0; k < pair_count; k++) {
+        int i = pairs[k].i;
+        int j = pairs[k].j;
+
+        float dx = balls->x_pos[j] - balls->x_pos[i];
+        float dy = balls->y_pos[j] - balls->y_pos[i];
+        float distance_squared = dx * dx + dy * dy;
+        float radius_sum = (balls->radius[i] + balls->radius[j]) * PBD_CONTACT_MARGIN;
+        if (distance_squared > radius_sum * radius_sum || distance_squared == 0.0f) continue;
+
+        float distance = sqrtf(distance_squared);
+        float nx = dx / distance;
+        float ny = dy / distance;
+
+        // Approach speed now and before the solve; positive means closing.
+        float approach = nx * (balls->x_vel[i] - balls->x_vel[j]) + ny * (balls->y_vel[i] - balls->y_vel[j]);
+        float approach_prev = nx * (pbd->x_vel_prev[i] - pbd->x_vel_prev[j]) + ny * (pbd->y_vel_prev[i] - pbd->y_vel_prev[j]);
+        if (approach_prev < threshold) continue;
+
+        float w_i = 1.0f / balls->mass[i];
+        float w_j = 1.0f / balls->mass[j];
+        float impulse = (approach + restitution * approach_prev) / (w_i + w_j);
+        balls->x_vel[i] -= nx * impulse * w_i;
+        balls->y_vel[i] -= ny * impulse * w_i;
+        balls->x_vel[j] += nx * impulse * w_j;
+        balls->y_vel[j] += ny * impulse * w_j;
+    }
+
+    for (int i = 0; i < count; i++) {
+        float radius = balls->radius[i];
+        balls->x_vel[i] = wall_bounce(balls->x_vel[i], pbd->x_vel_prev[i], balls->x_pos[i], radius, threshold, restitution);
+        balls->y_vel[i] = wall_bounce(balls->y_vel[i], pbd->y_vel_prev[i], balls->y_pos[i], radius, threshold, restitution);
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef PBD_H
+#define PBD_H
+
+#include "balls.h"
+#include "broadphase.h"
+
+// Pairs are gathered slightly beyond contact, since the projection moves
+// balls into new contacts while it iterates.
+#define PBD_CONTACT_MARGIN 1.1f
+
+// Impacts slower than this many substeps of gravity land dead instead of
+// bouncing, which keeps resting piles from buzzing.
+#define PBD_BOUNCE_THRESHOLD 2.0f
+
+// Position-based contact solve: integrate to predicted positions, project
+// overlaps away for a number of iterations, then rebuild velocities from how
+// far each ball actually moved.
+struct Pbd {
+    float* x_prev;
+    float* y_prev;
+    float* x_vel_prev;
+    float* y_vel_prev;
+    int capacity;
+};
+
+void pbd_init (struct Pbd* pbd, int capacity);
+void pbd_free (struct Pbd* pbd);
+
+// Remembers positions and velocities before the balls are integrated.
+void pbd_begin (struct Pbd* pbd, const struct Balls* balls, int count);
+
+void pbd_project_contacts (struct Balls* balls, const struct Pair* pairs, int pair_count, int count, int iterations);
+
+// Derives velocities over a substep of dt frames, then restores bounces of
+// restitution for fast impacts against other balls and the walls.
+void pbd_end (struct Pbd* pbd, struct Balls* balls, int count, const struct Pair* pairs, int pair_count, float dt, float gravity, float restitution);
+
+#endif
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pipeline.h"
+
+static double seconds_now () {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void pipeline_init (struct Pipeline* pipeline, int depth, int capacity) {
+    if (depth < 0) depth = 0;
+    if (depth > PIPELINE_MAX_DEPTH) depth = PIPELINE_MAX_DEPTH;
+
+    memset(pipeline, 0, sizeof(*pipeline));
+    pipeline->depth = depth;
+    pipeline->slot_count = depth + 1;
+    for (int s = 0; s < pipeline->slot_count; s++) {
+        pipeline->slots[s].instances = malloc((size_t)capacity * 3 * sizeof(float));
+        if (pipeline->slots[s].instances == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(1);
+        }
+        pipeline->slots[s].state = PIPELINE_FREE;
+    }
+
+    pthread_mutex_init(&pipeline->lock, NULL);
+    pthread_cond_init(&pipeline->changed, NULL);
+    pipeline->counting_since = seconds_now();
+}
+
+void pipeline_free (struct Pipeline* pipeline) {
+    for (int s = 0; s < pipeline->slot_count; s++) {
+        free(pipeline->slots[s].instances);
+    }
+    pthread_mutex_destroy(&pipeline->lock);
+    pthread_cond_destroy(&pipeline->changed);
+}
+
+struct PipelineSlot* pipeline_begin_frame (struct Pipeline* pipeline) {
+    double start = seconds_now();
+    pthread_mutex_lock(&pipeline->lock);
+    struct PipelineSlot* slot = &pipeline->slots[pipeline->fill_next];
+    while (slot->state != PIPELINE_FREE && !pipeline->stopped) {
+        pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+    }
+    if (pipeline->stopped) {
+        pthread_mutex_unlock(&pipeline->lock);
+        return NULL;
+    }
+
+    slot->state = PIPELINE_FILLING;
+    pipeline->fill_next = (pipeline->fill_next + 1) % pipeline->slot_count;
+    slot->started = seconds_now();
+    pipeline->counters.physics_wait += slot->started - start;
+    pthread_mutex_unlock(&pipeline->lock);
+    return slot;
+}
+
+void pipeline_end_frame (struct Pipeline* pipeline, struct PipelineSlot* slot) {
+    pthread_mutex_lock(&pipeline->lock);
+    slot->ready = seconds_now();
+    slot->state = PIPELINE_READY;
+    pipeline->counters.physics_seconds += slot->ready - slot->started;
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+struct PipelineSlot* pipeline_take (struct Pipeline* pipeline) {
+    double start = seconds_now();
+    pthread_mutex_lock(&pipeline->lock);
+    struct PipelineSlot* slot = &pipeline->slots[pipeline->show_next];
+    while (slot->state != PIPELINE_READY && !pipeline->stopped) {
+        pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+    }
+    if (slot->state != PIPELINE_READY) {
+        pthread_mutex_unlock(&pipeline->lock);
+        return NULL;
+    }
+
+    slot->state = PIPELINE_SHOWING;
+    pipeline->show_next = (pipeline->show_next + 1) % pipeline->slot_count;
+    pipeline->counters.render_wait += seconds_now() - start;
+    pthread_mutex_unlock(&pipeline->lock);
+    return slot;
+}
+
+void pipeline_presented (struct Pipeline* pipeline, struct PipelineSlot* slot) {
+    double now = seconds_now();
+    pthread_mutex_lock(&pipeline->lock);
+    double latency = now - slot->started;
+    struct PipelineCounters* counters = &pipeline->counters;
+    counters->frames++;
+    counters->latency_sum += latency;
+    if (latency > counters->latency_max) counters->latency_max = latency;
+    slot->state = PIPELINE_FREE;
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+void pipeline_stop (struct Pipeline* pipeline) {
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->stopped = 1;
+    pthread_cond_broadcast(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+void pipeline_counters (struct Pipeline* pipeline, struct PipelineCounters* counters) {
+    double now = seconds_now();
+    pthread_mutex_lock(&pipeline->lock);
+    *counters = pipeline->counters;
+    counters->seconds = now - pipeline->counting_since;
+    memset(&pipeline->counters, 0, sizeof(pipeline->counters));
+    pipeline->counting_since = now;
+    pthread_mutex_unlock(&pipeline->lock);
+}
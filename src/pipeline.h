@@ -0,0 +1,81 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <pthread.h>
+
+// Frames handed from the physics to the renderer. Each slot holds one
+// frame's instance data (x, y and radius per ball, interleaved). Slots are
+// filled and shown in ring order: physics takes the next free slot, steps
+// into it and marks it ready; the renderer takes the oldest ready one,
+// draws it and frees it once it is on screen.
+//
+// With depth 0 there is one slot and the caller steps and draws in turn on
+// one thread. With depth N there are N + 1 slots, so physics on its own
+// thread can be up to N frames ahead of the one being drawn.
+#define PIPELINE_MAX_DEPTH 8
+
+#define PIPELINE_FREE 0
+#define PIPELINE_FILLING 1
+#define PIPELINE_READY 2
+#define PIPELINE_SHOWING 3
+
+struct PipelineSlot {
+    float* instances;
+    int count;
+    long frame;
+    int state;
+    // When physics started the frame, which is when it took its inputs.
+    double started;
+    double ready;
+};
+
+// Since the last pipeline_counters call. Latency runs from a frame's start
+// to the end of the swap that showed it.
+struct PipelineCounters {
+    long frames;
+    double seconds;
+    double latency_sum;
+    double latency_max;
+    double physics_seconds;
+    // Time physics waited for a free slot, and the renderer for a ready one.
+    double physics_wait;
+    double render_wait;
+};
+
+struct Pipeline {
+    int depth;
+    int slot_count;
+    struct PipelineSlot slots[PIPELINE_MAX_DEPTH + 1];
+    int fill_next;
+    int show_next;
+    int stopped;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+    // Guarded by lock.
+    struct PipelineCounters counters;
+    double counting_since;
+};
+
+// capacity is the most balls a frame can hold.
+void pipeline_init (struct Pipeline* pipeline, int depth, int capacity);
+void pipeline_free (struct Pipeline* pipeline);
+
+// Physics side. Waits for a free slot, or returns NULL once stopped.
+struct PipelineSlot* pipeline_begin_frame (struct Pipeline* pipeline);
+void pipeline_end_frame (struct Pipeline* pipeline, struct PipelineSlot* slot);
+
+// Render side. Waits for the oldest ready frame, or returns NULL once
+// stopped and every ready frame has been taken.
+struct PipelineSlot* pipeline_take (struct Pipeline* pipeline);
+// Called once the frame is on screen.
+void pipeline_presented (struct Pipeline* pipeline, struct PipelineSlot* slot);
+
+// Either side can stop the pipeline; both waits return.
+void pipeline_stop (struct Pipeline* pipeline);
+
+// Copies the counters and starts counting again.
+void pipeline_counters (struct Pipeline* pipeline, struct PipelineCounters* counters);
+
+#endif
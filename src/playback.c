@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "playback.h"
+
+#define NO_CHUNK UINT64_MAX
+
+static void add_entry (struct Playback* playback, long* capacity, const struct IndexEntry* entry) {
+    if (playback->frame_count == *capacity) {
+        *capacity = *capacity > 0 ? *capacity * 2 : 1024;
+        playback->index = realloc(playback->index, *capacity * sizeof(struct IndexEntry));
+        if (playback->index == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(1);
+        }
+    }
+    playback->index[playback->frame_count++] = *entry;
+}
+
+// Recovers the index of a file whose recorder never got to write one. The
+// last chunk's header is still blank then, so its frames are walked until
+// the data runs out.
+static void rebuild_index (struct Playback* playback) {
+    long capacity = 0;
+    uint64_t offset = playback->header.header_size;
+
+    while (offset + sizeof(struct ChunkHeader) <= playback->size) {
+        struct ChunkHeader chunk;
+        memcpy(&chunk, playback->data + offset, sizeof(chunk));
+
+        uint64_t chunk_end = playback->size;
+        int complete = chunk.magic == TRAJECTORY_CHUNK_MAGIC;
+        if (complete && chunk.byte_size <= playback->size - offset - sizeof(chunk)) {
+            chunk_end = offset + sizeof(chunk) + chunk.byte_size;
+        } else if (chunk.magic != 0) {
+            break;
+        }
+
+        struct IndexEntry entry = {0, offset, offset + sizeof(chunk), 0, 0};
+        while (entry.frame_offset + sizeof(struct FrameHeader) <= chunk_end) {
+            struct FrameHeader frame;
+            memcpy(&frame, playback->data + entry.frame_offset, sizeof(frame));
+            if (frame.count < 0 || frame.byte_size > chunk_end - entry.frame_offset - sizeof(frame)) break;
+
+            entry.frame = frame.frame;
+            entry.count = frame.count;
+            add_entry(playback, &capacity, &entry);
+            entry.frame_offset += sizeof(frame) + frame.byte_size;
+            entry.frame_in_chunk++;
+        }
+
+        if (!complete) break;
+        offset = chunk_end;
+    }
+}
+
+static int read_index (struct Playback* playback) {
+    struct TrajectoryFooter footer;
+    if (playback->size < playback->header.header_size + sizeof(footer)) return 0;
+    memcpy(&footer, playback->data + playback->size - sizeof(footer), sizeof(footer));
+
+    uint64_t index_size = playback->size - sizeof(footer) - footer.index_offset;
+    if (footer.magic != TRAJECTORY_INDEX_MAGIC || footer.index_offset > playback->size - sizeof(footer) ||
+        index_size != footer.frame_count * sizeof(struct IndexEntry)) {
+        return 0;
+    }
+
+    // Copied out rather than used in place: entries are not 8-byte aligned
+    // in the file, and the index is small next to the frames.
+    playback->frame_count = footer.frame_count;
+    playback->index = malloc(index_size > 0 ? index_size : 1);
+    if (playback->index == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(1);
+    }
+    memcpy(playback->index, playback->data + footer.index_offset, index_size);
+    return 1;
+}
+
+int playback_open (struct Playback* playback, const char* path) {
+    memset(playback, 0, sizeof(*playback));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening file %s\n", path);
+        return 0;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)(3 * sizeof(uint32_t))) {
+        fprintf(stderr, "%s is not a trajectory\n", path);
+        close(fd);
+        return 0;
+    }
+
+    playback->size = info.st_size;
+    playback->data = mmap(NULL, playback->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (playback->data == MAP_FAILED) {
+        fprintf(stderr, "Could not map %s\n", path);
+        return 0;
+    }
+
+    // Version 1 files stop after the fields count and are always raw.
+    struct TrajectoryHeader* header = &playback->header;
+    memcpy(header, playback->data, 3 * sizeof(uint32_t));
+    int known = header->magic == TRAJECTORY_MAGIC && header->version >= 1 && header->version <= TRAJECTORY_VERSION &&
+                header->header_size <= playback->size && header->header_size >= 6 * sizeof(uint32_t);
+    if (known) {
+        size_t header_size = header->header_size < sizeof(*header) ? header->header_size : sizeof(*header);
+        memcpy(header, playback->data, header_size);
+        known = header->fields == TRAJECTORY_FIELDS &&
+                (header->codec == TRAJECTORY_CODEC_RAW || header->codec == TRAJECTORY_CODEC_DELTA) &&
+                header->precision >= 0.0f;
+    }
+    if (!known) {
+        fprintf(stderr, "%s is not a trajectory this version can play\n", path);
+        playback_close(playback);
+        return 0;
+    }
+
+    if (!read_index(playback)) {
+        fprintf(stderr, "%s has no index, recovering it from the chunks\n", path);
+        rebuild_index(playback);
+    }
+
+    for (long n = 0; n < playback->frame_count; n++) {
+        if (playback->index[n].count > playback->max_count) playback->max_count = playback->index[n].count;
+    }
+
+    if (header->codec == TRAJECTORY_CODEC_DELTA) {
+        codec_init(&playback->codec, playback->max_count, header->precision);
+        for (int field = 0; field < TRAJECTORY_FIELDS; field++) {
+            playback->fields[field] = malloc((playback->max_count + 1) * sizeof(float));
+            if (playback->fields[field] == NULL) {
+                fprintf(stderr, "Memory allocation error\n");
+                exit(1);
+            }
+        }
+    }
+
+    playback->decoded = -1;
+    playback->resident_chunk = NO_CHUNK;
+    return 1;
+}
+
+void playback_close (struct Playback* playback) {
+    if (playback->data != NULL && playback->data != MAP_FAILED) {
+        munmap((void*)playback->data, playback->size);
+    }
+    if (playback->header.codec == TRAJECTORY_CODEC_DELTA && playback->fields[0] != NULL) {
+        codec_free(&playback->codec);
+        for (int field = 0; field < TRAJECTORY_FIELDS; field++) {
+            free(playback->fields[field]);
+        }
+    }
+    free(playback->index);
+}
+
+// Hands the pages of the chunk we are leaving back to the kernel, so long
+// recordings played end to end do not pile up in memory.
+static void release_chunk (struct Playback* playback, uint64_t offset) {
+    struct ChunkHeader chunk;
+    if (offset > playback->size - sizeof(chunk)) return;
+    memcpy(&chunk, playback->data + offset, sizeof(chunk));
+    uint64_t end = offset + sizeof(chunk);
+    if (chunk.magic == TRAJECTORY_CHUNK_MAGIC && chunk.byte_size <= playback->size - end) end += chunk.byte_size;
+
+    uint64_t page = sysconf(_SC_PAGESIZE);
+    uint64_t start = offset / page * page;
+    madvise((void*)(playback->data + start), end - start, MADV_DONTNEED);
+}
+
+// Frame n's header, or 0 if the entry points outside the file.
+static int frame_at (const struct Playback* playback, long n, struct FrameHeader* frame) {
+    const struct IndexEntry* entry = &playback->index[n];
+    if (entry->frame_offset > playback->size - sizeof(*frame)) return 0;
+    memcpy(frame, playback->data + entry->frame_offset, sizeof(*frame));
+    return frame->count == entry->count && frame->count >= 0 &&
+           frame->byte_size <= playback->size - entry->frame_offset - sizeof(*frame);
+}
+
+int playback_read (struct Playback* playback, long n, const float** fields) {
+    if (n < 0 || n >= playback->frame_count) return -1;
+    const struct IndexEntry* entry = &playback->index[n];
+
+    if (entry->chunk_offset != playback->resident_chunk) {
+        if (playback->resident_chunk != NO_CHUNK) release_chunk(playback, playback->resident_chunk);
+        playback->resident_chunk = entry->chunk_offset;
+    }
+
+    struct FrameHeader frame;
+    if (playback->header.codec == TRAJECTORY_CODEC_RAW) {
+        if (!frame_at(playback, n, &frame) || frame.byte_size != TRAJECTORY_FIELDS * frame.count * sizeof(float)) {
+            return -1;
+        }
+        const float* values = (const float*)(playback->data + entry->frame_offset + sizeof(frame));
+        for (int field = 0; field < TRAJECTORY_FIELDS; field++) {
+            fields[field] = values + field * frame.count;
+        }
+        return frame.count;
+    }
+
+    // Delta frames only make sense on top of the one before, back to the
+    // keyframe that opens the chunk.
+    if (playback->decoded != n) {
+        long first = n - entry->frame_in_chunk;
+        if (first < 0) first = 0;
+        if (playback->decoded == n - 1 && entry->frame_in_chunk > 0) {
+            first = n;
+        } else {
+            codec_reset(&playback->codec);
+        }
+
+        for (long k = first; k <= n; k++) {
+            playback->decoded = -1;
+            if (!frame_at(playback, k, &frame)) return -1;
+            const uint8_t* payload = playback->data + playback->index[k].frame_offset + sizeof(frame);
+            if (!codec_decode_frame(&playback->codec, payload, frame.byte_size, frame.count, playback->fields)) {
+                return -1;
+            }
+            playback->decoded = k;
+        }
+    }
+
+    for (int field = 0; field < TRAJECTORY_FIELDS; field++) {
+        fields[field] = playback->fields[field];
+    }
+    return entry->count;
+}
@@ -0,0 +1,39 @@
+#ifndef PLAYBACK_H
+#define PLAYBACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "codec.h"
+#include "trajectory.h"
+
+// A recorded trajectory opened for viewing. The file is mapped rather than
+// read, so only the chunks being looked at are paged in; raw frames are used
+// straight from the mapping and delta frames are decoded into fields.
+struct Playback {
+    const uint8_t* data;
+    size_t size;
+    struct TrajectoryHeader header;
+
+    // Copied from the end of the file, or rebuilt by walking the chunks when
+    // the recording was cut short before its index was written.
+    struct IndexEntry* index;
+    long frame_count;
+    int max_count;
+
+    struct Codec codec;
+    float* fields[TRAJECTORY_FIELDS];
+    long decoded;
+    uint64_t resident_chunk;
+};
+
+// Returns 0 if the file cannot be mapped or is not a trajectory.
+int playback_open (struct Playback* playback, const char* path);
+void playback_close (struct Playback* playback);
+
+// Makes frame n (0 based, in index order) available in fields and returns
+// its ball count, or -1 if the frame is damaged. Stepping forward decodes
+// one frame; any other seek decodes from the start of n's chunk.
+int playback_read (struct Playback* playback, long n, const float** fields);
+
+#endif
@@ -0,0 +1,88 @@
+#include "potential.h"
+#include "simd.h"
+
+// 2^(-1/3): sigma^2 for a unit contact distance when the LJ minimum is at contact.
+#define LJ_SIGMA_SQUARED_SCALE 0.7937005f
+
+float potential_reach () {
+#if PAIR_POTENTIAL == POTENTIAL_LJ
+    return POTENTIAL_CUTOFF;
+#else
+    // WCA and Hertz are purely repulsive and vanish at contact.
+    return 1.0f;
+#endif
+}
+
+// Force magnitude divided by distance, so the force vector is f * (dx, dy).
+static inline vfloat pair_force (vfloat r2, vfloat contact) {
+#if PAIR_POTENTIAL == POTENTIAL_LJ || PAIR_POTENTIAL == POTENTIAL_WCA
+    vfloat contact2 = contact * contact;
+    vfloat sigma2 = contact2 * vsplat(LJ_SIGMA_SQUARED_SCALE);
+    vfloat r2_core = vmax(r2, sigma2 * vsplat(POTENTIAL_CORE * POTENTIAL_CORE));
+    vfloat s2 = sigma2 / r2_core;
+    vfloat s6 = s2 * s2 * s2;
+    vfloat f = vsplat(24.0f * POTENTIAL_EPSILON) * (vsplat(2.0f) * s6 * s6 - s6) / r2_core;
+#if PAIR_POTENTIAL == POTENTIAL_LJ
+    vfloat cutoff2 = contact2 * vsplat(POTENTIAL_CUTOFF * POTENTIAL_CUTOFF);
+#else
+    vfloat cutoff2 = contact2;
+#endif
+    return vselect(r2 < cutoff2, f, vsplat(0.0f));
+#elif PAIR_POTENTIAL == POTENTIAL_HERTZ
+    vfloat r = vmax(vsqrt(r2), vsplat(0.000001f));
+    vfloat overlap = vmax(contact - r, vsplat(0.0f));
+    return vsplat(POTENTIAL_STIFFNESS) * overlap * vsqrt(overlap) / r;
+#else
+    (void)r2;
+    (void)contact;
+    return vsplat(0.0f);
+#endif
+}
+
+void potential_apply (struct Balls* balls, const struct Pair* pairs, int pair_count, float dt) {
+    for (int base = 0; base < pair_count; base += SIMD_WIDTH) {
+        float dx[SIMD_WIDTH], dy[SIMD_WIDTH], contact[SIMD_WIDTH];
+        float share_i[SIMD_WIDTH], share_j[SIMD_WIDTH];
+
+        // Gather one pair per lane. Lanes past the end are parked far outside
+        // any cutoff so they contribute nothing.
+        for (int lane = 0; lane < SIMD_WIDTH; lane++) {
+            if (base + lane < pair_count) {
+                int i = pairs[base + lane].i;
+                int j = pairs[base + lane].j;
+                float mass_sum = balls->mass[i] + balls->mass[j];
+                dx[lane] = balls->x_pos[j] - balls->x_pos[i];
+                dy[lane] = balls->y_pos[j] - balls->y_pos[i];
+                contact[lane] = balls->radius[i] + balls->radius[j];
+                share_i[lane] = balls->mass[j] / mass_sum;
+                share_j[lane] = balls->mass[i] / mass_sum;
+            } else {
+                dx[lane] = 4.0f;
+                dy[lane] = 4.0f;
+                contact[lane] = 1.0f;
+                share_i[lane] = 0.0f;
+                share_j[lane] = 0.0f;
+            }
+        }
+
+        vfloat vdx = vload(dx);
+        vfloat vdy = vload(dy);
+        vfloat f = pair_force(vdx * vdx + vdy * vdy, vload(contact)) * vsplat(dt);
+        vfloat fx = f * vdx;
+        vfloat fy = f * vdy;
+        vstore(dx, fx * vload(share_i));
+        vstore(dy, fy * vload(share_i));
+        vfloat fx_j = fx * vload(share_j);
+        vfloat fy_j = fy * vload(share_j);
+
+        // Scatter stays scalar: two lanes may share a ball.
+        for (int lane = 0; lane < SIMD_WIDTH && base + lane < pair_count; lane++) {
+            int i = pairs[base + lane].i;
+            int j = pairs[base + lane].j;
+            balls->x_vel[i] -= dx[lane];
+            balls->y_vel[i] -= dy[lane];
+            balls->x_vel[j] += fx_j[lane];
+            balls->y_vel[j] += fy_j[lane];
+        }
+    }
+}
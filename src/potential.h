@@ -0,0 +1,49 @@
+#ifndef POTENTIAL_H
+#define POTENTIAL_H
+
+#include "balls.h"
+#include "broadphase.h"
+
+#define POTENTIAL_NONE 0
+#define POTENTIAL_LJ 1
+#define POTENTIAL_WCA 2
+#define POTENTIAL_HERTZ 3
+
+// Pick the potential at build time, e.g. make DEFINES=-DPAIR_POTENTIAL=1
+#ifndef PAIR_POTENTIAL
+#define PAIR_POTENTIAL POTENTIAL_NONE
+#endif
+
+// When set, the potential is the only pair interaction and the hard-sphere
+// impulses in handle_collisions are skipped.
+#ifndef POTENTIAL_REPLACES_IMPULSES
+#define POTENTIAL_REPLACES_IMPULSES 0
+#endif
+
+// Distances are measured in units of the contact distance r_i + r_j. The LJ
+// sigma is chosen so its minimum sits exactly at contact.
+#ifndef POTENTIAL_CUTOFF
+#define POTENTIAL_CUTOFF 2.0f
+#endif
+
+// Well depth (LJ, WCA) and stiffness (Hertz) are per unit reduced mass, so the
+// same value behaves alike for small and large balls.
+#ifndef POTENTIAL_EPSILON
+#define POTENTIAL_EPSILON 0.0000001f
+#endif
+
+#ifndef POTENTIAL_STIFFNESS
+#define POTENTIAL_STIFFNESS 1.0f
+#endif
+
+// LJ forces are evaluated no closer than this fraction of sigma, which keeps
+// deep overlaps from producing unbounded kicks.
+#define POTENTIAL_CORE 0.8f
+
+// How far out, relative to contact, pairs must be collected for the potential.
+float potential_reach ();
+
+// Kicks velocities by the pair forces acting over dt frames.
+void potential_apply (struct Balls* balls, const struct Pair* pairs, int pair_count, float dt);
+
+#endif
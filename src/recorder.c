@@ -0,0 +1,323 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "recorder.h"
+
+static void write_at (struct Recorder* recorder, const void* data, size_t size, uint64_t offset) {
+    const char* bytes = data;
+    while (size > 0 && !recorder->failed) {
+        ssize_t written = pwrite(recorder->fd, bytes, size, offset);
+        if (written < 0) {
+            fprintf(stderr, "Error writing trajectory, recording stopped\n");
+            recorder->failed = 1;
+            return;
+        }
+        bytes += written;
+        size -= written;
+        offset += written;
+    }
+}
+
+static void append (struct Recorder* recorder, const void* data, size_t size) {
+    write_at(recorder, data, size, recorder->offset);
+    recorder->offset += size;
+}
+
+// The chunk header goes in the space reserved in front of its frames once
+// the frame count and size are known.
+static void finish_chunk (struct Recorder* recorder) {
+    if (recorder->chunk.frame_count == 0) return;
+    write_at(recorder, &recorder->chunk, sizeof(recorder->chunk), recorder->chunk_offset);
+    recorder->chunk.frame_count = 0;
+}
+
+static void encode_slices (struct Recorder* recorder) {
+    const struct RecordedFrame* frame = recorder->encoding;
+    int slice;
+    while ((slice = atomic_fetch_add(&recorder->encode_next, 1)) < recorder->encode_slices) {
+        int begin = slice * CODEC_SLICE;
+        int end = begin + CODEC_SLICE < frame->count ? begin + CODEC_SLICE : frame->count;
+        uint8_t* out = recorder->encoded + slice * codec_max_slice_size();
+        recorder->slice_sizes[slice] = codec_encode_slice(&recorder->codec, frame->fields, begin, end, out);
+    }
+}
+
+static void* encoder_main (void* arg) {
+    struct Recorder* recorder = arg;
+    unsigned seen = 0;
+
+    pthread_mutex_lock(&recorder->encode_lock);
+    for (;;) {
+        while (recorder->encode_generation == seen && !recorder->encode_quitting) {
+            pthread_cond_wait(&recorder->encode_wake, &recorder->encode_lock);
+        }
+        if (recorder->encode_quitting) break;
+        seen = recorder->encode_generation;
+
+        pthread_mutex_unlock(&recorder->encode_lock);
+        encode_slices(recorder);
+        pthread_mutex_lock(&recorder->encode_lock);
+
+        if (--recorder->encode_busy == 0) pthread_cond_signal(&recorder->encode_done);
+    }
+    pthread_mutex_unlock(&recorder->encode_lock);
+    return NULL;
+}
+
+// Encodes frame's slices on the writer and the helpers together, and returns
+// the payload size: the slice size table plus the slices.
+static size_t encode_frame (struct Recorder* recorder, const struct RecordedFrame* frame) {
+    pthread_mutex_lock(&recorder->encode_lock);
+    recorder->encoding = frame;
+    recorder->encode_slices = codec_slice_count(frame->count);
+    atomic_store(&recorder->encode_next, 0);
+    recorder->encode_busy = RECORDER_ENCODE_THREADS - 1;
+    recorder->encode_generation++;
+    pthread_cond_broadcast(&recorder->encode_wake);
+    pthread_mutex_unlock(&recorder->encode_lock);
+
+    encode_slices(recorder);
+
+    pthread_mutex_lock(&recorder->encode_lock);
+    while (recorder->encode_busy > 0) {
+        pthread_cond_wait(&recorder->encode_done, &recorder->encode_lock);
+    }
+    pthread_mutex_unlock(&recorder->encode_lock);
+
+    codec_end_frame(&recorder->codec, frame->count);
+
+    size_t size = recorder->encode_slices * sizeof(uint32_t);
+    for (int slice = 0; slice < recorder->encode_slices; slice++) {
+        size += recorder->slice_sizes[slice];
+    }
+    return size;
+}
+
+static double seconds_now () {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void write_frame (struct Recorder* recorder, const struct RecordedFrame* frame) {
+    if (recorder->chunk.frame_count == 0) {
+        // Every chunk opens with a keyframe so it decodes on its own.
+        codec_reset(&recorder->codec);
+        recorder->chunk_offset = recorder->offset;
+        recorder->chunk.magic = TRAJECTORY_CHUNK_MAGIC;
+        recorder->chunk.first_frame = frame->frame;
+        recorder->chunk.byte_size = 0;
+        recorder->offset += sizeof(struct ChunkHeader);
+    }
+
+    if (recorder->index_count == recorder->index_capacity) {
+        recorder->index_capacity = recorder->index_capacity > 0 ? recorder->index_capacity * 2 : 1024;
+        recorder->index = realloc(recorder->index, recorder->index_capacity * sizeof(struct IndexEntry));
+        if (recorder->index == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(1);
+        }
+    }
+
+    struct IndexEntry* entry = &recorder->index[recorder->index_count++];
+    entry->frame = frame->frame;
+    entry->chunk_offset = recorder->chunk_offset;
+    entry->frame_offset = recorder->offset;
+    entry->frame_in_chunk = recorder->chunk.frame_count;
+    entry->count = frame->count;
+
+    size_t field_size = frame->count * sizeof(float);
+    struct FrameHeader header = {frame->frame, frame->count, TRAJECTORY_FIELDS * field_size};
+    double encode_seconds = 0.0;
+
+    if (recorder->codec_id == TRAJECTORY_CODEC_DELTA) {
+        double start = seconds_now();
+        header.byte_size = encode_frame(recorder, frame);
+        encode_seconds = seconds_now() - start;
+
+        append(recorder, &header, sizeof(header));
+        append(recorder, recorder->slice_sizes, recorder->encode_slices * sizeof(uint32_t));
+        for (int slice = 0; slice < recorder->encode_slices; slice++) {
+            append(recorder, recorder->encoded + slice * codec_max_slice_size(), recorder->slice_sizes[slice]);
+        }
+    } else {
+        append(recorder, &header, sizeof(header));
+        for (int field = 0; field < TRAJECTORY_FIELDS; field++) {
+            append(recorder, frame->fields[field], field_size);
+        }
+    }
+
+    pthread_mutex_lock(&recorder->lock);
+    recorder->counters.raw_bytes += sizeof(header) + TRAJECTORY_FIELDS * field_size;
+    recorder->counters.written_bytes += sizeof(header) + header.byte_size;
+    recorder->counters.encode_seconds += encode_seconds;
+    pthread_mutex_unlock(&recorder->lock);
+
+    recorder->chunk.frame_count++;
+    recorder->chunk.byte_size += sizeof(header) + header.byte_size;
+    if (recorder->chunk.frame_count == RECORDER_CHUNK_FRAMES) finish_chunk(recorder);
+}
+
+static void write_index (struct Recorder* recorder) {
+    struct TrajectoryFooter footer = {recorder->offset, recorder->index_count, TRAJECTORY_INDEX_MAGIC, TRAJECTORY_VERSION};
+    append(recorder, recorder->index, recorder->index_count * sizeof(struct IndexEntry));
+    append(recorder, &footer, sizeof(footer));
+}
+
+static void* writer_main (void* arg) {
+    struct Recorder* recorder = arg;
+
+    pthread_mutex_lock(&recorder->lock);
+    for (;;) {
+        while (recorder->queue_count == 0 && !recorder->quitting) {
+            pthread_cond_wait(&recorder->wake, &recorder->lock);
+        }
+        if (recorder->queue_count == 0) break;
+
+        int slot = recorder->queue[recorder->queue_head];
+        recorder->queue_head = (recorder->queue_head + 1) % RECORDER_BUFFERS;
+        recorder->queue_count--;
+
+        pthread_mutex_unlock(&recorder->lock);
+        write_frame(recorder, &recorder->buffers[slot]);
+        pthread_mutex_lock(&recorder->lock);
+
+        recorder->free_stack[recorder->free_count++] = slot;
+        recorder->counters.frames_recorded++;
+    }
+    pthread_mutex_unlock(&recorder->lock);
+
+    finish_chunk(recorder);
+    write_index(recorder);
+    return NULL;
+}
+
+int recorder_open (struct Recorder* recorder, const char* path, int capacity, int codec, float precision) {
+    memset(recorder, 0, sizeof(*recorder));
+    recorder->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (recorder->fd < 0) {
+        fprintf(stderr, "Error opening file %s\n", path);
+        return 0;
+    }
+
+    recorder->capacity = capacity;
+    recorder->codec_id = codec;
+    for (int slot = 0; slot < RECORDER_BUFFERS; slot++) {
+        for (int field = 0; field < TRAJECTORY_FIELDS; field++) {
+            recorder->buffers[slot].fields[field] = malloc(capacity * sizeof(float));
+            if (recorder->buffers[slot].fields[field] == NULL) {
+                fprintf(stderr, "Memory allocation error\n");
+                exit(1);
+            }
+        }
+        recorder->free_stack[recorder->free_count++] = slot;
+    }
+
+    struct TrajectoryHeader header = {
+        TRAJECTORY_MAGIC, TRAJECTORY_VERSION, sizeof(struct TrajectoryHeader),
+        codec, RECORDER_CHUNK_FRAMES, TRAJECTORY_FIELDS, precision, CODEC_SLICE,
+    };
+    append(recorder, &header, sizeof(header));
+
+    pthread_mutex_init(&recorder->lock, NULL);
+    pthread_cond_init(&recorder->wake, NULL);
+
+    if (codec == TRAJECTORY_CODEC_DELTA) {
+        int slices = codec_slice_count(capacity);
+        codec_init(&recorder->codec, capacity, precision);
+        recorder->encoded = malloc(slices * codec_max_slice_size());
+        recorder->slice_sizes = malloc(slices * sizeof(uint32_t));
+        if (recorder->encoded == NULL || recorder->slice_sizes == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(1);
+        }
+
+        pthread_mutex_init(&recorder->encode_lock, NULL);
+        pthread_cond_init(&recorder->encode_wake, NULL);
+        pthread_cond_init(&recorder->encode_done, NULL);
+        for (int n = 0; n < RECORDER_ENCODE_THREADS - 1; n++) {
+            if (pthread_create(&recorder->encoders[n], NULL, encoder_main, recorder) != 0) {
+                fprintf(stderr, "Could not start trajectory encoder\n");
+                exit(1);
+            }
+        }
+    }
+
+    if (pthread_create(&recorder->thread, NULL, writer_main, recorder) != 0) {
+        fprintf(stderr, "Could not start trajectory writer\n");
+        exit(1);
+    }
+    return 1;
+}
+
+void recorder_capture (struct Recorder* recorder, const struct Balls* balls, int count, long frame) {
+    if (count > recorder->capacity) count = recorder->capacity;
+
+    pthread_mutex_lock(&recorder->lock);
+    int slot = recorder->free_count > 0 ? recorder->free_stack[--recorder->free_count] : -1;
+    if (slot < 0) recorder->counters.frames_dropped++;
+    pthread_mutex_unlock(&recorder->lock);
+    if (slot < 0) return;
+
+    // The buffer belongs to this thread until it is queued.
+    struct RecordedFrame* buffer = &recorder->buffers[slot];
+    const float* from[TRAJECTORY_FIELDS] = {balls->radius, balls->x_pos, balls->y_pos, balls->x_vel, balls->y_vel};
+    for (int field = 0; field < TRAJECTORY_FIELDS; field++) {
+        memcpy(buffer->fields[field], from[field], count * sizeof(float));
+    }
+    buffer->frame = frame;
+    buffer->count = count;
+
+    pthread_mutex_lock(&recorder->lock);
+    recorder->queue[(recorder->queue_head + recorder->queue_count) % RECORDER_BUFFERS] = slot;
+    recorder->queue_count++;
+    if (recorder->queue_count > recorder->counters.queue_peak) recorder->counters.queue_peak = recorder->queue_count;
+    pthread_cond_signal(&recorder->wake);
+    pthread_mutex_unlock(&recorder->lock);
+}
+
+void recorder_counters (struct Recorder* recorder, struct RecorderCounters* counters) {
+    pthread_mutex_lock(&recorder->lock);
+    recorder->counters.queue_depth = recorder->queue_count;
+    *counters = recorder->counters;
+    pthread_mutex_unlock(&recorder->lock);
+}
+
+void recorder_close (struct Recorder* recorder) {
+    pthread_mutex_lock(&recorder->lock);
+    recorder->quitting = 1;
+    pthread_cond_signal(&recorder->wake);
+    pthread_mutex_unlock(&recorder->lock);
+    pthread_join(recorder->thread, NULL);
+
+    if (recorder->codec_id == TRAJECTORY_CODEC_DELTA) {
+        pthread_mutex_lock(&recorder->encode_lock);
+        recorder->encode_quitting = 1;
+        pthread_cond_broadcast(&recorder->encode_wake);
+        pthread_mutex_unlock(&recorder->encode_lock);
+        for (int n = 0; n < RECORDER_ENCODE_THREADS - 1; n++) {
+            pthread_join(recorder->encoders[n], NULL);
+        }
+
+        pthread_mutex_destroy(&recorder->encode_lock);
+        pthread_cond_destroy(&recorder->encode_wake);
+        pthread_cond_destroy(&recorder->encode_done);
+        codec_free(&recorder->codec);
+        free(recorder->encoded);
+        free(recorder->slice_sizes);
+    }
+
+    close(recorder->fd);
+    pthread_mutex_destroy(&recorder->lock);
+    pthread_cond_destroy(&recorder->wake);
+    for (int slot = 0; slot < RECORDER_BUFFERS; slot++) {
+        for (int field = 0; field < TRAJECTORY_FIELDS; field++) {
+            free(recorder->buffers[slot].fields[field]);
+        }
+    }
+    free(recorder->index);
+}
@@ -0,0 +1,103 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "balls.h"
+#include "codec.h"
+#include "trajectory.h"
+
+// Frames in flight between the simulation and the writer. When all of them
+// are waiting to be written the next frame is dropped rather than stalling
+// the simulation.
+#define RECORDER_BUFFERS 8
+
+// Frames per chunk in the output file.
+#define RECORDER_CHUNK_FRAMES 64
+
+// Threads encoding the slices of a frame, the writer included.
+#define RECORDER_ENCODE_THREADS 4
+
+struct RecordedFrame {
+    int64_t frame;
+    int count;
+    float* fields[TRAJECTORY_FIELDS];
+};
+
+struct RecorderCounters {
+    long frames_recorded;
+    long frames_dropped;
+    int queue_depth;
+    int queue_peak;
+
+    // Bytes the frames would take raw and bytes actually written, and time
+    // spent encoding them.
+    double raw_bytes;
+    double written_bytes;
+    double encode_seconds;
+};
+
+// Streams frames to a trajectory file (see trajectory.h) from a writer
+// thread. Buffers cycle from the free stack to the queue and back.
+struct Recorder {
+    int fd;
+    int capacity;
+    int codec_id;
+
+    struct RecordedFrame buffers[RECORDER_BUFFERS];
+    int free_stack[RECORDER_BUFFERS];
+    int free_count;
+    int queue[RECORDER_BUFFERS];
+    int queue_head;
+    int queue_count;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int quitting;
+
+    // Writer thread only.
+    uint64_t offset;
+    uint64_t chunk_offset;
+    struct ChunkHeader chunk;
+    struct IndexEntry* index;
+    long index_count;
+    long index_capacity;
+    int failed;
+
+    // Delta codec state, and the helpers the writer splits each frame with.
+    struct Codec codec;
+    uint8_t* encoded;
+    uint32_t* slice_sizes;
+    pthread_t encoders[RECORDER_ENCODE_THREADS - 1];
+    pthread_mutex_t encode_lock;
+    pthread_cond_t encode_wake;
+    pthread_cond_t encode_done;
+    unsigned encode_generation;
+    int encode_busy;
+    int encode_quitting;
+    const struct RecordedFrame* encoding;
+    int encode_slices;
+    atomic_int encode_next;
+
+    // Guarded by lock.
+    struct RecorderCounters counters;
+};
+
+// codec is TRAJECTORY_CODEC_RAW or TRAJECTORY_CODEC_DELTA, precision the
+// delta codec's quantization step (0 keeps every bit). Returns 0 if the file
+// cannot be created.
+int recorder_open (struct Recorder* recorder, const char* path, int capacity, int codec, float precision);
+
+// Copies the first count balls into a free buffer and queues it, or counts
+// the frame as dropped if the writer has fallen RECORDER_BUFFERS behind.
+void recorder_capture (struct Recorder* recorder, const struct Balls* balls, int count, long frame);
+
+// Writes out everything still queued, then the index.
+void recorder_close (struct Recorder* recorder);
+
+void recorder_counters (struct Recorder* recorder, struct RecorderCounters* counters);
+
+#endif
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rewind.h"
+
+static void* alloc_copy (const void* source, size_t size) {
+    void* copy = malloc(size > 0 ? size : 1);
+    if (copy == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(1);
+    }
+    memcpy(copy, source, size);
+    return copy;
+}
+
+static void fields_of (const struct Balls* balls, float** fields) {
+    fields[0] = balls->radius;
+    fields[1] = balls->x_pos;
+    fields[2] = balls->y_pos;
+    fields[3] = balls->x_vel;
+    fields[4] = balls->y_vel;
+    fields[5] = balls->mass;
+}
+
+static struct Keyframe* keyframe_at (struct Rewind* rewind, int n) {
+    return &rewind->keyframes[(rewind->first + n) % REWIND_MAX_KEYFRAMES];
+}
+
+static void drop_keyframe (struct Rewind* rewind, struct Keyframe* keyframe) {
+    for (int field = 0; field < 6; field++) {
+        free(keyframe->fields[field]);
+    }
+    free(keyframe->links);
+    free(keyframe->cache);
+    rewind->used -= keyframe->bytes;
+}
+
+// Index of the first event at or after frame.
+static int first_event (const struct Rewind* rewind, long frame) {
+    int low = 0;
+    int high = rewind->event_count;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (rewind->events[middle].frame < frame) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Evicts the oldest keyframes, and the events only they could replay, until
+// the history fits the budget. The newest keyframe always stays.
+static void trim (struct Rewind* rewind) {
+    while ((rewind->used > rewind->budget && rewind->keyframe_count > 1) || rewind->keyframe_count == REWIND_MAX_KEYFRAMES) {
+        drop_keyframe(rewind, keyframe_at(rewind, 0));
+        rewind->first = (rewind->first + 1) % REWIND_MAX_KEYFRAMES;
+        rewind->keyframe_count--;
+    }
+
+    int stale = first_event(rewind, rewind_oldest(rewind));
+    if (stale > 0) {
+        rewind->event_count -= stale;
+        memmove(rewind->events, rewind->events + stale, rewind->event_count * sizeof(struct SimEvent));
+    }
+}
+
+void rewind_init (struct Rewind* rewind, size_t budget) {
+    memset(rewind, 0, sizeof(*rewind));
+    rewind->budget = budget;
+}
+
+void rewind_free (struct Rewind* rewind) {
+    for (int n = 0; n < rewind->keyframe_count; n++) {
+        drop_keyframe(rewind, keyframe_at(rewind, n));
+    }
+    free(rewind->events);
+}
+
+void rewind_capture (struct Rewind* rewind, long frame, const struct Balls* balls, int count,
+                     const struct Links* links, const struct ContactCache* cache, int rope_end, int broadphase) {
+    if (frame % REWIND_INTERVAL != 0) return;
+    if (rewind->keyframe_count > 0 && keyframe_at(rewind, rewind->keyframe_count - 1)->frame >= frame) return;
+
+    if (rewind->keyframe_count == REWIND_MAX_KEYFRAMES) trim(rewind);
+    struct Keyframe* keyframe = keyframe_at(rewind, rewind->keyframe_count++);
+    keyframe->frame = frame;
+    keyframe->count = count;
+    keyframe->rope_end = rope_end;
+    keyframe->broadphase = broadphase;
+
+    float* fields[6];
+    fields_of(balls, fields);
+    for (int field = 0; field < 6; field++) {
+        keyframe->fields[field] = alloc_copy(fields[field], count * sizeof(float));
+    }
+    keyframe->link_count = links->count;
+    keyframe->links = alloc_copy(links->links, links->count * sizeof(struct Link));
+    keyframe->cache_capacity = cache->capacity;
+    keyframe->cache = alloc_copy(cache->entries, cache->capacity * sizeof(struct CacheEntry));
+
+    keyframe->bytes = 6 * count * sizeof(float) + links->count * sizeof(struct Link) +
+                      cache->capacity * sizeof(struct CacheEntry);
+    rewind->used += keyframe->bytes;
+    trim(rewind);
+}
+
+void rewind_record_event (struct Rewind* rewind, const struct SimEvent* event) {
+    if (rewind->event_count == rewind->event_capacity) {
+        rewind->used -= rewind->event_capacity * sizeof(struct SimEvent);
+        rewind->event_capacity = rewind->event_capacity > 0 ? rewind->event_capacity * 2 : 256;
+        rewind->events = realloc(rewind->events, rewind->event_capacity * sizeof(struct SimEvent));
+        if (rewind->events == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(1);
+        }
+        rewind->used += rewind->event_capacity * sizeof(struct SimEvent);
+    }
+    rewind->events[rewind->event_count++] = *event;
+}
+
+long rewind_oldest (const struct Rewind* rewind) {
+    if (rewind->keyframe_count == 0) return -1;
+    return rewind->keyframes[rewind->first].frame;
+}
+
+long rewind_load (struct Rewind* rewind, long frame, struct Balls* balls, int* count,
+                  struct Links* links, struct ContactCache* cache, int* rope_end, int* broadphase) {
+    int newest = rewind->keyframe_count - 1;
+    while (newest >= 0 && keyframe_at(rewind, newest)->frame > frame) newest--;
+    if (newest < 0) return -1;
+
+    // Keyframes past the target belong to the future being abandoned.
+    while (rewind->keyframe_count - 1 > newest) {
+        drop_keyframe(rewind, keyframe_at(rewind, --rewind->keyframe_count));
+    }
+    rewind->event_count = first_event(rewind, frame);
+
+    struct Keyframe* keyframe = keyframe_at(rewind, newest);
+    float* fields[6];
+    fields_of(balls, fields);
+    for (int field = 0; field < 6; field++) {
+        memcpy(fields[field], keyframe->fields[field], keyframe->count * sizeof(float));
+    }
+    *count = keyframe->count;
+    *rope_end = keyframe->rope_end;
+    *broadphase = keyframe->broadphase;
+
+    links->count = 0;
+    links->coloured = 0;
+    for (int n = 0; n < keyframe->link_count; n++) {
+        const struct Link* link = &keyframe->links[n];
+        links_add(links, link->a, link->b, link->rest_length, link->compliance);
+    }
+
+    if (cache->capacity != keyframe->cache_capacity) {
+        free(cache->entries);
+        cache->capacity = keyframe->cache_capacity;
+        cache->entries = alloc_copy(keyframe->cache, cache->capacity * sizeof(struct CacheEntry));
+    } else {
+        memcpy(cache->entries, keyframe->cache, cache->capacity * sizeof(struct CacheEntry));
+    }
+
+    return keyframe->frame;
+}
+
+const struct SimEvent* rewind_events (const struct Rewind* rewind, long frame, int* event_count) {
+    int begin = first_event(rewind, frame);
+    int end = first_event(rewind, frame + 1);
+    *event_count = end - begin;
+    return rewind->events + begin;
+}
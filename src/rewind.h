@@ -0,0 +1,70 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stddef.h>
+
+#include "balls.h"
+#include "contact_cache.h"
+#include "events.h"
+#include "links.h"
+
+// A full copy of the world every REWIND_INTERVAL frames, and the events in
+// between. Any frame in the window is rebuilt by loading the keyframe before
+// it and stepping forward through the same events, which lands on the same
+// state since stepping is deterministic.
+#define REWIND_INTERVAL 60
+#define REWIND_MAX_KEYFRAMES 1024
+#define REWIND_DEFAULT_BUDGET (64 << 20)
+
+struct Keyframe {
+    long frame;
+    int count;
+    int rope_end;
+    int broadphase;
+    float* fields[6];
+    struct Link* links;
+    int link_count;
+    struct CacheEntry* cache;
+    int cache_capacity;
+    size_t bytes;
+};
+
+// Keyframes form a ring, oldest first; the oldest are evicted to stay under
+// budget. events holds every event since the oldest keyframe, in order.
+struct Rewind {
+    size_t budget;
+    size_t used;
+
+    struct Keyframe keyframes[REWIND_MAX_KEYFRAMES];
+    int first;
+    int keyframe_count;
+
+    struct SimEvent* events;
+    int event_count;
+    int event_capacity;
+};
+
+void rewind_init (struct Rewind* rewind, size_t budget);
+void rewind_free (struct Rewind* rewind);
+
+// Called after every step; keeps a keyframe when frame is a multiple of
+// REWIND_INTERVAL.
+void rewind_capture (struct Rewind* rewind, long frame, const struct Balls* balls, int count,
+                     const struct Links* links, const struct ContactCache* cache, int rope_end, int broadphase);
+
+void rewind_record_event (struct Rewind* rewind, const struct SimEvent* event);
+
+// Oldest frame that can still be restored, or -1 with no keyframes.
+long rewind_oldest (const struct Rewind* rewind);
+
+// Loads the newest keyframe at or before frame and forgets everything from
+// frame on, so the timeline can branch there. Returns the keyframe's frame,
+// or -1 if frame is older than the window. The caller then steps forward
+// to frame, applying rewind_events along the way.
+long rewind_load (struct Rewind* rewind, long frame, struct Balls* balls, int* count,
+                  struct Links* links, struct ContactCache* cache, int* rope_end, int* broadphase);
+
+// The recorded events of one frame.
+const struct SimEvent* rewind_events (const struct Rewind* rewind, long frame, int* event_count);
+
+#endif
@@ -0,0 +1,374 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#include "server.h"
+#include "shm_export.h"
+#include "snapshot.h"
+#include "world.h"
+
+// Answers are collected and written together once no more requests are
+// waiting, or once this much has piled up.
+#define SERVER_FLUSH_SIZE (64 << 10)
+
+struct Connection {
+    int socket;
+    int number;
+    struct World* world;
+    struct ShmExport shm;
+
+    char* payload;
+    size_t payload_capacity;
+    char* output;
+    size_t output_size;
+    size_t output_capacity;
+
+    long requests;
+    long frames;
+};
+
+static volatile sig_atomic_t stopping = 0;
+
+static void handle_signal (int number) {
+    (void)number;
+    stopping = 1;
+}
+
+static void* grow (void* data, size_t* capacity, size_t needed) {
+    if (needed <= *capacity) return data;
+    size_t new_capacity = *capacity > 0 ? *capacity : 4096;
+    while (new_capacity < needed) new_capacity *= 2;
+    data = realloc(data, new_capacity);
+    if (data == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(1);
+    }
+    *capacity = new_capacity;
+    return data;
+}
+
+static int read_all (int fd, void* data, size_t size) {
+    char* bytes = data;
+    while (size > 0) {
+        ssize_t got = read(fd, bytes, size);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return 0;
+        bytes += got;
+        size -= got;
+    }
+    return 1;
+}
+
+static int write_all (int fd, const void* data, size_t size) {
+    const char* bytes = data;
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return 0;
+        bytes += written;
+        size -= written;
+    }
+    return 1;
+}
+
+static int flush (struct Connection* connection) {
+    int ok = write_all(connection->socket, connection->output, connection->output_size);
+    connection->output_size = 0;
+    return ok;
+}
+
+static void queue (struct Connection* connection, const void* data, size_t size) {
+    connection->output = grow(connection->output, &connection->output_capacity, connection->output_size + size);
+    memcpy(connection->output + connection->output_size, data, size);
+    connection->output_size += size;
+}
+
+static void respond (struct Connection* connection, uint32_t status, uint32_t tag, uint64_t value, const void* payload, size_t size) {
+    struct ServerResponse response = {status, tag, value, size};
+    queue(connection, &response, sizeof(response));
+    queue(connection, payload, size);
+    if (connection->output_size >= SERVER_FLUSH_SIZE) flush(connection);
+}
+
+static void fail (struct Connection* connection, uint32_t tag, const char* message) {
+    respond(connection, SERVER_ERROR, tag, 0, message, strlen(message));
+}
+
+static void load_scene (struct Connection* connection, const struct ServerRequest* request) {
+    struct World* world = connection->world;
+    char path[1024];
+    if (request->size >= sizeof(path)) {
+        fail(connection, request->tag, "path too long");
+        return;
+    }
+    memcpy(path, connection->payload, request->size);
+    path[request->size] = '\0';
+
+    shm_export_begin(&connection->shm);
+    if (path[0] == '\0') {
+        world_clear(world);
+    } else {
+        // Restored into a mapping of its own, then copied into the shared
+        // segment the world lives in.
+        struct Balls loaded = {0};
+        struct SnapshotHeader header;
+        if (!snapshot_restore(path, world->capacity, &loaded, &world->links, &world->contact_cache, &header)) {
+            shm_export_end(&connection->shm, world->count, world->stats.frame);
+            fail(connection, request->tag, "cannot load snapshot");
+            return;
+        }
+        memcpy(world->balls.radius, loaded.radius, header.count * sizeof(float));
+        memcpy(world->balls.x_pos, loaded.x_pos, header.count * sizeof(float));
+        memcpy(world->balls.y_pos, loaded.y_pos, header.count * sizeof(float));
+        memcpy(world->balls.x_vel, loaded.x_vel, header.count * sizeof(float));
+        memcpy(world->balls.y_vel, loaded.y_vel, header.count * sizeof(float));
+        memcpy(world->balls.mass, loaded.mass, header.count * sizeof(float));
+        balls_free(&loaded);
+
+        world->count = header.count;
+        world->rope_end = header.rope_end;
+        world->stats.frame = header.frame;
+        broadphase_resume(&world->broadphase, header.broadphase);
+        world_renumber(world);
+    }
+    shm_export_end(&connection->shm, world->count, world->stats.frame);
+    respond(connection, SERVER_OK, request->tag, world->count, NULL, 0);
+}
+
+static void spawn (struct Connection* connection, const struct ServerRequest* request) {
+    struct World* world = connection->world;
+    uint64_t count = request->arg;
+    if (request->size != count * 5 * sizeof(float)) {
+        fail(connection, request->tag, "payload must hold five floats per particle");
+        return;
+    }
+    if (count > (uint64_t)(world->capacity - world->count)) {
+        fail(connection, request->tag, "world is full");
+        return;
+    }
+
+    const float* x_pos = (const float*)connection->payload;
+    const float* y_pos = x_pos + count;
+    const float* x_vel = y_pos + count;
+    const float* y_vel = x_vel + count;
+    const float* radius = y_vel + count;
+
+    // The ids overwrite the payload they came from, which is no longer read
+    // by the time each is written.
+    int32_t* ids = (int32_t*)connection->payload;
+    shm_export_begin(&connection->shm);
+    for (uint64_t n = 0; n < count; n++) {
+        ids[n] = world_add(world, x_pos[n], y_pos[n], x_vel[n], y_vel[n], radius[n]);
+    }
+    shm_export_end(&connection->shm, world->count, world->stats.frame);
+    respond(connection, SERVER_OK, request->tag, count, ids, count * sizeof(int32_t));
+}
+
+static void step (struct Connection* connection, const struct ServerRequest* request) {
+    struct World* world = connection->world;
+    for (uint64_t frame = 0; frame < request->arg; frame++) {
+        shm_export_begin(&connection->shm);
+        world_step(world, 1);
+        shm_export_end(&connection->shm, world->count, world->stats.frame);
+    }
+    connection->frames += request->arg;
+    respond(connection, SERVER_OK, request->tag, world->stats.frame, NULL, 0);
+}
+
+// The arrays go out straight from the shared segment: sendfile where the
+// kernel can send from it, plain writes from the mapping elsewhere.
+static int fetch (struct Connection* connection, const struct ServerRequest* request) {
+    struct World* world = connection->world;
+    size_t field_size = world->count * sizeof(float);
+
+    int field_count = 0;
+    for (int field = 0; field < 5; field++) {
+        if (request->arg & (1u << field)) field_count++;
+    }
+
+    struct ServerResponse response = {SERVER_OK, request->tag, world->count, field_count * field_size};
+    queue(connection, &response, sizeof(response));
+    if (!flush(connection)) return 0;
+
+    for (int field = 0; field < 5; field++) {
+        if (!(request->arg & (1u << field))) continue;
+        off_t offset = connection->shm.header->field_offset[field];
+#ifdef __linux__
+        size_t left = field_size;
+        while (left > 0) {
+            ssize_t sent = sendfile(connection->socket, connection->shm.fd, &offset, left);
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent <= 0) return 0;
+            left -= sent;
+        }
+#else
+        if (!write_all(connection->socket, (const char*)connection->shm.header + offset, field_size)) return 0;
+#endif
+    }
+    return 1;
+}
+
+// Hands over the segment itself, so a client on the same machine can read
+// the world live under its seqlock instead of fetching.
+static int attach (struct Connection* connection, const struct ServerRequest* request) {
+    if (!flush(connection)) return 0;
+
+    struct ServerResponse response = {SERVER_OK, request->tag, connection->shm.header->size, 0};
+    struct iovec data = {&response, sizeof(response)};
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct msghdr message = {0};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &connection->shm.fd, sizeof(int));
+
+    return sendmsg(connection->socket, &message, 0) == sizeof(response);
+}
+
+static int handle (struct Connection* connection, const struct ServerRequest* request) {
+    switch (request->command) {
+    case SERVER_LOAD:
+        load_scene(connection, request);
+        return 1;
+    case SERVER_SPAWN:
+        spawn(connection, request);
+        return 1;
+    case SERVER_STEP:
+        step(connection, request);
+        return 1;
+    case SERVER_FETCH:
+        return fetch(connection, request);
+    case SERVER_ATTACH:
+        return attach(connection, request);
+    case SERVER_STATS: {
+        struct WorldStats stats;
+        world_stats(connection->world, &stats);
+        respond(connection, SERVER_OK, request->tag, 0, &stats, sizeof(stats));
+        return 1;
+    }
+    default:
+        fail(connection, request->tag, "unknown command");
+        return 1;
+    }
+}
+
+static void* serve_connection (void* arg) {
+    struct Connection* connection = arg;
+
+    for (;;) {
+        // Pipelined requests are answered in one write once the client has
+        // no more waiting.
+        int waiting = 0;
+        if (connection->output_size > 0 && (ioctl(connection->socket, FIONREAD, &waiting) != 0 || waiting == 0)) {
+            if (!flush(connection)) break;
+        }
+
+        struct ServerRequest request;
+        if (!read_all(connection->socket, &request, sizeof(request))) break;
+        if (request.size > SERVER_MAX_PAYLOAD) break;
+        connection->payload = grow(connection->payload, &connection->payload_capacity, request.size);
+        if (!read_all(connection->socket, connection->payload, request.size)) break;
+
+        connection->requests++;
+        if (!handle(connection, &request)) break;
+    }
+    flush(connection);
+
+    printf("Client %d left after %ld requests and %ld frames\n", connection->number, connection->requests, connection->frames);
+    fflush(stdout);
+    close(connection->socket);
+    shm_export_close(&connection->shm);
+    world_destroy(connection->world);
+    free(connection->payload);
+    free(connection->output);
+    free(connection);
+    return NULL;
+}
+
+int server_run (const char* path, const struct WorldConfig* config) {
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path %s is too long\n", path);
+        return 1;
+    }
+    strcpy(address.sun_path, path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 16) != 0) {
+        fprintf(stderr, "Could not listen on %s\n", path);
+        if (listener >= 0) close(listener);
+        return 1;
+    }
+
+    // No SA_RESTART, so an interrupt wakes accept and the loop can end.
+    struct sigaction action = {0};
+    action.sa_handler = handle_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("Serving on %s\n", path);
+    int number = 0;
+    while (!stopping) {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) continue;
+
+        struct Connection* connection = calloc(1, sizeof(struct Connection));
+        if (connection == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(1);
+        }
+        connection->socket = client;
+        connection->number = ++number;
+        connection->world = world_create(config);
+
+        // The segment is only reachable through the fd handed out by
+        // SERVER_ATTACH, so its name goes as soon as it exists.
+        char name[64];
+        snprintf(name, sizeof(name), "/particle_sim.%d.%d", (int)getpid(), number);
+        if (!shm_export_open(&connection->shm, name, &connection->world->balls, 0, config->capacity)) {
+            close(client);
+            world_destroy(connection->world);
+            free(connection);
+            continue;
+        }
+        shm_unlink(name);
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, serve_connection, connection) != 0) {
+            fprintf(stderr, "Could not start a thread for client %d\n", number);
+            close(client);
+            shm_export_close(&connection->shm);
+            world_destroy(connection->world);
+            free(connection);
+            continue;
+        }
+        pthread_detach(thread);
+        printf("Client %d connected\n", number);
+        fflush(stdout);
+    }
+
+    close(listener);
+    unlink(path);
+    return 0;
+}
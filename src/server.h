@@ -0,0 +1,55 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+
+#include "particles.h"
+
+// Binary protocol spoken over the --serve Unix socket. Every connection gets
+// a world of its own. A client sends requests back to back without waiting:
+// each is a ServerRequest followed by size bytes of payload, and the answers
+// come back in the same order, each a ServerResponse followed by size bytes.
+// tag is echoed so a client can match them up. Clients must keep reading
+// while they send, as with any pipelined protocol.
+//
+// Numbers are in host byte order; the socket never leaves the machine.
+#define SERVER_LOAD 1   // payload: snapshot path, or empty to clear the world
+#define SERVER_SPAWN 2  // arg: n; payload: n floats each of x, y, x_vel, y_vel, radius; payload back: n int32 ids
+#define SERVER_STEP 3   // arg: frames; value: frame reached
+#define SERVER_FETCH 4  // arg: mask of SERVER_FIELD bits; payload back: count floats per field, in bit order
+#define SERVER_ATTACH 5 // the world's shared-memory segment comes back as an SCM_RIGHTS fd; value: its size
+#define SERVER_STATS 6  // payload back: struct WorldStats
+
+// Field order matches the shared-memory segment (see shm_export.h).
+#define SERVER_FIELD_RADIUS (1 << 0)
+#define SERVER_FIELD_X_POS (1 << 1)
+#define SERVER_FIELD_Y_POS (1 << 2)
+#define SERVER_FIELD_X_VEL (1 << 3)
+#define SERVER_FIELD_Y_VEL (1 << 4)
+
+#define SERVER_OK 0
+#define SERVER_ERROR 1 // payload: message
+
+// Requests with more payload than this close the connection.
+#define SERVER_MAX_PAYLOAD (1u << 30)
+
+struct ServerRequest {
+    uint32_t command;
+    uint32_t tag;
+    uint64_t arg;
+    uint64_t size;
+};
+
+struct ServerResponse {
+    uint32_t status;
+    uint32_t tag;
+    uint64_t value;
+    uint64_t size;
+};
+
+// Listens on path until interrupted, serving each connection on its own
+// thread with a world made from config. Returns non-zero if the socket
+// cannot be opened.
+int server_run (const char* path, const struct WorldConfig* config);
+
+#endif
@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "shm_export.h"
+
+static uint64_t align_up (uint64_t size) {
+    return (size + SHM_ALIGN - 1) / SHM_ALIGN * SHM_ALIGN;
+}
+
+int shm_export_open (struct ShmExport* shm, const char* name, struct Balls* balls, int count, int capacity) {
+    snprintf(shm->name, sizeof(shm->name), "%s", name);
+
+    struct ShmHeader layout;
+    memset(&layout, 0, sizeof(layout));
+    layout.magic = SHM_MAGIC;
+    layout.version = SHM_VERSION;
+    layout.header_size = sizeof(struct ShmHeader);
+    layout.align = SHM_ALIGN;
+    layout.capacity = capacity;
+    layout.count = count;
+    uint64_t offset = align_up(sizeof(struct ShmHeader));
+    for (int field = 0; field < SHM_FIELDS; field++) {
+        layout.field_offset[field] = offset;
+        offset += align_up((uint64_t)capacity * sizeof(float));
+    }
+    layout.size = offset;
+
+    // A segment left behind by a crashed run is replaced, not reused.
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Could not create shared memory %s\n", name);
+        return 0;
+    }
+    if (ftruncate(fd, layout.size) != 0) {
+        fprintf(stderr, "Could not size shared memory %s\n", name);
+        close(fd);
+        shm_unlink(name);
+        return 0;
+    }
+    unsigned char* base = mmap(NULL, layout.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Could not map shared memory %s\n", name);
+        close(fd);
+        shm_unlink(name);
+        return 0;
+    }
+
+    shm->fd = fd;
+    shm->header = (struct ShmHeader*)base;
+    memcpy(shm->header, &layout, offsetof(struct ShmHeader, sequence));
+    atomic_init(&shm->header->sequence, 0);
+
+    const float* fields[SHM_FIELDS] = {balls->radius, balls->x_pos, balls->y_pos, balls->x_vel, balls->y_vel, balls->mass};
+    float* shared[SHM_FIELDS];
+    for (int field = 0; field < SHM_FIELDS; field++) {
+        shared[field] = (float*)(base + layout.field_offset[field]);
+        memcpy(shared[field], fields[field], count * sizeof(float));
+    }
+
+    balls_free(balls);
+    balls->radius = shared[0];
+    balls->x_pos = shared[1];
+    balls->y_pos = shared[2];
+    balls->x_vel = shared[3];
+    balls->y_vel = shared[4];
+    balls->mass = shared[5];
+    balls->mapping = base;
+    balls->mapping_size = layout.size;
+
+    shm_export_end(shm, count, 0);
+    return 1;
+}
+
+void shm_export_close (struct ShmExport* shm) {
+    shm_unlink(shm->name);
+    close(shm->fd);
+}
+
+void shm_export_begin (struct ShmExport* shm) {
+    uint64_t sequence = atomic_load_explicit(&shm->header->sequence, memory_order_relaxed);
+    if (sequence & 1) return;
+    atomic_store_explicit(&shm->header->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+void shm_export_end (struct ShmExport* shm, int count, long frame) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    uint64_t sequence = atomic_load_explicit(&shm->header->sequence, memory_order_relaxed);
+    shm->header->count = count;
+    shm->header->frame = frame;
+    shm->header->published_ns = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    atomic_store_explicit(&shm->header->sequence, (sequence | 1) + 1, memory_order_release);
+}
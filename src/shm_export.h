@@ -0,0 +1,61 @@
+#ifndef SHM_EXPORT_H
+#define SHM_EXPORT_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "balls.h"
+
+#define SHM_MAGIC 0x4d485350u // "PSHM" on little-endian machines
+#define SHM_VERSION 1
+#define SHM_ALIGN 16384
+#define SHM_FIELDS 6
+
+// Shared-memory segment layout: this header, then radius, x_pos, y_pos,
+// x_vel, y_vel and mass as capacity floats each, every field on an
+// SHM_ALIGN boundary at field_offset. The simulation steps these arrays in
+// place, so other processes map the live state without anything copied.
+//
+// sequence is a seqlock: odd while the simulator is changing the balls, even
+// once a frame is complete. A reader takes sequence, reads frame, count and
+// whatever arrays it needs, and keeps the result only if sequence is still
+// the same even value; otherwise it reads again. The simulator never waits
+// for readers.
+struct ShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t align;
+    int32_t capacity;
+    int32_t count;
+    int64_t frame;
+    // CLOCK_MONOTONIC time the frame was completed, in nanoseconds.
+    int64_t published_ns;
+    uint64_t field_offset[SHM_FIELDS];
+    uint64_t size;
+    _Atomic uint64_t sequence;
+};
+
+// fd stays open, so the segment can be passed to another process or sent
+// from even after its name is gone.
+struct ShmExport {
+    char name[256];
+    int fd;
+    struct ShmHeader* header;
+};
+
+// Creates the segment, moves the balls into it and points them there; the
+// balls own the mapping from then on, as with a restored snapshot. Returns 0
+// if the segment cannot be created.
+int shm_export_open (struct ShmExport* shm, const char* name, struct Balls* balls, int count, int capacity);
+
+// Removes the name and closes fd; readers already attached keep their
+// mapping.
+void shm_export_close (struct ShmExport* shm);
+
+// Brackets every change to the balls.
+void shm_export_begin (struct ShmExport* shm);
+void shm_export_end (struct ShmExport* shm, int count, long frame);
+
+#endif
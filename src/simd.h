@@ -0,0 +1,60 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// 4-wide float vectors on top of the GCC/Clang vector extensions, so the same
+// kernels compile to SSE on x86 and NEON on Apple Silicon.
+
+#define SIMD_WIDTH 4
+
+typedef float vfloat __attribute__((vector_size(16)));
+typedef int vmask __attribute__((vector_size(16)));
+
+static inline vfloat vsplat (float value) {
+    return (vfloat){value, value, value, value};
+}
+
+static inline vfloat vload (const float* src) {
+    vfloat v;
+    memcpy(&v, src, sizeof(v));
+    return v;
+}
+
+static inline void vstore (float* dst, vfloat v) {
+    memcpy(dst, &v, sizeof(v));
+}
+
+// Lanes where mask is set take a, the others take b.
+static inline vfloat vselect (vmask mask, vfloat a, vfloat b) {
+    return (vfloat)(((vmask)a & mask) | ((vmask)b & ~mask));
+}
+
+static inline vfloat vmin (vfloat a, vfloat b) {
+    return vselect(a < b, a, b);
+}
+
+static inline vfloat vmax (vfloat a, vfloat b) {
+    return vselect(a > b, a, b);
+}
+
+static inline vfloat vsqrt (vfloat v) {
+#if defined(__SSE__)
+    return (vfloat)_mm_sqrt_ps((__m128)v);
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    return (vfloat)vsqrtq_f32((float32x4_t)v);
+#else
+    vfloat r;
+    for (int i = 0; i < SIMD_WIDTH; i++) r[i] = sqrtf(v[i]);
+    return r;
+#endif
+}
+
+#endif
@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "snapshot.h"
+
+static uint64_t align_up (uint64_t size) {
+    return (size + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+}
+
+// Fills in the section offsets and file size from the section sizes.
+static void layout (struct SnapshotHeader* header) {
+    uint64_t offset = align_up(sizeof(struct SnapshotHeader));
+    for (int field = 0; field < SNAPSHOT_FIELDS; field++) {
+        header->field_offset[field] = offset;
+        offset += align_up((uint64_t)header->capacity * sizeof(float));
+    }
+    header->links_offset = offset;
+    offset += align_up((uint64_t)header->link_count * sizeof(struct Link));
+    header->cache_offset = offset;
+    offset += align_up((uint64_t)header->cache_capacity * sizeof(struct CacheEntry));
+    header->file_size = offset;
+}
+
+static float** fields_of (struct Balls* balls, float** fields) {
+    fields[0] = balls->radius;
+    fields[1] = balls->x_pos;
+    fields[2] = balls->y_pos;
+    fields[3] = balls->x_vel;
+    fields[4] = balls->y_vel;
+    fields[5] = balls->mass;
+    return fields;
+}
+
+static int write_all (int fd, const void* data, size_t size, uint64_t offset) {
+    const char* bytes = data;
+    while (size > 0) {
+        ssize_t written = pwrite(fd, bytes, size, offset);
+        if (written < 0) return 0;
+        bytes += written;
+        size -= written;
+        offset += written;
+    }
+    return 1;
+}
+
+// Writes to a temporary file and renames it over path, so a crash mid-write
+// never leaves a torn snapshot behind.
+static void write_snapshot (struct SnapshotWriter* writer) {
+    struct SnapshotHeader* header = &writer->header;
+    char temp_path[sizeof(writer->path) + 4];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", writer->path);
+
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening file %s\n", temp_path);
+        return;
+    }
+
+    // Padding and the unused tail of each field read back as zeros.
+    int ok = ftruncate(fd, header->file_size) == 0;
+    ok = ok && write_all(fd, header, sizeof(*header), 0);
+
+    float* fields[SNAPSHOT_FIELDS];
+    fields_of(&writer->staging, fields);
+    for (int field = 0; field < SNAPSHOT_FIELDS && ok; field++) {
+        ok = write_all(fd, fields[field], header->count * sizeof(float), header->field_offset[field]);
+    }
+    ok = ok && write_all(fd, writer->links, header->link_count * sizeof(struct Link), header->links_offset);
+    ok = ok && write_all(fd, writer->cache, header->cache_capacity * sizeof(struct CacheEntry), header->cache_offset);
+
+    close(fd);
+    if (!ok || rename(temp_path, writer->path) != 0) {
+        fprintf(stderr, "Error writing snapshot %s\n", writer->path);
+        unlink(temp_path);
+    }
+}
+
+static void* writer_main (void* arg) {
+    struct SnapshotWriter* writer = arg;
+
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        while (!writer->pending && !writer->quitting) {
+            pthread_cond_wait(&writer->wake, &writer->lock);
+        }
+        if (!writer->pending) break;
+
+        pthread_mutex_unlock(&writer->lock);
+        write_snapshot(writer);
+        pthread_mutex_lock(&writer->lock);
+
+        writer->pending = 0;
+        writer->written++;
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+void snapshot_writer_start (struct SnapshotWriter* writer, int capacity) {
+    memset(writer, 0, sizeof(*writer));
+    balls_alloc(&writer->staging, capacity);
+    writer->header.capacity = capacity;
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->wake, NULL);
+    if (pthread_create(&writer->thread, NULL, writer_main, writer) != 0) {
+        fprintf(stderr, "Could not start snapshot writer\n");
+        exit(1);
+    }
+}
+
+// Finishes a snapshot that is still being written before returning.
+void snapshot_writer_stop (struct SnapshotWriter* writer) {
+    pthread_mutex_lock(&writer->lock);
+    writer->quitting = 1;
+    pthread_cond_signal(&writer->wake);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->wake);
+    balls_free(&writer->staging);
+    free(writer->links);
+    free(writer->cache);
+}
+
+int snapshot_request (struct SnapshotWriter* writer, const char* path, const struct Balls* balls, int count,
+                      const struct Links* links, const struct ContactCache* cache, int rope_end, int broadphase, long frame) {
+    pthread_mutex_lock(&writer->lock);
+    int busy = writer->pending;
+    if (busy) writer->skipped++;
+    pthread_mutex_unlock(&writer->lock);
+    if (busy) return 0;
+
+    // The writer only reads the staging area while a request is pending, so
+    // it can be filled without holding the lock.
+    float* from[SNAPSHOT_FIELDS];
+    float* to[SNAPSHOT_FIELDS];
+    fields_of((struct Balls*)balls, from);
+    fields_of(&writer->staging, to);
+    for (int field = 0; field < SNAPSHOT_FIELDS; field++) {
+        memcpy(to[field], from[field], count * sizeof(float));
+    }
+
+    if (links->count > writer->link_capacity) {
+        writer->link_capacity = links->count;
+        writer->links = realloc(writer->links, writer->link_capacity * sizeof(struct Link));
+        if (writer->links == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(1);
+        }
+    }
+    memcpy(writer->links, links->links, links->count * sizeof(struct Link));
+
+    if (cache->capacity > writer->cache_capacity) {
+        writer->cache_capacity = cache->capacity;
+        writer->cache = realloc(writer->cache, writer->cache_capacity * sizeof(struct CacheEntry));
+        if (writer->cache == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(1);
+        }
+    }
+    memcpy(writer->cache, cache->entries, cache->capacity * sizeof(struct CacheEntry));
+
+    struct SnapshotHeader* header = &writer->header;
+    header->magic = SNAPSHOT_MAGIC;
+    header->version = SNAPSHOT_VERSION;
+    header->header_size = sizeof(struct SnapshotHeader);
+    header->align = SNAPSHOT_ALIGN;
+    header->count = count;
+    header->link_count = links->count;
+    header->rope_end = rope_end;
+    header->broadphase = broadphase;
+    header->cache_capacity = cache->capacity;
+    header->frame = frame;
+    layout(header);
+    snprintf(writer->path, sizeof(writer->path), "%s", path);
+
+    pthread_mutex_lock(&writer->lock);
+    writer->pending = 1;
+    pthread_cond_signal(&writer->wake);
+    pthread_mutex_unlock(&writer->lock);
+    return 1;
+}
+
+int snapshot_restore (const char* path, int capacity, struct Balls* balls, struct Links* links,
+                      struct ContactCache* cache, struct SnapshotHeader* header) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening file %s\n", path);
+        return 0;
+    }
+
+    struct stat info;
+    struct SnapshotHeader file_header;
+    if (fstat(fd, &info) != 0 || pread(fd, &file_header, sizeof(file_header), 0) != sizeof(file_header)) {
+        fprintf(stderr, "Error reading snapshot %s\n", path);
+        close(fd);
+        return 0;
+    }
+
+    // The offsets are recomputed rather than trusted, so a corrupt header
+    // cannot point the fields outside the mapping.
+    struct SnapshotHeader expected = file_header;
+    layout(&expected);
+    if (file_header.magic != SNAPSHOT_MAGIC || file_header.version != SNAPSHOT_VERSION ||
+        file_header.header_size != sizeof(file_header) || file_header.align != SNAPSHOT_ALIGN ||
+        file_header.capacity != capacity || file_header.count < 0 || file_header.count > capacity ||
+        file_header.link_count < 0 || file_header.cache_capacity < 0 ||
+        (file_header.cache_capacity & (file_header.cache_capacity - 1)) != 0 || memcmp(&expected, &file_header, sizeof(file_header)) != 0 ||
+        (uint64_t)info.st_size < file_header.file_size) {
+        fprintf(stderr, "Snapshot %s is not a version %d snapshot for %d balls\n", path, SNAPSHOT_VERSION, capacity);
+        close(fd);
+        return 0;
+    }
+
+    // Private mapping: pages are read on first touch and copied on first
+    // write, so restoring costs nothing up front.
+    char* base = mmap(NULL, file_header.file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Could not map snapshot %s\n", path);
+        return 0;
+    }
+
+    const struct Link* file_links = (const struct Link*)(base + file_header.links_offset);
+    for (int n = 0; n < file_header.link_count; n++) {
+        if (file_links[n].a < 0 || file_links[n].a >= file_header.count ||
+            file_links[n].b < 0 || file_links[n].b >= file_header.count) {
+            fprintf(stderr, "Snapshot %s links a missing ball\n", path);
+            munmap(base, file_header.file_size);
+            return 0;
+        }
+    }
+
+    balls_free(balls);
+    balls->radius = (float*)(base + file_header.field_offset[0]);
+    balls->x_pos = (float*)(base + file_header.field_offset[1]);
+    balls->y_pos = (float*)(base + file_header.field_offset[2]);
+    balls->x_vel = (float*)(base + file_header.field_offset[3]);
+    balls->y_vel = (float*)(base + file_header.field_offset[4]);
+    balls->mass = (float*)(base + file_header.field_offset[5]);
+    balls->mapping = base;
+    balls->mapping_size = file_header.file_size;
+
+    links->count = 0;
+    links->coloured = 0;
+    for (int n = 0; n < file_header.link_count; n++) {
+        links_add(links, file_links[n].a, file_links[n].b, file_links[n].rest_length, file_links[n].compliance);
+    }
+
+    contact_cache_free(cache);
+    cache->entries = NULL;
+    cache->capacity = file_header.cache_capacity;
+    if (cache->capacity > 0) {
+        cache->entries = malloc(cache->capacity * sizeof(struct CacheEntry));
+        if (cache->entries == NULL) {
+            fprintf(stderr, "Memory allocation error\n");
+            exit(1);
+        }
+        memcpy(cache->entries, base + file_header.cache_offset, cache->capacity * sizeof(struct CacheEntry));
+    }
+
+    *header = file_header;
+    return 1;
+}
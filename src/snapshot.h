@@ -0,0 +1,81 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "balls.h"
+#include "contact_cache.h"
+#include "links.h"
+
+#define SNAPSHOT_MAGIC 0x504e5350u // "PSNP" on little-endian machines
+#define SNAPSHOT_VERSION 1
+
+// Every section starts on this boundary, which is a whole number of pages on
+// both 4K (x86) and 16K (Apple Silicon) systems, so a mapped file can be
+// adopted field by field.
+#define SNAPSHOT_ALIGN 16384
+
+#define SNAPSHOT_FIELDS 6
+
+// File layout: this header, then radius, x_pos, y_pos, x_vel, y_vel and mass
+// as capacity floats each, then link_count links, then the warm-start cache
+// table so a resumed run continues exactly where it stopped. Sections are
+// padded to SNAPSHOT_ALIGN and their offsets recorded below, so later
+// versions can add sections without moving the old ones.
+struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t align;
+    int32_t capacity;
+    int32_t count;
+    int32_t link_count;
+    int32_t rope_end;
+    int32_t cache_capacity;
+    // The broadphase strategy in use, 0 if none had been chosen.
+    int32_t broadphase;
+    int64_t frame;
+    uint64_t field_offset[SNAPSHOT_FIELDS];
+    uint64_t links_offset;
+    uint64_t cache_offset;
+    uint64_t file_size;
+};
+
+// Writes snapshots on its own thread. A request copies the state into a
+// staging area and returns; the disk write happens in the background.
+struct SnapshotWriter {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int pending;
+    int quitting;
+
+    char path[256];
+    struct SnapshotHeader header;
+    struct Balls staging;
+    struct Link* links;
+    int link_capacity;
+    struct CacheEntry* cache;
+    int cache_capacity;
+
+    long written;
+    long skipped;
+};
+
+void snapshot_writer_start (struct SnapshotWriter* writer, int capacity);
+void snapshot_writer_stop (struct SnapshotWriter* writer);
+
+// Queues a snapshot of the first count balls. Returns 0 and counts it as
+// skipped if the previous one is still being written.
+int snapshot_request (struct SnapshotWriter* writer, const char* path, const struct Balls* balls, int count,
+                      const struct Links* links, const struct ContactCache* cache, int rope_end, int broadphase, long frame);
+
+// Maps the file and points balls' fields straight at it (copy-on-write, so
+// stepping never touches the file). Links and the cache are small and are
+// copied. Returns 0 and leaves everything untouched if the file is missing,
+// from another version or built for a different capacity.
+int snapshot_restore (const char* path, int capacity, struct Balls* balls, struct Links* links,
+                      struct ContactCache* cache, struct SnapshotHeader* header);
+
+#endif
@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "sph.h"
+#include "jobs.h"
+
+#define SPH_GRAIN 256
+
+// 2D kernel normalisations for the poly6 and spiky kernels.
+#define POLY6_SCALE ((float)(4.0 / (M_PI * SPH_SMOOTHING_RADIUS * SPH_SMOOTHING_RADIUS * SPH_SMOOTHING_RADIUS * SPH_SMOOTHING_RADIUS * SPH_SMOOTHING_RADIUS * SPH_SMOOTHING_RADIUS * SPH_SMOOTHING_RADIUS * SPH_SMOOTHING_RADIUS)))
+#define SPIKY_SCALE ((float)(-30.0 / (M_PI * SPH_SMOOTHING_RADIUS * SPH_SMOOTHING_RADIUS * SPH_SMOOTHING_RADIUS * SPH_SMOOTHING_RADIUS * SPH_SMOOTHING_RADIUS)))
+
+struct SphPass {
+    struct Sph* sph;
+    struct Balls* balls;
+    int count;
+    float gravity;
+};
+
+static inline float poly6 (float r2) {
+    float h2 = SPH_SMOOTHING_RADIUS * SPH_SMOOTHING_RADIUS;
+    if (r2 >= h2) return 0.0f;
+    float d = h2 - r2;
+    return POLY6_SCALE * d * d * d;
+}
+
+// Magnitude of the spiky gradient divided by r, so grad W = spiky_grad(r) * (dx, dy).
+static inline float spiky_grad (float r) {
+    if (r >= SPH_SMOOTHING_RADIUS || r <= 0.0f) return 0.0f;
+    float d = SPH_SMOOTHING_RADIUS - r;
+    return SPIKY_SCALE * d * d / r;
+}
+
+float sph_spacing () {
+    return 0.5f * SPH_SMOOTHING_RADIUS;
+}
+
+static float* alloc_field (int capacity) {
+    float* field = (float*)calloc(capacity, sizeof(float));
+    if (field == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(1);
+    }
+    return field;
+}
+
+void sph_init (struct Sph* sph, int capacity) {
+    sph->capacity = capacity;
+    sph->x_prev = alloc_field(capacity);
+    sph->y_prev = alloc_field(capacity);
+    sph->density = alloc_field(capacity);
+    sph->lambda = alloc_field(capacity);
+    sph->x_delta = alloc_field(capacity);
+    sph->y_delta = alloc_field(capacity);
+
+    // Sum the kernel over a square lattice at rest spacing. The mass makes the
+    // rest density exactly 1, and the gradient sum sets the scale of lambda.
+    float spacing = sph_spacing();
+    int reach = (int)(SPH_SMOOTHING_RADIUS / spacing) + 1;
+    float kernel_sum = 0.0f;
+    float grad_sum = 0.0f;
+    for (int gy = -reach; gy <= reach; gy++) {
+        for (int gx = -reach; gx <= reach; gx++) {
+            float dx = gx * spacing;
+            float dy = gy * spacing;
+            float r2 = dx * dx + dy * dy;
+            float grad = spiky_grad(sqrtf(r2));
+            kernel_sum += poly6(r2);
+            grad_sum += grad * grad * r2;
+        }
+    }
+    sph->particle_mass = 1.0f / kernel_sum;
+    sph->lambda_scale = 1.0f / (sph->particle_mass * sph->particle_mass * grad_sum);
+}
+
+void sph_free (struct Sph* sph) {
+    grid_free(&sph->grid);
+    free(sph->x_prev);
+    free(sph->y_prev);
+    free(sph->density);
+    free(sph->lambda);
+    free(sph->x_delta);
+    free(sph->y_delta);
+}
+
+// Overshoot is mirrored back inside rather than snapped onto the wall, so
+// particles pushed into a corner together do not end up on the same point,
+// where the kernel gradient has no direction to separate them.
+static inline float clamp_to_walls (float pos, float radius) {
+    float low = -1.0f + radius;
+    float high = 1.0f - radius;
+    if (pos < low) return fminf(low + 0.5f * (low - pos), low + radius);
+    if (pos > high) return fmaxf(high - 0.5f * (pos - high), high - radius);
+    return pos;
+}
+
+static void predict_pass (void* context, int begin, int end) {
+    struct SphPass* pass = context;
+    struct Sph* sph = pass->sph;
+    struct Balls* balls = pass->balls;
+
+    for (int i = begin; i < end; i++) {
+        sph->x_prev[i] = balls->x_pos[i];
+        sph->y_prev[i] = balls->y_pos[i];
+        balls->y_vel[i] += pass->gravity;
+        balls->x_pos[i] = clamp_to_walls(balls->x_pos[i] + balls->x_vel[i], balls->radius[i]);
+        balls->y_pos[i] = clamp_to_walls(balls->y_pos[i] + balls->y_vel[i], balls->radius[i]);
+    }
+}
+
+// Visits every particle within the smoothing radius of i, including i itself.
+#define FOR_EACH_NEIGHBOUR(sph, balls, i, j, dx, dy, r2, body) \
+    do { \
+        const struct Grid* grid_ = &(sph)->grid; \
+        int cx_ = grid_->ball_cell[i] % grid_->cells_per_side; \
+        int cy_ = grid_->ball_cell[i] / grid_->cells_per_side; \
+        for (int ny_ = cy_ - 1; ny_ <= cy_ + 1; ny_++) { \
+            if (ny_ < 0 || ny_ >= grid_->cells_per_side) continue; \
+            for (int nx_ = cx_ - 1; nx_ <= cx_ + 1; nx_++) { \
+                if (nx_ < 0 || nx_ >= grid_->cells_per_side) continue; \
+                int cell_ = ny_ * grid_->cells_per_side + nx_; \
+                for (int k_ = grid_->cell_start[cell_]; k_ < grid_->cell_start[cell_ + 1]; k_++) { \
+                    int j = grid_->items[k_]; \
+                    float dx = (balls)->x_pos[i] - (balls)->x_pos[j]; \
+                    float dy = (balls)->y_pos[i] - (balls)->y_pos[j]; \
+                    float r2 = dx * dx + dy * dy; \
+                    if (r2 >= SPH_SMOOTHING_RADIUS * SPH_SMOOTHING_RADIUS) continue; \
+                    body \
+                } \
+            } \
+        } \
+    } while (0)
+
+static void density_pass (void* context, int begin, int end) {
+    struct SphPass* pass = context;
+    struct Sph* sph = pass->sph;
+    struct Balls* balls = pass->balls;
+    float mass = sph->particle_mass;
+
+    for (int k = begin; k < end; k++) {
+        int i = sph->grid.items[k];
+        float density = 0.0f;
+        float grad_x = 0.0f, grad_y = 0.0f;
+        float grad_norms = 0.0f;
+
+        FOR_EACH_NEIGHBOUR(sph, balls, i, j, dx, dy, r2, {
+            density += mass * poly6(r2);
+            if (j != i) {
+                float grad = mass * spiky_grad(sqrtf(r2));
+                grad_x += grad * dx;
+                grad_y += grad * dy;
+                grad_norms += grad * grad * r2;
+            }
+        });
+
+        // Only compression is corrected; a free surface must not pull inward.
+        float constraint = density - 1.0f;
+        if (constraint < 0.0f) constraint = 0.0f;
+
+        grad_norms += grad_x * grad_x + grad_y * grad_y;
+        sph->density[i] = density;
+        sph->lambda[i] = -constraint / (grad_norms + SPH_RELAXATION / sph->lambda_scale);
+    }
+}
+
+static void pressure_pass (void* context, int begin, int end) {
+    struct SphPass* pass = context;
+    struct Sph* sph = pass->sph;
+    struct Balls* balls = pass->balls;
+    float mass = sph->particle_mass;
+    float reference = poly6(0.04f * SPH_SMOOTHING_RADIUS * SPH_SMOOTHING_RADIUS);
+
+    for (int k = begin; k < end; k++) {
+        int i = sph->grid.items[k];
+        float delta_x = 0.0f, delta_y = 0.0f;
+
+        FOR_EACH_NEIGHBOUR(sph, balls, i, j, dx, dy, r2, {
+            if (j != i) {
+                // Artificial pressure keeps particles from clumping in pairs.
+                float ratio = poly6(r2) / reference;
+                float correction = -SPH_TENSILE * sph->lambda_scale * ratio * ratio * ratio * ratio;
+                float grad = mass * spiky_grad(sqrtf(r2));
+                float scale = (sph->lambda[i] + sph->lambda[j] + correction) * grad;
+                delta_x += scale * dx;
+                delta_y += scale * dy;
+            }
+        });
+
+        sph->x_delta[i] = delta_x;
+        sph->y_delta[i] = delta_y;
+    }
+}
+
+static void apply_delta_pass (void* context, int begin, int end) {
+    struct SphPass* pass = context;
+    struct Sph* sph = pass->sph;
+    struct Balls* balls = pass->balls;
+
+    for (int i = begin; i < end; i++) {
+        balls->x_pos[i] = clamp_to_walls(balls->x_pos[i] + sph->x_delta[i], balls->radius[i]);
+        balls->y_pos[i] = clamp_to_walls(balls->y_pos[i] + sph->y_delta[i], balls->radius[i]);
+        balls->x_vel[i] = balls->x_pos[i] - sph->x_prev[i];
+        balls->y_vel[i] = balls->y_pos[i] - sph->y_prev[i];
+    }
+}
+
+static void viscosity_pass (void* context, int begin, int end) {
+    struct SphPass* pass = context;
+    struct Sph* sph = pass->sph;
+    struct Balls* balls = pass->balls;
+    float mass = sph->particle_mass;
+
+    for (int k = begin; k < end; k++) {
+        int i = sph->grid.items[k];
+        float dv_x = 0.0f, dv_y = 0.0f;
+
+        FOR_EACH_NEIGHBOUR(sph, balls, i, j, dx, dy, r2, {
+            float weight = mass * poly6(r2);
+            dv_x += (balls->x_vel[j] - balls->x_vel[i]) * weight;
+            dv_y += (balls->y_vel[j] - balls->y_vel[i]) * weight;
+        });
+
+        sph->x_delta[i] = SPH_VISCOSITY * dv_x;
+        sph->y_delta[i] = SPH_VISCOSITY * dv_y;
+    }
+}
+
+static void apply_viscosity_pass (void* context, int begin, int end) {
+    struct SphPass* pass = context;
+    struct Sph* sph = pass->sph;
+    struct Balls* balls = pass->balls;
+
+    for (int i = begin; i < end; i++) {
+        balls->x_vel[i] += sph->x_delta[i];
+        balls->y_vel[i] += sph->y_delta[i];
+    }
+}
+
+void sph_step (struct Sph* sph, struct Balls* balls, int count, float gravity) {
+    if (count > sph->capacity) {
+        fprintf(stderr, "SPH buffers hold %d particles, got %d\n", sph->capacity, count);
+        exit(1);
+    }
+
+    struct SphPass pass = {sph, balls, count, gravity};
+
+    parallel_for(count, SPH_GRAIN, predict_pass, &pass);
+    grid_build(&sph->grid, balls->x_pos, balls->y_pos, count, SPH_SMOOTHING_RADIUS);
+
+    // Neighbours are found once on the predicted positions and reused by
+    // every pass; particles move far less than a cell per frame.
+    for (int iteration = 0; iteration < SPH_ITERATIONS; iteration++) {
+        parallel_for(count, SPH_GRAIN, density_pass, &pass);
+        parallel_for(count, SPH_GRAIN, pressure_pass, &pass);
+        parallel_for(count, SPH_GRAIN, apply_delta_pass, &pass);
+    }
+
+    parallel_for(count, SPH_GRAIN, viscosity_pass, &pass);
+    parallel_for(count, SPH_GRAIN, apply_viscosity_pass, &pass);
+}
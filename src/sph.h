@@ -0,0 +1,41 @@
+#ifndef SPH_H
+#define SPH_H
+
+#include "balls.h"
+#include "broadphase.h"
+
+// Position-based fluids: SPH density estimates drive a density constraint
+// that is relaxed a few times per frame, which stays stable at one step per
+// frame where explicit pressure forces would need dozens of substeps.
+#define SPH_SMOOTHING_RADIUS 0.01f
+#define SPH_ITERATIONS 4
+#define SPH_RELAXATION 0.01f
+#define SPH_TENSILE 0.001f
+#define SPH_VISCOSITY 0.05f
+
+struct Sph {
+    struct Grid grid;
+    int capacity;
+    float* x_prev;
+    float* y_prev;
+    float* density;
+    float* lambda;
+    float* x_delta;
+    float* y_delta;
+
+    // Derived from a particle lattice at rest spacing in sph_init.
+    float particle_mass;
+    float lambda_scale;
+};
+
+void sph_init (struct Sph* sph, int capacity);
+void sph_free (struct Sph* sph);
+
+// Rest spacing between fluid particles; also twice their drawn radius.
+float sph_spacing ();
+
+// Advances the fluid one frame. Takes the place of integrate_balls' move
+// pass for these particles; wall bounces are still left to its walls pass.
+void sph_step (struct Sph* sph, struct Balls* balls, int count, float gravity);
+
+#endif
@@ -0,0 +1,59 @@
+#include <stdio.h>
+
+#include "contacts.h"
+#include "stats.h"
+
+void stats_begin_frame (struct SimStats* stats) {
+    stats->frame++;
+    stats->pairs = 0;
+    stats->max_overlap = 0.0f;
+    stats->cache_lookups = 0;
+    stats->cache_hits = 0;
+    stats->island_count = 0;
+    stats->largest_island = 0;
+}
+
+void stats_record_islands (struct SimStats* stats, const struct Islands* islands) {
+    stats->island_count = islands->count;
+    stats->largest_island = islands->count > 0 ? islands->items[0].ball_count : 0;
+    for (int b = 0; b < ISLAND_BUCKETS; b++) {
+        stats->island_histogram[b] = islands->histogram[b];
+    }
+}
+
+void stats_print (const struct SimStats* stats) {
+    float hit_rate = stats->cache_lookups > 0 ? 100.0f * stats->cache_hits / stats->cache_lookups : 0.0f;
+    printf("frame %ld: %d balls, %d pairs, %d iterations, max overlap %.5f, cache hits %.1f%%, energy %.6g\n",
+           stats->frame, stats->balls, stats->pairs, stats->solver_iterations, stats->max_overlap, hit_rate, stats->kinetic_energy);
+
+    if (stats->island_count > 0) {
+        printf("  %d islands, largest %d balls, sizes", stats->island_count, stats->largest_island);
+        for (int b = 0; b < ISLAND_BUCKETS; b++) {
+            if (stats->island_histogram[b] == 0) continue;
+            if (b == ISLAND_BUCKETS - 1) {
+                printf(" >%d:%d", 1 << b, stats->island_histogram[b]);
+            } else {
+                printf(" <=%d:%d", 2 << b, stats->island_histogram[b]);
+            }
+        }
+        printf(", %s kernel", contact_kernel_name(stats->contact_kernel));
+        if (stats->contact_kernel == CONTACT_KERNEL_CLASSES) printf(" (%d classes)", stats->radius_classes);
+        printf("\n");
+    }
+
+    if (stats->rewind_bytes > 0) {
+        printf("  rewind %.1f MB, %ld frames back, last restore %.2f ms\n", stats->rewind_bytes / 1048576.0,
+               stats->rewind_frames, stats->restore_ms);
+    }
+
+    if (stats->recording) {
+        const struct RecorderCounters* recorder = &stats->recorder;
+        float ratio = recorder->written_bytes > 0.0 ? recorder->raw_bytes / recorder->written_bytes : 0.0f;
+        printf("  recorded %ld frames, dropped %ld, writer queue %d (peak %d), ratio %.2fx", recorder->frames_recorded,
+               recorder->frames_dropped, recorder->queue_depth, recorder->queue_peak, ratio);
+        if (recorder->encode_seconds > 0.0) {
+            printf(", encode %.0f MB/s", recorder->raw_bytes / recorder->encode_seconds / 1e6);
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+
+#include "islands.h"
+#include "recorder.h"
+
+// Printed every STATS_INTERVAL frames.
+#define STATS_INTERVAL 60
+
+struct SimStats {
+    long frame;
+    int balls;
+    int pairs;
+    int solver_iterations;
+    double kinetic_energy;
+
+    // Deepest overlap left after the contact solve, worst substep of the frame.
+    float max_overlap;
+
+    // Contacts looked up in the warm-start cache, and how many were found.
+    long cache_lookups;
+    long cache_hits;
+
+    // Islands of the last substep, binned by ball count (see ISLAND_BUCKETS).
+    int island_count;
+    int largest_island;
+    int island_histogram[ISLAND_BUCKETS];
+
+    // The contact kernel picked for the scene (see CONTACT_KERNEL_GENERAL)
+    // and how many kinds of ball the class kernel has.
+    int contact_kernel;
+    int radius_classes;
+
+    // Rewind history: memory held, frames it reaches back, and how long the
+    // last rewind took.
+    size_t rewind_bytes;
+    long rewind_frames;
+    double restore_ms;
+
+    // Trajectory recorder, when --record is on.
+    int recording;
+    struct RecorderCounters recorder;
+};
+
+void stats_begin_frame (struct SimStats* stats);
+void stats_record_islands (struct SimStats* stats, const struct Islands* islands);
+void stats_print (const struct SimStats* stats);
+
+#endif
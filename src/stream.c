@@ -0,0 +1,301 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "stream.h"
+
+static double seconds_now () {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void* alloc_or_die (size_t size) {
+    void* data = malloc(size);
+    if (data == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(1);
+    }
+    return data;
+}
+
+// Largest frame, header included, that a stream of capacity balls can carry.
+static size_t max_frame_size (int capacity) {
+    int slices = codec_slice_count(capacity);
+    return sizeof(struct FrameHeader) + slices * (sizeof(uint32_t) + codec_max_slice_size());
+}
+
+static void set_nonblocking (int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+int stream_server_open (struct StreamServer* server, int port, double rate, float precision, int capacity) {
+    memset(server, 0, sizeof(*server));
+
+    server->listener = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (server->listener < 0 || setsockopt(server->listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+        bind(server->listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(server->listener, 16) != 0) {
+        fprintf(stderr, "Could not stream on port %d\n", port);
+        if (server->listener >= 0) close(server->listener);
+        return 0;
+    }
+    set_nonblocking(server->listener);
+    signal(SIGPIPE, SIG_IGN);
+
+    server->capacity = capacity;
+    server->precision = precision;
+    server->interval = rate > 0.0 ? 1.0 / rate : 0.0;
+    server->last_publish = seconds_now() - server->interval;
+    server->zeros = calloc(capacity > 0 ? capacity : 1, sizeof(float));
+    if (server->zeros == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(1);
+    }
+    server->buffer_capacity = max_frame_size(capacity);
+    return 1;
+}
+
+static void drop_client (struct StreamServer* server, int n) {
+    struct StreamClient* client = &server->clients[n];
+    close(client->socket);
+    codec_free(&client->codec);
+    free(client->buffer);
+    server->clients[n] = server->clients[--server->client_count];
+}
+
+void stream_server_close (struct StreamServer* server) {
+    while (server->client_count > 0) {
+        drop_client(server, server->client_count - 1);
+    }
+    close(server->listener);
+    free(server->zeros);
+}
+
+static void accept_clients (struct StreamServer* server) {
+    for (;;) {
+        int fd = accept(server->listener, NULL, NULL);
+        if (fd < 0) return;
+        if (server->client_count == STREAM_MAX_CLIENTS) {
+            close(fd);
+            continue;
+        }
+        set_nonblocking(fd);
+        int nodelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        struct StreamClient* client = &server->clients[server->client_count++];
+        client->socket = fd;
+        codec_init(&client->codec, server->capacity, server->precision);
+        client->buffer = alloc_or_die(server->buffer_capacity);
+
+        struct StreamHeader header = {STREAM_MAGIC, STREAM_VERSION, sizeof(header), server->capacity, server->precision,
+                                      TRAJECTORY_FIELDS};
+        memcpy(client->buffer, &header, sizeof(header));
+        client->size = sizeof(header);
+        client->sent = 0;
+    }
+}
+
+// Sends as much of the pending frame as the socket takes. Returns 0 once the
+// viewer has gone.
+static int push (struct StreamClient* client) {
+    while (client->sent < client->size) {
+        ssize_t sent = send(client->socket, client->buffer + client->sent, client->size - client->sent, 0);
+        if (sent > 0) {
+            client->sent += sent;
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+    client->size = 0;
+    client->sent = 0;
+    return 1;
+}
+
+static void encode_frame (struct StreamServer* server, struct StreamClient* client, const struct Balls* balls, int count, long frame) {
+    float* fields[TRAJECTORY_FIELDS] = {balls->radius, balls->x_pos, balls->y_pos, server->zeros, server->zeros};
+    int slices = codec_slice_count(count);
+    uint8_t* table = client->buffer + sizeof(struct FrameHeader);
+    uint8_t* out = table + slices * sizeof(uint32_t);
+    for (int slice = 0; slice < slices; slice++) {
+        int begin = slice * CODEC_SLICE;
+        int end = begin + CODEC_SLICE < count ? begin + CODEC_SLICE : count;
+        uint32_t slice_size = codec_encode_slice(&client->codec, fields, begin, end, out);
+        memcpy(table + slice * sizeof(uint32_t), &slice_size, sizeof(slice_size));
+        out += slice_size;
+    }
+    codec_end_frame(&client->codec, count);
+
+    struct FrameHeader header = {frame, count, (uint32_t)(out - table)};
+    memcpy(client->buffer, &header, sizeof(header));
+    client->size = out - client->buffer;
+    client->sent = 0;
+    server->bytes_sent += client->size;
+}
+
+void stream_server_publish (struct StreamServer* server, const struct Balls* balls, int count, long frame) {
+    accept_clients(server);
+
+    double now = seconds_now();
+    int due = now - server->last_publish >= server->interval;
+    if (due) server->last_publish = now;
+
+    for (int n = 0; n < server->client_count;) {
+        struct StreamClient* client = &server->clients[n];
+        int alive = push(client);
+        if (alive && due) {
+            if (client->size > 0) {
+                server->frames_dropped++;
+            } else {
+                encode_frame(server, client, balls, count, frame);
+                server->frames_sent++;
+                alive = push(client);
+            }
+        }
+        if (!alive) {
+            drop_client(server, n);
+            continue;
+        }
+        n++;
+    }
+}
+
+static int read_all (int fd, void* data, size_t size) {
+    char* bytes = data;
+    while (size > 0) {
+        ssize_t got = read(fd, bytes, size);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return 0;
+        bytes += got;
+        size -= got;
+    }
+    return 1;
+}
+
+int stream_viewer_connect (struct StreamViewer* viewer, const char* address) {
+    memset(viewer, 0, sizeof(*viewer));
+    viewer->socket = -1;
+
+    char host[256];
+    const char* colon = strrchr(address, ':');
+    if (colon == NULL || colon - address >= (long)sizeof(host)) {
+        fprintf(stderr, "Expected host:port, not %s\n", address);
+        return 0;
+    }
+    memcpy(host, address, colon - address);
+    host[colon - address] = '\0';
+
+    struct addrinfo hints = {0};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* found;
+    if (getaddrinfo(host, colon + 1, &hints, &found) != 0) {
+        fprintf(stderr, "Cannot resolve %s\n", host);
+        return 0;
+    }
+    for (struct addrinfo* candidate = found; candidate != NULL && viewer->socket < 0; candidate = candidate->ai_next) {
+        viewer->socket = socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+        if (viewer->socket >= 0 && connect(viewer->socket, candidate->ai_addr, candidate->ai_addrlen) != 0) {
+            close(viewer->socket);
+            viewer->socket = -1;
+        }
+    }
+    freeaddrinfo(found);
+    if (viewer->socket < 0) {
+        fprintf(stderr, "Could not connect to %s\n", address);
+        return 0;
+    }
+
+    struct StreamHeader* header = &viewer->header;
+    if (!read_all(viewer->socket, header, sizeof(*header)) || header->magic != STREAM_MAGIC ||
+        header->version != STREAM_VERSION || header->header_size != sizeof(*header) ||
+        header->fields != TRAJECTORY_FIELDS || header->capacity <= 0 || !(header->precision >= 0.0f)) {
+        fprintf(stderr, "%s is not a version %d particle stream\n", address, STREAM_VERSION);
+        close(viewer->socket);
+        return 0;
+    }
+
+    codec_init(&viewer->codec, header->capacity, header->precision);
+    for (int field = 0; field < TRAJECTORY_FIELDS; field++) {
+        viewer->fields[field] = alloc_or_die(header->capacity * sizeof(float));
+    }
+    viewer->buffer_capacity = max_frame_size(header->capacity);
+    viewer->buffer = alloc_or_die(viewer->buffer_capacity);
+    viewer->frame = -1;
+    set_nonblocking(viewer->socket);
+    return 1;
+}
+
+void stream_viewer_close (struct StreamViewer* viewer) {
+    if (viewer->socket < 0) return;
+    close(viewer->socket);
+    codec_free(&viewer->codec);
+    for (int field = 0; field < TRAJECTORY_FIELDS; field++) {
+        free(viewer->fields[field]);
+    }
+    free(viewer->buffer);
+    viewer->socket = -1;
+}
+
+int stream_viewer_poll (struct StreamViewer* viewer) {
+    int fresh = 0;
+    int ended = 0;
+    size_t max_payload = viewer->buffer_capacity - sizeof(struct FrameHeader);
+
+    // The buffer always holds a whole frame, so when it fills up there is at
+    // least one to decode before reading on.
+    for (;;) {
+        while (viewer->filled < viewer->buffer_capacity) {
+            ssize_t got = recv(viewer->socket, viewer->buffer + viewer->filled, viewer->buffer_capacity - viewer->filled, 0);
+            if (got > 0) {
+                viewer->filled += got;
+                viewer->bytes_received += got;
+            } else if (got < 0 && errno == EINTR) {
+                continue;
+            } else {
+                ended = got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+                break;
+            }
+        }
+        int full = viewer->filled == viewer->buffer_capacity;
+
+        size_t offset = 0;
+        struct FrameHeader header;
+        while (viewer->filled - offset >= sizeof(header)) {
+            memcpy(&header, viewer->buffer + offset, sizeof(header));
+            if (header.count < 0 || header.count > viewer->header.capacity || header.byte_size > max_payload) return -1;
+            if (viewer->filled - offset - sizeof(header) < header.byte_size) break;
+
+            const uint8_t* payload = viewer->buffer + offset + sizeof(header);
+            if (!codec_decode_frame(&viewer->codec, payload, header.byte_size, header.count, viewer->fields)) return -1;
+            viewer->count = header.count;
+            viewer->frame = header.frame;
+            viewer->frames_received++;
+            fresh = 1;
+            offset += sizeof(header) + header.byte_size;
+        }
+        memmove(viewer->buffer, viewer->buffer + offset, viewer->filled - offset);
+        viewer->filled -= offset;
+
+        if (!full || ended) break;
+    }
+
+    if (fresh) return 1;
+    return ended ? -1 : 0;
+}
@@ -0,0 +1,101 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "balls.h"
+#include "codec.h"
+#include "trajectory.h"
+
+// Live frames over TCP for remote viewers. A connection starts with a
+// StreamHeader, then carries frames exactly as a delta-coded trajectory
+// does: a FrameHeader followed by one codec payload (codec.h). The first
+// frame a viewer gets is a keyframe and every later one is coded against
+// the frame before it on that connection.
+//
+// Viewers only draw, so velocities go out as zeros and cost a byte per
+// block. Numbers are little-endian, as on every machine the simulator
+// runs on.
+#define STREAM_MAGIC 0x52545350u // "PSTR"
+#define STREAM_VERSION 1
+#define STREAM_MAX_CLIENTS 16
+#define STREAM_DEFAULT_RATE 30.0
+// Positions are drawn, not analysed: a 2^-14 step is well under a pixel.
+#define STREAM_DEFAULT_PRECISION (1.0f / 16384.0f)
+
+struct StreamHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    int32_t capacity;
+    float precision;
+    uint32_t fields;
+};
+
+// Every client has its own codec, so a slow one can skip frames without
+// breaking the chain of deltas: a frame is only coded for a client once the
+// previous one has left, and otherwise dropped for that client alone.
+// Memory per client is bounded by one coded frame.
+struct StreamClient {
+    int socket;
+    struct Codec codec;
+    uint8_t* buffer;
+    size_t size;
+    size_t sent;
+};
+
+struct StreamServer {
+    int listener;
+    int capacity;
+    float precision;
+    double interval;
+    double last_publish;
+    float* zeros;
+    size_t buffer_capacity;
+
+    struct StreamClient clients[STREAM_MAX_CLIENTS];
+    int client_count;
+
+    long frames_sent;
+    long frames_dropped;
+    uint64_t bytes_sent;
+};
+
+// Listens on port on every interface. rate is in frames per second. Returns
+// 0 if the port cannot be opened.
+int stream_server_open (struct StreamServer* server, int port, double rate, float precision, int capacity);
+void stream_server_close (struct StreamServer* server);
+
+// Called once per simulated frame: takes new viewers, moves pending data
+// along and, when a frame is due, codes it for every viewer that is ready.
+// Never blocks.
+void stream_server_publish (struct StreamServer* server, const struct Balls* balls, int count, long frame);
+
+struct StreamViewer {
+    int socket;
+    struct StreamHeader header;
+    struct Codec codec;
+    float* fields[TRAJECTORY_FIELDS];
+    int count;
+    long frame;
+
+    uint8_t* buffer;
+    size_t filled;
+    size_t buffer_capacity;
+
+    long frames_received;
+    uint64_t bytes_received;
+};
+
+// Connects to a stream at host:port and reads its header. Returns 0 on
+// failure.
+int stream_viewer_connect (struct StreamViewer* viewer, const char* address);
+void stream_viewer_close (struct StreamViewer* viewer);
+
+// Decodes whatever has arrived without waiting. Returns 1 if fields now hold
+// a newer frame, 0 if nothing new came, and -1 once the stream has ended or
+// is damaged.
+int stream_viewer_poll (struct StreamViewer* viewer);
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <stdint.h>
+
+// On-disk layout of a recorded trajectory:
+//
+//   TrajectoryHeader
+//   chunk:  ChunkHeader, then frame_count frames of
+//           FrameHeader, radius, x_pos, y_pos, x_vel, y_vel (count floats
+//           each, or one codec payload with TRAJECTORY_CODEC_DELTA)
+//   chunk:  ...
+//   index:  one IndexEntry per frame
+//   TrajectoryFooter
+//
+// The footer sits at the very end so a reader can find the index with one
+// seek. A file cut short by a crash has no footer, but its chunks can still
+// be walked from the front since each one records its own size.
+//
+// With the delta codec (codec.h) the first frame of every chunk is a
+// keyframe, so decoding can start at any chunk.
+
+#define TRAJECTORY_MAGIC 0x4a525450u // "PTRJ"
+#define TRAJECTORY_CHUNK_MAGIC 0x4b4e4843u // "CHNK"
+#define TRAJECTORY_INDEX_MAGIC 0x58525450u // "PTRX"
+#define TRAJECTORY_VERSION 2
+
+#define TRAJECTORY_CODEC_RAW 0
+#define TRAJECTORY_CODEC_DELTA 1
+
+// Field order in frames and in RecordedFrame.
+#define TRAJECTORY_RADIUS 0
+#define TRAJECTORY_X_POS 1
+#define TRAJECTORY_Y_POS 2
+#define TRAJECTORY_X_VEL 3
+#define TRAJECTORY_Y_VEL 4
+#define TRAJECTORY_FIELDS 5
+
+struct TrajectoryHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t codec;
+    uint32_t chunk_frames;
+    uint32_t fields;
+    float precision; // quantization step of the delta codec, 0 for lossless
+    uint32_t slice_size;
+};
+
+struct ChunkHeader {
+    uint32_t magic;
+    uint32_t frame_count;
+    int64_t first_frame;
+    uint64_t byte_size; // of the frames that follow
+};
+
+struct FrameHeader {
+    int64_t frame;
+    int32_t count;
+    uint32_t byte_size; // of the arrays that follow
+};
+
+struct IndexEntry {
+    int64_t frame;
+    uint64_t chunk_offset;
+    uint64_t frame_offset;
+    uint32_t frame_in_chunk;
+    int32_t count;
+};
+
+struct TrajectoryFooter {
+    uint64_t index_offset;
+    uint64_t frame_count;
+    uint32_t magic;
+    uint32_t version;
+};
+
+#endif
@@ -0,0 +1,603 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "integrate.h"
+#include "jobs.h"
+#include "potential.h"
+#include "simd.h"
+#include "world.h"
+
+static int* alloc_ints (int* data, int capacity) {
+    data = realloc(data, (capacity > 0 ? capacity : 1) * sizeof(int));
+    if (data == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(1);
+    }
+    return data;
+}
+
+static void build_substep (struct World* world);
+static void build_pbd_substep (struct World* world);
+
+struct World* world_create (const struct WorldConfig* config) {
+    struct World* world = calloc(1, sizeof(struct World));
+    if (world == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        exit(1);
+    }
+
+    world->capacity = config->capacity;
+    world->fluid = config->fluid;
+    world->solver = config->solver;
+    world->iterations = config->iterations > 0 ? config->iterations : 4;
+    world->gravity = WORLD_DEFAULT_GRAVITY;
+    world->restitution = WORLD_DEFAULT_RESTITUTION;
+    world->rope_end = -1;
+
+    balls_alloc(&world->balls, world->capacity);
+    pbd_init(&world->pbd, world->capacity);
+    if (world->fluid) sph_init(&world->sph, world->capacity);
+    world->ids = alloc_ints(NULL, world->capacity);
+    world->index_of = alloc_ints(NULL, world->capacity);
+    world->free_ids = alloc_ints(NULL, world->capacity);
+    build_substep(world);
+    build_pbd_substep(world);
+    return world;
+}
+
+void world_destroy (struct World* world) {
+    if (world->fluid) sph_free(&world->sph);
+    links_free(&world->links);
+    pbd_free(&world->pbd);
+    islands_free(&world->islands);
+    contact_cache_free(&world->contact_cache);
+    contacts_free(&world->contacts);
+    contact_kernel_free(&world->contact_kernel);
+    broadphase_free(&world->broadphase);
+    balls_free(&world->balls);
+    free(world->ids);
+    free(world->index_of);
+    free(world->free_ids);
+    free(world);
+}
+
+void world_reserve (struct World* world, int capacity) {
+    if (capacity <= world->capacity) return;
+
+    // Also moves balls restored from a snapshot off the mapping.
+    struct Balls grown;
+    balls_alloc(&grown, capacity);
+    memcpy(grown.radius, world->balls.radius, world->count * sizeof(float));
+    memcpy(grown.x_pos, world->balls.x_pos, world->count * sizeof(float));
+    memcpy(grown.y_pos, world->balls.y_pos, world->count * sizeof(float));
+    memcpy(grown.x_vel, world->balls.x_vel, world->count * sizeof(float));
+    memcpy(grown.y_vel, world->balls.y_vel, world->count * sizeof(float));
+    memcpy(grown.mass, world->balls.mass, world->count * sizeof(float));
+    balls_free(&world->balls);
+    world->balls = grown;
+
+    // The solver arrays are scratch, refilled every step.
+    pbd_free(&world->pbd);
+    pbd_init(&world->pbd, capacity);
+    if (world->fluid) {
+        sph_free(&world->sph);
+        sph_init(&world->sph, capacity);
+    }
+
+    world->ids = alloc_ints(world->ids, capacity);
+    world->index_of = alloc_ints(world->index_of, capacity);
+    world->free_ids = alloc_ints(world->free_ids, capacity);
+    world->capacity = capacity;
+}
+
+int world_add (struct World* world, float x_pos, float y_pos, float x_vel, float y_vel, float radius) {
+    if (world->count >= world->capacity) return -1;
+
+    int i = world->count++;
+    world->balls.radius[i] = radius;
+    world->balls.x_pos[i] = x_pos;
+    world->balls.y_pos[i] = y_pos;
+    world->balls.x_vel[i] = x_vel;
+    world->balls.y_vel[i] = y_vel;
+    world->balls.mass[i] = M_PI * radius * radius * radius;
+
+    int id = world->free_count > 0 ? world->free_ids[--world->free_count] : world->next_id++;
+    world->ids[i] = id;
+    world->index_of[id] = i;
+    return id;
+}
+
+int world_remove (struct World* world, int id) {
+    int i = world_index(world, id);
+    if (i < 0) return 0;
+
+    int last = --world->count;
+    world->balls.radius[i] = world->balls.radius[last];
+    world->balls.x_pos[i] = world->balls.x_pos[last];
+    world->balls.y_pos[i] = world->balls.y_pos[last];
+    world->balls.x_vel[i] = world->balls.x_vel[last];
+    world->balls.y_vel[i] = world->balls.y_vel[last];
+    world->balls.mass[i] = world->balls.mass[last];
+
+    world->ids[i] = world->ids[last];
+    world->index_of[world->ids[i]] = i;
+    world->index_of[id] = -1;
+    world->free_ids[world->free_count++] = id;
+
+    links_remove_ball(&world->links, i, last);
+    contact_cache_clear(&world->contact_cache);
+    if (world->rope_end == i) world->rope_end = -1;
+    else if (world->rope_end == last) world->rope_end = i;
+    return 1;
+}
+
+int world_index (const struct World* world, int id) {
+    if (id < 0 || id >= world->next_id) return -1;
+    return world->index_of[id];
+}
+
+void world_renumber (struct World* world) {
+    for (int i = 0; i < world->count; i++) {
+        world->ids[i] = i;
+        world->index_of[i] = i;
+    }
+    world->next_id = world->count;
+    world->free_count = 0;
+}
+
+void world_clear (struct World* world) {
+    world->count = 0;
+    world->rope_end = -1;
+    world->links.count = 0;
+    world->links.coloured = 0;
+    contact_cache_free(&world->contact_cache);
+    memset(&world->contact_cache, 0, sizeof(world->contact_cache));
+    memset(&world->stats, 0, sizeof(world->stats));
+    world_renumber(world);
+}
+
+// Lays count fluid particles on a square lattice at rest spacing, row by
+// row from (x_pos, y_pos), columns wide.
+void world_add_fluid_block (struct World* world, float x_pos, float y_pos, int columns, int count) {
+    float spacing = sph_spacing();
+    for (int k = 0; k < count; k++) {
+        float x = x_pos + spacing * (k % columns);
+        float y = y_pos + spacing * (k / columns);
+        world_add(world, x, y, 0.0f, 0.0f, 0.5f * spacing);
+    }
+}
+
+// Dam break: a column of fluid against the left wall, as wide as half the
+// box unless it would not fit in the height.
+void world_seed_fluid (struct World* world, int count) {
+    float spacing = sph_spacing();
+    int columns = (int)(1.0f / spacing);
+    int max_rows = (int)(1.8f / spacing);
+    if (count > columns * max_rows) columns = count / max_rows + 1;
+    world_add_fluid_block(world, -1.0f + spacing, -1.0f + spacing, columns, count);
+}
+
+void world_seed_test_scene (struct World* world, int fluid_count) {
+    if (world->fluid) {
+        world_seed_fluid(world, fluid_count);
+        return;
+    }
+
+    for (int k = 0; k < 1600; k++) {
+        float radius = 0.008f + 0.004f * (k % 3);
+        float x = -0.9f + 0.036f * (k % 50);
+        float y = -0.9f + 0.036f * (k / 50);
+        world_add(world, x, y, 0.0f, 0.0f, radius);
+    }
+
+    world->rope_end = -1;
+    world_extend_rope(world, -0.8f, 0.6f, 0.01f);
+    world_extend_rope(world, 0.8f, 0.6f, 0.01f);
+    world_add_soft_body(world, -0.05f, 0.75f, 0.015f);
+}
+
+int world_check_determinism (const char* name, const struct WorldConfig* config, int frames, int fluid_count) {
+    static const int thread_counts[] = {1, 4, 16};
+    static const int broadphases[] = {BROADPHASE_AUTO, BROADPHASE_BRUTE, BROADPHASE_GRID, BROADPHASE_TREE};
+    int thread_runs = sizeof(thread_counts) / sizeof(thread_counts[0]);
+    int broadphase_runs = sizeof(broadphases) / sizeof(broadphases[0]);
+    uint64_t first_hash = 0;
+    int failures = 0;
+
+    for (int t = 0; t < thread_runs; t++) {
+        printf("%-8s %2d threads:", name, thread_counts[t]);
+        for (int b = 0; b < broadphase_runs; b++) {
+            jobs_init(thread_counts[t]);
+            struct World* world = world_create(config);
+            world->broadphase.mode = broadphases[b];
+            world_seed_test_scene(world, fluid_count);
+            world_step(world, frames);
+            uint64_t hash = balls_hash(&world->balls, world->count);
+            world_destroy(world);
+            jobs_shutdown();
+
+            if (t == 0 && b == 0) first_hash = hash;
+            int agrees = hash == first_hash;
+            if (!agrees) failures++;
+            printf(" %s %016llx%s", broadphase_name(broadphases[b]), (unsigned long long)hash, agrees ? "" : " MISMATCH");
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+    return failures;
+}
+
+// Continues the current rope from its last ball to (x_pos, y_pos), filling
+// the gap with touching balls held by rigid links.
+void world_extend_rope (struct World* world, float x_pos, float y_pos, float radius) {
+    struct Balls* balls = &world->balls;
+    if (world->rope_end < 0) {
+        if (world_add(world, x_pos, y_pos, 0.0f, 0.0f, radius) >= 0) world->rope_end = world->count - 1;
+        return;
+    }
+
+    float dx = x_pos - balls->x_pos[world->rope_end];
+    float dy = y_pos - balls->y_pos[world->rope_end];
+    float spacing = 2.0f * radius;
+    int segments = (int)(sqrtf(dx * dx + dy * dy) / spacing);
+
+    for (int k = 1; k <= segments && world->count < world->capacity; k++) {
+        float x = balls->x_pos[world->rope_end] + dx / segments;
+        float y = balls->y_pos[world->rope_end] + dy / segments;
+        float rest_length = sqrtf(dx * dx + dy * dy) / segments;
+        world_add(world, x, y, 0.0f, 0.0f, radius);
+        links_add(&world->links, world->rope_end, world->count - 1, rest_length, LINK_RIGID);
+        world->rope_end = world->count - 1;
+    }
+}
+
+// A square lattice of balls held together by springs along the edges and
+// both diagonals of every cell.
+void world_add_soft_body (struct World* world, float x_pos, float y_pos, float radius) {
+    if (world->count + SOFT_BODY_SIZE * SOFT_BODY_SIZE > world->capacity) return;
+
+    int first = world->count;
+    float spacing = 2.0f * radius;
+    for (int row = 0; row < SOFT_BODY_SIZE; row++) {
+        for (int column = 0; column < SOFT_BODY_SIZE; column++) {
+            world_add(world, x_pos + column * spacing, y_pos + row * spacing, 0.0f, 0.0f, radius);
+        }
+    }
+
+    for (int row = 0; row < SOFT_BODY_SIZE; row++) {
+        for (int column = 0; column < SOFT_BODY_SIZE; column++) {
+            int i = first + row * SOFT_BODY_SIZE + column;
+            if (column + 1 < SOFT_BODY_SIZE) {
+                links_add(&world->links, i, i + 1, spacing, LINK_SPRING);
+            }
+            if (row + 1 < SOFT_BODY_SIZE) {
+                links_add(&world->links, i, i + SOFT_BODY_SIZE, spacing, LINK_SPRING);
+            }
+            if (column + 1 < SOFT_BODY_SIZE && row + 1 < SOFT_BODY_SIZE) {
+                links_add(&world->links, i, i + SOFT_BODY_SIZE + 1, spacing * M_SQRT2, LINK_SPRING);
+                links_add(&world->links, i + 1, i + SOFT_BODY_SIZE, spacing * M_SQRT2, LINK_SPRING);
+            }
+        }
+    }
+}
+
+void world_apply_event (struct World* world, const struct SimEvent* event) {
+    switch (event->type) {
+    case EVENT_ADD_BALL:
+        world_add(world, event->x, event->y, 0.0f, 0.0f, event->radius);
+        break;
+    case EVENT_ADD_FLUID:
+        world_add_fluid_block(world, event->x, event->y, FLUID_BLOCK_SIZE, FLUID_BLOCK_SIZE * FLUID_BLOCK_SIZE);
+        break;
+    case EVENT_START_ROPE:
+        world->rope_end = -1;
+        world_extend_rope(world, event->x, event->y, event->radius);
+        break;
+    case EVENT_EXTEND_ROPE:
+        world_extend_rope(world, event->x, event->y, event->radius);
+        break;
+    case EVENT_ADD_SOFT_BODY:
+        world_add_soft_body(world, event->x, event->y, event->radius);
+        break;
+    }
+}
+
+#if !POTENTIAL_REPLACES_IMPULSES
+static void solve_islands (void* context, int begin, int end) {
+    struct World* world = context;
+    for (int n = begin; n < end; n++) {
+        struct Island* island = &world->islands.items[n];
+        struct Contact* island_contacts = world->contacts.items + island->contact_begin;
+        contacts_separate(island_contacts, island->contact_count, &world->balls, &world->contact_kernel);
+        contacts_solve(island_contacts, island->contact_count, &world->balls, world->iterations, &world->contact_kernel);
+    }
+}
+#endif
+
+static void find_pairs (struct World* world, float dt) {
+    struct Broadphase* broadphase = &world->broadphase;
+    struct SimStats* stats = &world->stats;
+
+    float reach = potential_reach();
+    float margin = world->solver == SOLVER_PBD ? PBD_CONTACT_MARGIN : CONTACT_MARGIN;
+    if (reach < margin) reach = margin;
+    broadphase_update(broadphase, &world->balls, world->count, reach);
+    if (broadphase->pair_count > stats->pairs) stats->pairs = broadphase->pair_count;
+
+#if PAIR_POTENTIAL != POTENTIAL_NONE
+    potential_apply(&world->balls, broadphase->pairs, broadphase->pair_count, dt);
+#else
+    (void)dt;
+#endif
+}
+
+// The impulse solver's substep as a task graph, built once per world:
+//
+//   broadphase -> contacts -> solve -> overlap -> integrate -> links -> walls
+//                                  \-> cache
+//
+// Storing the contact cache only reads the contacts, so it runs alongside
+// the rest of the substep. The solve node is sized by the contacts node once
+// it knows how many islands there are. In a world without links, integrate
+// also does the walls and the walls node is empty.
+static void broadphase_task (void* context, int begin, int end) {
+    struct World* world = context;
+    (void)begin;
+    (void)end;
+    find_pairs(world, 1.0f / SUBSTEPS);
+}
+
+static void overlap_task (void* context, int begin, int end) {
+    struct World* world = context;
+    (void)begin;
+    (void)end;
+    const struct Broadphase* broadphase = &world->broadphase;
+    float overlap = pairs_max_overlap(&world->balls, broadphase->pairs, broadphase->pair_count);
+    if (overlap > world->stats.max_overlap) world->stats.max_overlap = overlap;
+}
+
+#if !POTENTIAL_REPLACES_IMPULSES
+static void contacts_task (void* context, int begin, int end) {
+    struct World* world = context;
+    (void)begin;
+    (void)end;
+    const struct Broadphase* broadphase = &world->broadphase;
+    struct Contacts* contacts = &world->contacts;
+    float dt = 1.0f / SUBSTEPS;
+
+    float bounce_threshold = CONTACT_BOUNCE_THRESHOLD * fabsf(world->gravity) * dt;
+    contacts_build(contacts, &world->balls, broadphase->pairs, broadphase->pair_count, dt, bounce_threshold, world->restitution, &world->contact_kernel);
+
+    // Pairs that kept touching since the last substep start from the impulse
+    // they ended with, so resting stacks need only a few iterations.
+    world->cache_lookups = world->contact_cache.lookups;
+    world->cache_hits = world->contact_cache.hits;
+    contact_cache_warm_start(&world->contact_cache, contacts->items, contacts->count);
+
+    // Separate clusters of touching balls share no ball, so each island is an
+    // independent task.
+    islands_build(&world->islands, contacts->items, contacts->count, world->count);
+    task_graph_set_count(&world->substep, world->solve_node, world->islands.count);
+}
+
+static void cache_task (void* context, int begin, int end) {
+    struct World* world = context;
+    (void)begin;
+    (void)end;
+    struct SimStats* stats = &world->stats;
+    contact_cache_store(&world->contact_cache, world->contacts.items, world->contacts.count);
+    stats->cache_lookups += world->contact_cache.lookups - world->cache_lookups;
+    stats->cache_hits += world->contact_cache.hits - world->cache_hits;
+    stats_record_islands(stats, &world->islands);
+}
+
+#endif
+
+// The integrate and walls ranges count blocks of SIMD_WIDTH balls.
+static void run_integrate (struct World* world, int begin, int end, int passes) {
+    struct IntegrateParams params = {1.0f / SUBSTEPS, world->gravity, world->restitution, passes};
+    int last = end * SIMD_WIDTH < world->count ? end * SIMD_WIDTH : world->count;
+    integrate_balls(&world->balls, begin * SIMD_WIDTH, last, &params);
+}
+
+static void integrate_task (void* context, int begin, int end) {
+    struct World* world = context;
+    run_integrate(world, begin, end, world->integrate_passes);
+}
+
+static void links_task (void* context, int begin, int end) {
+    struct World* world = context;
+    (void)begin;
+    (void)end;
+    // Links correct the freshly integrated positions, the way position
+    // based dynamics projects its predictions.
+    links_solve(&world->links, &world->balls, world->count, 1.0f / SUBSTEPS);
+}
+
+static void walls_task (void* context, int begin, int end) {
+    struct World* world = context;
+    run_integrate(world, begin, end, INTEGRATE_WALLS);
+}
+
+static void build_substep (struct World* world) {
+    struct TaskGraph* graph = &world->substep;
+    task_graph_init(graph);
+
+    int broadphase = task_graph_add(graph, broadphase_task, world, 1, 1);
+    int before_integrate = broadphase;
+#if !POTENTIAL_REPLACES_IMPULSES
+    int contacts = task_graph_add(graph, contacts_task, world, 1, 1);
+    world->solve_node = task_graph_add(graph, solve_islands, world, 0, 1);
+    int cache = task_graph_add(graph, cache_task, world, 1, 1);
+    int overlap = task_graph_add(graph, overlap_task, world, 1, 1);
+    task_graph_depend(graph, contacts, broadphase);
+    task_graph_depend(graph, world->solve_node, contacts);
+    task_graph_depend(graph, cache, world->solve_node);
+    task_graph_depend(graph, overlap, world->solve_node);
+    before_integrate = overlap;
+#endif
+    world->integrate_node = task_graph_add(graph, integrate_task, world, 0, WORLD_GRAIN / SIMD_WIDTH);
+    int links = task_graph_add(graph, links_task, world, 1, 1);
+    world->walls_node = task_graph_add(graph, walls_task, world, 0, WORLD_GRAIN / SIMD_WIDTH);
+    task_graph_depend(graph, world->integrate_node, before_integrate);
+    task_graph_depend(graph, links, world->integrate_node);
+    task_graph_depend(graph, world->walls_node, links);
+}
+
+static void pbd_begin_task (void* context, int begin, int end) {
+    struct World* world = context;
+    (void)begin;
+    (void)end;
+    pbd_begin(&world->pbd, &world->balls, world->count);
+}
+
+static void pbd_contacts_task (void* context, int begin, int end) {
+    struct World* world = context;
+    (void)begin;
+    (void)end;
+    const struct Broadphase* broadphase = &world->broadphase;
+    pbd_project_contacts(&world->balls, broadphase->pairs, broadphase->pair_count, world->count, world->iterations);
+}
+
+static void pbd_end_task (void* context, int begin, int end) {
+    struct World* world = context;
+    (void)begin;
+    (void)end;
+    const struct Broadphase* broadphase = &world->broadphase;
+    pbd_end(&world->pbd, &world->balls, world->count, broadphase->pairs, broadphase->pair_count, 1.0f / SUBSTEPS,
+            world->gravity, world->restitution);
+}
+
+// The position-based solver's substep, built once per world:
+//
+//   broadphase -> integrate -> contacts -> links -> end -> overlap
+//        begin -/
+//
+// It projects the pairs after integration. Remembering where the balls
+// started only reads them, as the broadphase does, so the two run side by
+// side.
+static void build_pbd_substep (struct World* world) {
+    struct TaskGraph* graph = &world->pbd_substep;
+    task_graph_init(graph);
+
+    int broadphase = task_graph_add(graph, broadphase_task, world, 1, 1);
+    int begin = task_graph_add(graph, pbd_begin_task, world, 1, 1);
+    world->pbd_integrate_node = task_graph_add(graph, integrate_task, world, 0, WORLD_GRAIN / SIMD_WIDTH);
+    int contacts = task_graph_add(graph, pbd_contacts_task, world, 1, 1);
+    int links = task_graph_add(graph, links_task, world, 1, 1);
+    int end = task_graph_add(graph, pbd_end_task, world, 1, 1);
+    int overlap = task_graph_add(graph, overlap_task, world, 1, 1);
+    task_graph_depend(graph, world->pbd_integrate_node, broadphase);
+    task_graph_depend(graph, world->pbd_integrate_node, begin);
+    task_graph_depend(graph, contacts, world->pbd_integrate_node);
+    task_graph_depend(graph, links, contacts);
+    task_graph_depend(graph, end, links);
+    task_graph_depend(graph, overlap, end);
+}
+
+// Advances one frame. Velocities are in units per frame, so each substep
+// integrates over dt = 1 / SUBSTEPS of a frame.
+static void step_frame (struct World* world) {
+    struct Balls* balls = &world->balls;
+    int count = world->count;
+    int blocks = (count + SIMD_WIDTH - 1) / SIMD_WIDTH;
+
+    if (world->fluid) {
+        sph_step(&world->sph, balls, count, world->gravity);
+        parallel_for(blocks, WORLD_GRAIN / SIMD_WIDTH, walls_task, world);
+        return;
+    }
+
+    if (world->solver == SOLVER_PBD) {
+        world->integrate_passes = INTEGRATE_MOVE;
+        task_graph_set_count(&world->pbd_substep, world->pbd_integrate_node, blocks);
+        for (int substep = 0; substep < SUBSTEPS; substep++) {
+            task_graph_run(&world->pbd_substep);
+        }
+        return;
+    }
+
+#if !POTENTIAL_REPLACES_IMPULSES
+    // Balls only come and go between frames, so the contact kernel fits the
+    // whole frame.
+    contact_kernel_choose(&world->contact_kernel, balls, count);
+    world->stats.contact_kernel = world->contact_kernel.kind;
+    world->stats.radius_classes = world->contact_kernel.class_count;
+#endif
+
+    // With no links nothing moves a ball between integrating it and the
+    // walls, so both happen in one pass and the walls node has nothing to do.
+    int fused = world->links.count == 0;
+    world->integrate_passes = fused ? INTEGRATE_MOVE | INTEGRATE_WALLS : INTEGRATE_MOVE;
+    task_graph_set_count(&world->substep, world->integrate_node, blocks);
+    task_graph_set_count(&world->substep, world->walls_node, fused ? 0 : blocks);
+    for (int substep = 0; substep < SUBSTEPS; substep++) {
+        task_graph_run(&world->substep);
+    }
+}
+
+void world_set_gravity (struct World* world, float gravity) {
+    world->gravity = gravity;
+}
+
+void world_set_restitution (struct World* world, float restitution) {
+    world->restitution = restitution;
+}
+
+void world_step (struct World* world, int steps) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int step = 0; step < steps; step++) {
+        stats_begin_frame(&world->stats);
+        step_frame(world);
+    }
+    world->stats.balls = world->count;
+    world->stats.solver_iterations = world->iterations;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    world->step_ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) * 1e-6;
+}
+
+void world_view (struct World* world, struct WorldView* view) {
+    view->count = world->count;
+    view->x_pos = world->balls.x_pos;
+    view->y_pos = world->balls.y_pos;
+    view->x_vel = world->balls.x_vel;
+    view->y_vel = world->balls.y_vel;
+    view->radius = world->balls.radius;
+    view->ids = world->ids;
+}
+
+static double kinetic_energy (void* context, int begin, int end) {
+    const struct Balls* balls = context;
+    double energy = 0.0;
+    for (int i = begin; i < end; i++) {
+        double speed2 = balls->x_vel[i] * balls->x_vel[i] + balls->y_vel[i] * balls->y_vel[i];
+        energy += 0.5 * balls->mass[i] * speed2;
+    }
+    return energy;
+}
+
+double world_kinetic_energy (const struct World* world) {
+    // kinetic_energy only reads the balls.
+    return parallel_sum(world->count, kinetic_energy, (void*)&world->balls);
+}
+
+void world_stats (const struct World* world, struct WorldStats* stats) {
+    stats->frame = world->stats.frame;
+    stats->count = world->count;
+    stats->capacity = world->capacity;
+    stats->links = world->links.count;
+    stats->pairs = world->stats.pairs;
+    stats->max_overlap = world->stats.max_overlap;
+    stats->cache_lookups = world->stats.cache_lookups;
+    stats->cache_hits = world->stats.cache_hits;
+    stats->island_count = world->stats.island_count;
+    stats->largest_island = world->stats.largest_island;
+    stats->kinetic_energy = world_kinetic_energy(world);
+    stats->step_ms = world->step_ms;
+}
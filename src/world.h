@@ -0,0 +1,100 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include "balls.h"
+#include "broadphase.h"
+#include "contact_cache.h"
+#include "contacts.h"
+#include "events.h"
+#include "islands.h"
+#include "jobs.h"
+#include "links.h"
+#include "particles.h"
+#include "pbd.h"
+#include "sph.h"
+#include "stats.h"
+
+#define SUBSTEPS 4
+#define FLUID_BLOCK_SIZE 8
+#define SOFT_BODY_SIZE 5
+// Balls per task when integrating and clamping to the walls.
+#define WORLD_GRAIN 2048
+
+// Everything one simulation owns. Kept out of particles.h so library users
+// only see the handle; the viewer and the tools built with the library use
+// the fields directly for snapshots, rewinding and recording.
+struct World {
+    int capacity;
+    int count;
+    struct Balls balls;
+
+    // ids[i] is the id of the ball at index i and index_of[id] its index, or
+    // -1; removed ids wait in free_ids to be reused.
+    int* ids;
+    int* index_of;
+    int* free_ids;
+    int free_count;
+    int next_id;
+
+    struct Broadphase broadphase;
+    struct Contacts contacts;
+    struct ContactKernel contact_kernel;
+    struct ContactCache contact_cache;
+    struct Islands islands;
+    long cache_lookups;
+    long cache_hits;
+
+    // One substep of the impulse solver; see build_substep.
+    struct TaskGraph substep;
+    int solve_node;
+    int integrate_node;
+    int integrate_passes;
+    int walls_node;
+    // The same for the position-based solver; see build_pbd_substep.
+    struct TaskGraph pbd_substep;
+    int pbd_integrate_node;
+
+    struct Links links;
+    int rope_end;
+
+    int fluid;
+    struct Sph sph;
+
+    int solver;
+    int iterations;
+    struct Pbd pbd;
+
+    float gravity;
+    float restitution;
+
+    struct SimStats stats;
+    double step_ms;
+};
+
+// Scene building, as used by the viewer's inputs.
+void world_add_fluid_block (struct World* world, float x_pos, float y_pos, int columns, int count);
+void world_seed_fluid (struct World* world, int count);
+void world_extend_rope (struct World* world, float x_pos, float y_pos, float radius);
+void world_add_soft_body (struct World* world, float x_pos, float y_pos, float radius);
+void world_apply_event (struct World* world, const struct SimEvent* event);
+
+// A fixed scene touching every solver: piles of mixed sizes, a rope across
+// the middle and a soft body dropped on top, or a dam break of fluid_count
+// particles in fluid mode. Used by the determinism checks.
+void world_seed_test_scene (struct World* world, int fluid_count);
+// Steps the test scene for frames frames on 1, 4 and 16 threads under every
+// broadphase, automatic choice included, printing each run's hash. Starts
+// and stops the job pool for each run. Returns how many runs disagree with
+// the first.
+int world_check_determinism (const char* name, const struct WorldConfig* config, int frames, int fluid_count);
+
+// Empties the world, keeping its capacity and settings.
+void world_clear (struct World* world);
+
+// Makes every ball's id its index again, after count and the arrays were
+// loaded wholesale from a snapshot or a keyframe.
+void world_renumber (struct World* world);
+
+double world_kinetic_energy (const struct World* world);
+
+#endif
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "balls.h"
+#include "integrate.h"
+#include "jobs.h"
+#include "particles.h"
+#include "simd.h"
+
+// Times one substep of moving and bouncing a million balls three ways: the
+// scalar passes as separate loops, the fused SIMD kernel on one thread, and
+// the fused kernel across the job pool. Balls start scattered with a few
+// outside the box, so every wall test is taken by some of them.
+//
+//   integrate_bench [balls] [repeats] [threads]
+
+#define BENCH_GRAIN 4096
+
+struct Bench {
+    struct Balls* balls;
+    int count;
+    const struct IntegrateParams* params;
+};
+
+static double now_seconds () {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static float random_between (float low, float high) {
+    return low + (high - low) * (float)rand() / (float)RAND_MAX;
+}
+
+static void scatter (struct Balls* balls, int count) {
+    srand(1);
+    for (int i = 0; i < count; i++) {
+        balls->radius[i] = random_between(0.001f, 0.01f);
+        balls->x_pos[i] = random_between(-1.02f, 1.02f);
+        balls->y_pos[i] = random_between(-1.02f, 1.02f);
+        balls->x_vel[i] = random_between(-0.01f, 0.01f);
+        balls->y_vel[i] = random_between(-0.01f, 0.01f);
+        balls->mass[i] = balls->radius[i] * balls->radius[i];
+    }
+}
+
+static void copy_balls (struct Balls* to, const struct Balls* from, int count) {
+    memcpy(to->radius, from->radius, count * sizeof(float));
+    memcpy(to->x_pos, from->x_pos, count * sizeof(float));
+    memcpy(to->y_pos, from->y_pos, count * sizeof(float));
+    memcpy(to->x_vel, from->x_vel, count * sizeof(float));
+    memcpy(to->y_vel, from->y_vel, count * sizeof(float));
+}
+
+static void integrate_blocks (void* context, int begin, int end) {
+    struct Bench* bench = context;
+    int last = end * SIMD_WIDTH < bench->count ? end * SIMD_WIDTH : bench->count;
+    integrate_balls(bench->balls, begin * SIMD_WIDTH, last, bench->params);
+}
+
+static int count_differences (const struct Balls* a, const struct Balls* b, int count) {
+    int differences = 0;
+    for (int i = 0; i < count; i++) {
+        if (a->x_pos[i] != b->x_pos[i] || a->y_pos[i] != b->y_pos[i] || a->x_vel[i] != b->x_vel[i] ||
+            a->y_vel[i] != b->y_vel[i]) {
+            differences++;
+        }
+    }
+    return differences;
+}
+
+int main (int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    int repeats = argc > 2 ? atoi(argv[2]) : 50;
+    int thread_count = argc > 3 ? atoi(argv[3]) : 0;
+    if (count < 1 || repeats < 1) {
+        fprintf(stderr, "Usage: %s [balls] [repeats] [threads]\n", argv[0]);
+        return 1;
+    }
+
+    struct Balls start, scalar, fused;
+    balls_alloc(&start, count);
+    balls_alloc(&scalar, count);
+    balls_alloc(&fused, count);
+    scatter(&start, count);
+
+    struct IntegrateParams params = {0.25f, WORLD_DEFAULT_GRAVITY, WORLD_DEFAULT_RESTITUTION, INTEGRATE_MOVE | INTEGRATE_WALLS};
+    int blocks = (count + SIMD_WIDTH - 1) / SIMD_WIDTH;
+    struct Bench bench = {&fused, count, &params};
+
+    // Every repeat starts from the same balls, and copying them back is not
+    // timed.
+    double scalar_seconds = 0.0;
+    double simd_seconds = 0.0;
+    double parallel_seconds = 0.0;
+    int differences = 0;
+    jobs_init(thread_count);
+
+    for (int r = 0; r < repeats; r++) {
+        copy_balls(&scalar, &start, count);
+        double begin = now_seconds();
+        integrate_balls_scalar(&scalar, 0, count, &params);
+        scalar_seconds += now_seconds() - begin;
+
+        copy_balls(&fused, &start, count);
+        begin = now_seconds();
+        integrate_balls(&fused, 0, count, &params);
+        simd_seconds += now_seconds() - begin;
+        differences += count_differences(&scalar, &fused, count);
+
+        copy_balls(&fused, &start, count);
+        begin = now_seconds();
+        parallel_for(blocks, BENCH_GRAIN / SIMD_WIDTH, integrate_blocks, &bench);
+        parallel_seconds += now_seconds() - begin;
+        differences += count_differences(&scalar, &fused, count);
+    }
+
+    double scale = 1e9 / ((double)repeats * count);
+    printf("%d balls, %d repeats, %d threads\n", count, repeats, jobs_thread_count());
+    printf("  scalar loops       %6.3f ns/ball\n", scalar_seconds * scale);
+    printf("  fused SIMD         %6.3f ns/ball  %.2fx\n", simd_seconds * scale, scalar_seconds / simd_seconds);
+    printf("  fused SIMD, pool   %6.3f ns/ball  %.2fx\n", parallel_seconds * scale, scalar_seconds / parallel_seconds);
+    printf("  %d balls differ from the scalar result\n", differences);
+
+    jobs_shutdown();
+    balls_free(&start);
+    balls_free(&scalar);
+    balls_free(&fused);
+    return differences != 0;
+}
@@ -0,0 +1,194 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "shm_export.h"
+
+// Drives a simulator started with --serve <socket>: spawns balls in one
+// request, steps them one request at a time both waiting for every answer
+// and pipelined, fetches the positions back and attaches to the shared
+// segment. Prints how long each part took.
+
+struct Pipeline {
+    int socket;
+    int steps;
+};
+
+static double now_seconds () {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void read_all (int fd, void* data, size_t size) {
+    char* bytes = data;
+    while (size > 0) {
+        ssize_t got = read(fd, bytes, size);
+        if (got <= 0) {
+            fprintf(stderr, "Server closed the connection\n");
+            exit(1);
+        }
+        bytes += got;
+        size -= got;
+    }
+}
+
+static void write_all (int fd, const void* data, size_t size) {
+    const char* bytes = data;
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written <= 0) {
+            fprintf(stderr, "Server closed the connection\n");
+            exit(1);
+        }
+        bytes += written;
+        size -= written;
+    }
+}
+
+static void send_request (int fd, uint32_t command, uint32_t tag, uint64_t arg, const void* payload, uint64_t size) {
+    struct ServerRequest request = {command, tag, arg, size};
+    write_all(fd, &request, sizeof(request));
+    write_all(fd, payload, size);
+}
+
+// Reads one answer; a payload goes to data, which must hold it.
+static struct ServerResponse receive (int fd, void* data) {
+    struct ServerResponse response;
+    read_all(fd, &response, sizeof(response));
+    if (response.status != SERVER_OK) {
+        char message[256] = {0};
+        read_all(fd, message, response.size < sizeof(message) - 1 ? response.size : sizeof(message) - 1);
+        fprintf(stderr, "Request %u failed: %s\n", response.tag, message);
+        exit(1);
+    }
+    if (response.size > 0) read_all(fd, data, response.size);
+    return response;
+}
+
+// Requests go out from a thread of their own so the answers are read as
+// they come, which keeps both socket buffers from filling up.
+static void* send_steps (void* arg) {
+    struct Pipeline* pipeline = arg;
+    for (int n = 0; n < pipeline->steps; n++) {
+        send_request(pipeline->socket, SERVER_STEP, n, 1, NULL, 0);
+    }
+    return NULL;
+}
+
+static int receive_fd (int fd, struct ServerResponse* response) {
+    struct iovec data = {response, sizeof(*response)};
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr message = {0};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    if (recvmsg(fd, &message, MSG_WAITALL) != sizeof(*response)) return -1;
+
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    if (header == NULL || header->cmsg_type != SCM_RIGHTS) return -1;
+    int received;
+    memcpy(&received, CMSG_DATA(header), sizeof(int));
+    return received;
+}
+
+int main (int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <socket> [balls] [steps]\n", argv[0]);
+        return 1;
+    }
+    int count = argc > 2 ? atoi(argv[2]) : 10000;
+    int steps = argc > 3 ? atoi(argv[3]) : 1000;
+
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, argv[1], sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        fprintf(stderr, "Could not connect to %s; is the simulator running with --serve?\n", argv[1]);
+        return 1;
+    }
+
+    float* fields = malloc(5 * count * sizeof(float));
+    int32_t* ids = malloc(count * sizeof(int32_t));
+    if (fields == NULL || ids == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        return 1;
+    }
+    for (int i = 0; i < count; i++) {
+        fields[i] = (float)rand() / RAND_MAX * 1.8f - 0.9f;
+        fields[count + i] = (float)rand() / RAND_MAX * 1.8f - 0.9f;
+        fields[2 * count + i] = 0.0f;
+        fields[3 * count + i] = 0.0f;
+        fields[4 * count + i] = 0.004f;
+    }
+
+    double start = now_seconds();
+    send_request(fd, SERVER_SPAWN, 0, count, fields, 5 * count * sizeof(float));
+    receive(fd, ids);
+    printf("spawned %d balls in %.2f ms\n", count, (now_seconds() - start) * 1e3);
+
+    // One step per request both ways, so the difference is the round trips.
+    int waited = steps < 100 ? steps : 100;
+    start = now_seconds();
+    for (int n = 0; n < waited; n++) {
+        send_request(fd, SERVER_STEP, n, 1, NULL, 0);
+        receive(fd, NULL);
+    }
+    double waited_seconds = now_seconds() - start;
+    printf("waiting:   %d steps, %.3f ms each\n", waited, waited_seconds * 1e3 / waited);
+
+    struct Pipeline pipeline = {fd, steps};
+    pthread_t sender;
+    start = now_seconds();
+    pthread_create(&sender, NULL, send_steps, &pipeline);
+    struct ServerResponse response;
+    for (int n = 0; n < steps; n++) {
+        response = receive(fd, NULL);
+    }
+    pthread_join(sender, NULL);
+    double pipelined_seconds = now_seconds() - start;
+    printf("pipelined: %d steps, %.3f ms each, frame %llu\n", steps, pipelined_seconds * 1e3 / steps,
+           (unsigned long long)response.value);
+
+    start = now_seconds();
+    send_request(fd, SERVER_FETCH, 0, SERVER_FIELD_X_POS | SERVER_FIELD_Y_POS, NULL, 0);
+    response = receive(fd, fields);
+    double fetch_seconds = now_seconds() - start;
+    int fetched = (int)response.value;
+    double mean_height = 0.0;
+    for (int i = 0; i < fetched; i++) {
+        mean_height += fields[fetched + i];
+    }
+    printf("fetched %d positions in %.2f ms (%.0f MB/s), mean height %.4f\n", fetched, fetch_seconds * 1e3,
+           response.size / fetch_seconds / 1e6, fetched > 0 ? mean_height / fetched : 0.0);
+
+    send_request(fd, SERVER_ATTACH, 0, 0, NULL, 0);
+    int segment = receive_fd(fd, &response);
+    if (segment < 0) {
+        fprintf(stderr, "No segment came back\n");
+        return 1;
+    }
+    void* base = mmap(NULL, response.value, PROT_READ, MAP_SHARED, segment, 0);
+    close(segment);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Could not map the segment\n");
+        return 1;
+    }
+    struct ShmHeader* header = base;
+    printf("attached: frame %lld, %d balls\n", (long long)header->frame, header->count);
+
+    munmap(base, response.value);
+    close(fd);
+    free(fields);
+    free(ids);
+    return 0;
+}
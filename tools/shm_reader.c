@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "shm_export.h"
+
+// Attaches to a simulator started with --shm <name> and prints, once a
+// second, its frame rate, ball count and mean height. Run for a number of
+// seconds, or until interrupted.
+
+struct Sample {
+    long frame;
+    int count;
+    double mean_height;
+    int64_t published_ns;
+};
+
+static int64_t now_ns () {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Reads one whole frame under the seqlock, straight from the mapping.
+// Returns how many attempts were thrown away because a step was under way.
+static int read_sample (struct ShmHeader* header, const unsigned char* base, struct Sample* sample) {
+    struct timespec pause = {0, 100000};
+    for (int retries = 0;; retries++) {
+        uint64_t before = atomic_load_explicit(&header->sequence, memory_order_acquire);
+        if (before & 1) {
+            nanosleep(&pause, NULL);
+            continue;
+        }
+
+        sample->frame = header->frame;
+        sample->count = header->count;
+        sample->published_ns = header->published_ns;
+        int count = sample->count < header->capacity ? sample->count : header->capacity;
+        const float* y_pos = (const float*)(base + header->field_offset[2]);
+        double sum = 0.0;
+        for (int i = 0; i < count; i++) {
+            sum += y_pos[i];
+        }
+        sample->mean_height = count > 0 ? sum / count : 0.0;
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&header->sequence, memory_order_relaxed) == before) return retries;
+    }
+}
+
+int main (int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <name> [seconds]\n", argv[0]);
+        return 1;
+    }
+    int seconds = argc > 2 ? atoi(argv[2]) : 0;
+
+    int fd = shm_open(argv[1], O_RDONLY, 0);
+    if (fd < 0) {
+        fprintf(stderr, "No shared memory named %s; is the simulator running with --shm?\n", argv[1]);
+        return 1;
+    }
+
+    struct ShmHeader first;
+    if (pread(fd, &first, sizeof(first), 0) != sizeof(first) || first.magic != SHM_MAGIC ||
+        first.version != SHM_VERSION || first.header_size != sizeof(first)) {
+        fprintf(stderr, "%s is not a version %d particle segment\n", argv[1], SHM_VERSION);
+        close(fd);
+        return 1;
+    }
+
+    unsigned char* base = mmap(NULL, first.size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Could not map %s\n", argv[1]);
+        return 1;
+    }
+    struct ShmHeader* header = (struct ShmHeader*)base;
+
+    struct Sample last;
+    read_sample(header, base, &last);
+    int64_t last_ns = now_ns();
+    printf("%s: capacity %d, frame %ld, %d balls\n", argv[1], header->capacity, last.frame, last.count);
+
+    for (int tick = 0; seconds <= 0 || tick < seconds; tick++) {
+        sleep(1);
+        struct Sample sample;
+        int retries = read_sample(header, base, &sample);
+        int64_t ns = now_ns();
+
+        double fps = (sample.frame - last.frame) * 1e9 / (ns - last_ns);
+        double age_ms = (ns - sample.published_ns) * 1e-6;
+        printf("frame %ld: %.1f fps, %d balls, mean height %.4f, frame age %.1f ms, %d torn reads\n",
+               sample.frame, fps, sample.count, sample.mean_height, age_ms, retries);
+        fflush(stdout);
+
+        last = sample;
+        last_ns = ns;
+    }
+
+    munmap(base, first.size);
+    return 0;
+}